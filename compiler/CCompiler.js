@@ -8,11 +8,12 @@ var __importStar = (this && this.__importStar) || function (mod) {
 };
 Object.defineProperty(exports, "__esModule", { value: true });
 const ts = __importStar(require("typescript"));
-var CC;
-(function (CC) {
+
+
+(function(CC) {
     function isPublicProperty(node) {
         if (node.modifiers !== undefined) {
-            for (let m of node.modifiers) {
+            for (let m of node.modifiers){
                 if (m.kind == ts.SyntaxKind.PrivateKeyword || m.kind == ts.SyntaxKind.ProtectedKeyword) {
                     return false;
                 }
@@ -36,7 +37,7 @@ var CC;
         }
         if ((type.flags & ts.TypeFlags.Object) != 0 && !type.isClassOrInterface()) {
             let t = type;
-            return t.typeArguments !== undefined;
+            return t.typeArguments !== undefined && !isGenericType(type) && !isLibType(type);
         }
         return false;
     }
@@ -56,9 +57,8 @@ var CC;
     function isObjectWeakType(type) {
         if (isObjectType(type)) {
             if ((type.flags & ts.TypeFlags.Union) != 0) {
-                for (let t of type.types) {
-                    if (t.name !== undefined &&
-                        (t.name == "weak") || t.name.endsWith(".weak")) {
+                for (let t of type.types){
+                    if (t.name !== undefined && t.name == "weak" || t.name.endsWith(".weak")) {
                         return true;
                     }
                 }
@@ -67,6 +67,81 @@ var CC;
         }
         return false;
     }
+    function isGenericDeclaration(node) {
+        return (ts.isClassDeclaration(node) || ts.isInterfaceDeclaration(node) || ts.isFunctionDeclaration(node)) && node.typeParameters !== undefined && node.typeParameters.length > 0;
+    }
+    function getGenericDeclaration(type) {
+        if (type.symbol === undefined || type.symbol.declarations === undefined) {
+            return undefined;
+        }
+        return type.symbol.declarations.find((d)=>{
+            return (ts.isClassDeclaration(d) || ts.isInterfaceDeclaration(d)) && isGenericDeclaration(d) && !d.getSourceFile().isDeclarationFile;
+        });
+    }
+    function isGenericType(type) {
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        return (type.flags & ts.TypeFlags.Object) != 0 && type.typeArguments !== undefined && getGenericDeclaration(type) !== undefined;
+    }
+    function genericArguments(type) {
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        let t = type;
+        return typeArguments(t, t.typeArguments.slice(0, getGenericDeclaration(type).typeParameters.length));
+    }
+    function typeArguments(t, vs) {
+        vs.forEach((v, i)=>{
+            if ((v.flags & ts.TypeFlags.Number) != 0) {
+                v.name = t.argumentNames !== undefined ? t.argumentNames[i] : "number";
+            }
+        });
+        return vs;
+    }
+    function isTypeParameter(type) {
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        return (type.flags & ts.TypeFlags.TypeParameter) != 0;
+    }
+    function isClassTypeParameter(type) {
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        if (!isTypeParameter(type) || type.symbol === undefined || type.symbol.declarations === undefined) {
+            return false;
+        }
+        let p = type.symbol.declarations[0].parent;
+        return ts.isClassDeclaration(p) || ts.isInterfaceDeclaration(p);
+    }
+    function genericScope(node) {
+        var p = node.parent;
+        while(p !== undefined){
+            if (isGenericDeclaration(p)) {
+                return p;
+            }
+            p = p.parent;
+        }
+        return undefined;
+    }
+    function templateArguments(node) {
+        if (node === undefined || !isGenericDeclaration(node)) {
+            return "";
+        }
+        return "<" + node.typeParameters.map((v)=>v.name.text).join(",") + ">";
+    }
+    function isStringConcat(e, checker) {
+        return ts.isBinaryExpression(e) && e.operatorToken.kind == ts.SyntaxKind.PlusToken && (checker.getTypeAtLocation(e).flags & ts.TypeFlags.StringLike) != 0;
+    }
+    function stringConcatOperands(e, checker, vs) {
+        if (ts.isBinaryExpression(e) && isStringConcat(e, checker)) {
+            stringConcatOperands(e.left, checker, vs);
+            stringConcatOperands(e.right, checker, vs);
+        } else {
+            vs.push(e);
+        }
+    }
     function getTypeAtLocation(node, checker) {
         if (node === undefined) {
             return undefined;
@@ -76,21 +151,72 @@ var CC;
             return undefined;
         }
         type.name = node.getText();
+        if (ts.isTypeReferenceNode(node) && node.typeArguments !== undefined) {
+            type.argumentNames = node.typeArguments.map((v)=>v.getText());
+        }
         if (type.types !== undefined) {
             var i = 0;
-            ts.forEachChild(node, (node) => {
+            ts.forEachChild(node, (node)=>{
                 if (ts.isTypeNode(node)) {
                     let type = checker.getTypeAtLocation(node);
                     type.name = node.getText();
+                    if (ts.isTypeReferenceNode(node) && node.typeArguments !== undefined) {
+                        type.argumentNames = node.typeArguments.map((v)=>v.getText());
+                    }
                 }
             });
         }
         return type;
     }
+    const LibTypes = {
+        "float64array": "Float64Array",
+        "int32array": "Int32Array",
+        "channel": "Channel",
+        "concurrentMap": "ConcurrentMap"
+    };
+    function isLibType(type) {
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        let symbol = type.symbol;
+        if (symbol === undefined || LibTypes[symbol.name] === undefined || symbol.declarations === undefined) {
+            return false;
+        }
+        return symbol.declarations.some((d)=>d.getSourceFile().isDeclarationFile);
+    }
+    function getLibType(type, options) {
+        if (type === undefined || !isLibType(type)) {
+            return undefined;
+        }
+        let t = type.getNonNullableType();
+        let s = options.lib + "::" + LibTypes[t.symbol.name];
+        if (t.typeArguments !== undefined && t.typeArguments.length > 0) {
+            s += "<" + typeArguments(t, t.typeArguments.slice()).map((v)=>getType(v, options)).join(",") + ">";
+        }
+        return s;
+    }
+    const LibFunctions = {
+        "parallelFor": "parallelFor",
+        "parallelMap": "parallelMap",
+        "parallelReduce": "parallelReduce"
+    };
+    function getLibFunction(e, checker, options) {
+        var symbol = checker.getSymbolAtLocation(ts.isPropertyAccessExpression(e) ? e.name : e);
+        if (symbol !== undefined && (symbol.flags & ts.SymbolFlags.Alias) != 0) {
+            symbol = checker.getAliasedSymbol(symbol);
+        }
+        if (symbol === undefined || LibFunctions[symbol.name] === undefined || symbol.valueDeclaration === undefined) {
+            return undefined;
+        }
+        if (ts.isFunctionDeclaration(symbol.valueDeclaration) && symbol.valueDeclaration.getSourceFile().isDeclarationFile) {
+            return options.lib + "::" + LibFunctions[symbol.name];
+        }
+        return undefined;
+    }
     function getSymbolString(symbol, options) {
         let vs = [];
         var s = symbol;
-        while (s !== undefined && (s.valueDeclaration === undefined || !ts.isSourceFile(s.valueDeclaration))) {
+        while(s !== undefined && (s.valueDeclaration === undefined || !ts.isSourceFile(s.valueDeclaration))){
             vs.push(s.name);
             s = s.parent;
         }
@@ -103,15 +229,20 @@ var CC;
         if ((type.flags & ts.TypeFlags.Boolean) != 0) {
             return options.lib + "::Boolean";
         }
-        while ((type.flags & ts.TypeFlags.Union) != 0) {
+        while((type.flags & ts.TypeFlags.Union) != 0){
             let v = type.getNonNullableType();
             if (v == type) {
                 type = v.types[0];
-            }
-            else {
+            } else {
                 type = v;
             }
         }
+        if ((type.flags & ts.TypeFlags.EnumLike) != 0) {
+            let e = getEnumDeclaration(type);
+            if (e !== undefined) {
+                return isStringEnum(e) ? options.lib + "::String" : getSymbolString(getEnumSymbol(type), options);
+            }
+        }
         if ((type.flags & ts.TypeFlags.String) != 0) {
             return options.lib + "::String";
         }
@@ -119,7 +250,7 @@ var CC;
             let t = type;
             if (t.name !== undefined) {
                 let n = t.name.split(".");
-                switch (n[n.length - 1]) {
+                switch(n[n.length - 1]){
                     case "int":
                         return options.lib + "::Int";
                     case "uint":
@@ -136,7 +267,18 @@ var CC;
             }
             return options.lib + "::Number";
         }
+        if ((type.flags & ts.TypeFlags.TypeParameter) != 0) {
+            return type.symbol.name;
+        }
         if ((type.flags & ts.TypeFlags.Object) != 0) {
+            let lib = getLibType(type, options);
+            if (lib !== undefined) {
+                return lib + " *";
+            }
+            if (isGenericType(type)) {
+                let vs = genericArguments(type).map((v)=>getType(v, options));
+                return getSymbolString(type.symbol, options) + "<" + vs.join(",") + "> *";
+            }
             return getSymbolString(type.symbol, options) + " *";
         }
         if ((type.flags & ts.TypeFlags.Void) != 0) {
@@ -147,6 +289,28 @@ var CC;
         }
         throw new Error("[TYPE] " + type.flags.toString());
     }
+    function getEnumSymbol(type) {
+        var symbol = type.symbol;
+        if (symbol !== undefined && (symbol.flags & ts.SymbolFlags.EnumMember) != 0) {
+            symbol = symbol.parent;
+        }
+        if (symbol === undefined || (symbol.flags & ts.SymbolFlags.Enum) == 0) {
+            return undefined;
+        }
+        return symbol;
+    }
+    function getEnumDeclaration(type) {
+        let symbol = getEnumSymbol(type);
+        if (symbol === undefined || symbol.declarations === undefined) {
+            return undefined;
+        }
+        return symbol.declarations.find((d)=>ts.isEnumDeclaration(d));
+    }
+    function isStringEnum(node) {
+        return node.members.length > 0 && node.members.every((m)=>{
+            return m.initializer !== undefined && ts.isStringLiteral(m.initializer);
+        });
+    }
     function getDefaultValue(type, options) {
         if (type === undefined) {
             return "nullptr";
@@ -154,6 +318,12 @@ var CC;
         if ((type.flags & ts.TypeFlags.Union) != 0) {
             type = type.getNonNullableType();
         }
+        if ((type.flags & ts.TypeFlags.EnumLike) != 0 && getEnumDeclaration(type) !== undefined) {
+            return "(" + getType(type, options) + ")0";
+        }
+        if ((type.flags & ts.TypeFlags.TypeParameter) != 0) {
+            return getType(type, options) + "()";
+        }
         if ((type.flags & ts.TypeFlags.String) != 0) {
             return '""';
         }
@@ -172,12 +342,12 @@ var CC;
             if ((type.flags & ts.TypeFlags.Union) != 0) {
                 type = type.getNonNullableType();
             }
-            for (let sign of type.getCallSignatures()) {
+            for (let sign of type.getCallSignatures()){
                 vs.push(options.lib);
                 vs.push("::Closure<");
                 let args = [];
                 args.push(define("", sign.getReturnType(), program, options));
-                for (let param of sign.parameters) {
+                for (let param of sign.parameters){
                     if (ts.isParameter(param.valueDeclaration)) {
                         let vType = getTypeAtLocation(param.valueDeclaration.type, checker);
                         args.push(define("", vType, program, options));
@@ -192,29 +362,39 @@ var CC;
                 break;
             }
             return vs.join('');
-        }
-        else if (type !== undefined && isObjectReferenceType(type)) {
+        } else if (type !== undefined && isGenericType(type)) {
+            let vs = genericArguments(type).map((v)=>define("", v, program, options));
+            let s = getSymbolString(type.getNonNullableType().symbol, options) + "<" + vs.join(",") + "> *";
+            if (name != "") {
+                s += " " + name;
+            }
+            return s;
+        } else if (type !== undefined && isObjectReferenceType(type)) {
             let vs = [];
             let t = type;
             if (t.typeArguments !== undefined) {
-                for (let v of t.typeArguments) {
+                for (let v of isPromiseType(type) ? typeArguments(t, t.typeArguments) : t.typeArguments){
                     vs.push(define("", v, program, options));
                 }
             }
             var s = getSymbolString(type.symbol, options);
             if (type.symbol.name == "map") {
                 s = options.lib + "::Map";
-            }
-            else if (type.symbol.name == "array") {
+            } else if (type.symbol.name == "orderedMap") {
+                s = options.lib + "::OrderedMap";
+            } else if (type.symbol.name == "array") {
                 s = options.lib + "::Array";
+            } else if (isPromiseType(type)) {
+                s = options.lib + "::Promise";
             }
             s = s + "<" + vs.join(",") + ">";
-            if (name != "") {
+            if (name != "" && isPromiseType(type)) {
+                s += " " + name;
+            } else if (name != "") {
                 s += " &" + name;
             }
             return s;
-        }
-        else {
+        } else {
             let s = getType(type, options);
             if (name != "") {
                 s += " " + name;
@@ -244,21 +424,631 @@ var CC;
     function getSetSymbol(name) {
         return "set" + name.substr(0, 1).toLocaleUpperCase() + name.substr(1);
     }
-    let FileType;
-    (function (FileType) {
+    function isConstReferenceType(type, options) {
+        if (type !== undefined && (isFunctionType(type) || isObjectReferenceType(type))) {
+            return false;
+        }
+        let s = getType(type, options);
+        return s == options.lib + "::String" || s == options.lib + "::Any";
+    }
+    function defineParameter(name, type, program, options, sink = false) {
+        if (!sink && isConstReferenceType(type, options)) {
+            return "const " + getType(type, options) + " &" + name;
+        }
+        if (!sink && type !== undefined && isClassTypeParameter(type)) {
+            return "typename " + options.lib + "::Param<" + getType(type, options) + ">::type " + name;
+        }
+        return define(name, type, program, options);
+    }
+    function isAssignedParameter(param, checker) {
+        let body = param.parent.body;
+        let symbol = checker.getSymbolAtLocation(param.name);
+        var assigned = false;
+        if (body === undefined || symbol === undefined) {
+            return false;
+        }
+        let visit = (node)=>{
+            if (ts.isIdentifier(node) && checker.getSymbolAtLocation(node) == symbol && isWriteTarget(node)) {
+                assigned = true;
+            }
+            if (!assigned) {
+                ts.forEachChild(node, visit);
+            }
+        };
+        visit(body);
+        return assigned;
+    }
+    function sinkParameters(s, checker, options) {
+        let vs = new Set();
+        let body = s.body;
+        if (body === undefined || !ts.isBlock(body)) {
+            return vs;
+        }
+        for (let param of s.parameters){
+            let symbol = checker.getSymbolAtLocation(param.name);
+            let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
+            if (symbol === undefined || !isConstReferenceType(type, options)) {
+                continue;
+            }
+            let refs = [];
+            let visit = (node)=>{
+                if (ts.isIdentifier(node) && checker.getSymbolAtLocation(node) == symbol) {
+                    refs.push(node);
+                }
+                ts.forEachChild(node, visit);
+            };
+            visit(body);
+            if (refs.length != 1) {
+                continue;
+            }
+            let e = refs[0].parent;
+            if (e !== undefined && ts.isBinaryExpression(e) && e.right == refs[0] && e.operatorToken.kind == ts.SyntaxKind.EqualsToken && isThisProperty(e.left) && e.parent !== undefined && ts.isExpressionStatement(e.parent) && e.parent.parent == body) {
+                vs.add(symbol);
+            }
+        }
+        return vs;
+    }
+    function isAsync(node) {
+        return (ts.getCombinedModifierFlags(node) & ts.ModifierFlags.Async) != 0;
+    }
+    function isPromiseType(type) {
+        if (type === undefined) {
+            return false;
+        }
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        return type.symbol !== undefined && type.symbol.name == "Promise" && type.typeArguments !== undefined && type.symbol.declarations !== undefined && type.symbol.declarations.every((d)=>d.getSourceFile().isDeclarationFile);
+    }
+    function isVoidPromiseType(type) {
+        return type !== undefined && isPromiseType(type) && (type.getNonNullableType().typeArguments[0].flags & ts.TypeFlags.Void) != 0;
+    }
+    function isAsyncScope(node) {
+        var p = node.parent;
+        while(p !== undefined && !isFunctionScope(p)){
+            p = p.parent;
+        }
+        return p !== undefined && isAsync(p);
+    }
+    function isFunctionScope(node) {
+        return ts.isFunctionDeclaration(node) || ts.isFunctionExpression(node) || ts.isArrowFunction(node) || ts.isMethodDeclaration(node) || ts.isConstructorDeclaration(node) || ts.isGetAccessorDeclaration(node) || ts.isSetAccessorDeclaration(node);
+    }
+    function thisEscapes(node, checker) {
+        if (node.getSourceFile().isDeclarationFile) {
+            return true;
+        }
+        if (node.members.some((m)=>isAsync(m))) {
+            return true;
+        }
+        var escapes = false;
+        let visit = (node, nested)=>{
+            if (escapes) {
+                return;
+            }
+            if (node.kind == ts.SyntaxKind.ThisKeyword) {
+                if (nested || node.parent === undefined || !ts.isPropertyAccessExpression(node.parent) || node.parent.expression != node) {
+                    escapes = true;
+                }
+                return;
+            }
+            if (ts.isClassDeclaration(node) || ts.isClassExpression(node)) {
+                return;
+            }
+            let n = nested || isFunctionScope(node);
+            ts.forEachChild(node, (child)=>{
+                visit(child, n);
+            });
+        };
+        for (let m of node.members){
+            ts.forEachChild(m, (child)=>{
+                visit(child, false);
+            });
+        }
+        if (escapes) {
+            return true;
+        }
+        for (let base of heritageDeclarations(node, checker, ts.SyntaxKind.ExtendsKeyword)){
+            if (!ts.isClassDeclaration(base) || thisEscapes(base, checker)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    function isLocalObject(v, checker, options) {
+        if (v.type === undefined || v.initializer === undefined || !ts.isNewExpression(v.initializer) || !ts.isIdentifier(v.name)) {
+            return false;
+        }
+        let type = checker.getTypeAtLocation(v.initializer);
+        if (getLibType(type, options) === undefined) {
+            if (type.symbol === undefined || type.symbol.declarations === undefined) {
+                return false;
+            }
+            let decl = type.symbol.declarations.find((d)=>ts.isClassDeclaration(d));
+            if (decl === undefined || thisEscapes(decl, checker)) {
+                return false;
+            }
+        }
+        var scope = v.parent;
+        while(scope !== undefined && !isFunctionScope(scope)){
+            scope = scope.parent;
+        }
+        if (scope === undefined) {
+            return false;
+        }
+        let symbol = checker.getSymbolAtLocation(v.name);
+        var escapes = false;
+        let visit = (node, depth)=>{
+            if (escapes || node == v.name) {
+                return;
+            }
+            if (ts.isIdentifier(node) && checker.getSymbolAtLocation(node) == symbol) {
+                if (depth > 0 || node.parent === undefined || !ts.isPropertyAccessExpression(node.parent) || node.parent.expression != node) {
+                    escapes = true;
+                }
+                return;
+            }
+            let d = isFunctionScope(node) ? depth + 1 : depth;
+            ts.forEachChild(node, (child)=>{
+                visit(child, d);
+            });
+        };
+        ts.forEachChild(scope, (child)=>{
+            visit(child, 0);
+        });
+        return !escapes;
+    }
+    function isLocalClosure(v, checker) {
+        if (v.initializer === undefined || !ts.isArrowFunction(v.initializer) || !ts.isIdentifier(v.name)) {
+            return false;
+        }
+        var scope = v.parent;
+        while(scope !== undefined && !isFunctionScope(scope)){
+            scope = scope.parent;
+        }
+        if (scope === undefined) {
+            return false;
+        }
+        let symbol = checker.getSymbolAtLocation(v.name);
+        var escapes = false;
+        let visit = (node, depth)=>{
+            if (escapes || node == v.name) {
+                return;
+            }
+            if (ts.isIdentifier(node) && checker.getSymbolAtLocation(node) == symbol) {
+                if (depth > 0 || node.parent === undefined || !ts.isCallExpression(node.parent) || node.parent.expression != node) {
+                    escapes = true;
+                }
+                return;
+            }
+            let d = isFunctionScope(node) ? depth + 1 : depth;
+            ts.forEachChild(node, (child)=>{
+                visit(child, d);
+            });
+        };
+        ts.forEachChild(scope, (child)=>{
+            visit(child, 0);
+        });
+        return !escapes;
+    }
+    function forwardDeclarations(s, checker) {
+        let clause = s.importClause;
+        if (clause === undefined || clause.name !== undefined || clause.namedBindings === undefined || !ts.isNamedImports(clause.namedBindings)) {
+            return undefined;
+        }
+        let aliases = new Set();
+        let vs = [];
+        for (let element of clause.namedBindings.elements){
+            let alias = checker.getSymbolAtLocation(element.name);
+            if (alias === undefined) {
+                return undefined;
+            }
+            let symbol = checker.getAliasedSymbol(alias);
+            if ((symbol.flags & (ts.SymbolFlags.Class | ts.SymbolFlags.Interface)) == 0 || (symbol.flags & (ts.SymbolFlags.Enum | ts.SymbolFlags.Function | ts.SymbolFlags.Variable | ts.SymbolFlags.ValueModule)) != 0 || symbol.declarations === undefined || symbol.declarations.some((d)=>!ts.isSourceFile(d.parent) || isGenericDeclaration(d))) {
+                return undefined;
+            }
+            aliases.add(alias);
+            vs.push(element.name.text);
+        }
+        var complete = false;
+        let visit = (node)=>{
+            if (complete || ts.isImportDeclaration(node)) {
+                return;
+            }
+            if (ts.isIdentifier(node) && aliases.has(checker.getSymbolAtLocation(node))) {
+                var p = node.parent;
+                var body = false;
+                while(p !== undefined && !ts.isSourceFile(p)){
+                    if (isGenericDeclaration(p) || !body && (ts.isHeritageClause(p) || ts.isPropertyDeclaration(p))) {
+                        complete = true;
+                        return;
+                    }
+                    if (isFunctionScope(p) && p.body !== undefined && node.pos >= p.body.pos) {
+                        body = true;
+                    }
+                    p = p.parent;
+                }
+                return;
+            }
+            ts.forEachChild(node, visit);
+        };
+        ts.forEachChild(s.getSourceFile(), visit);
+        return complete ? undefined : vs;
+    }
+    let NumericWidth = /*#__PURE__*/ function(NumericWidth) {
+        NumericWidth[NumericWidth["Int32"] = 0] = "Int32";
+        NumericWidth[NumericWidth["Int64"] = 1] = "Int64";
+        NumericWidth[NumericWidth["Number"] = 2] = "Number";
+        return NumericWidth;
+    }({});
+    const NumericTypes = [
+        "::Int32",
+        "::Int64",
+        "::Number"
+    ];
+    function literalWidth(v) {
+        if (!Number.isInteger(v)) {
+            return 2;
+        }
+        if (v >= -2147483648 && v <= 2147483647) {
+            return 0;
+        }
+        if (Number.isSafeInteger(v)) {
+            return 1;
+        }
+        return 2;
+    }
+    function typeNodeWidth(node) {
+        let n = node.getText().split(".");
+        switch(n[n.length - 1]){
+            case "int":
+            case "int32":
+                return 0;
+            case "uint":
+            case "uint32":
+            case "int64":
+            case "uint64":
+                return 1;
+        }
+        return 2;
+    }
+    function binaryWidth(op, l, r) {
+        switch(op){
+            case ts.SyntaxKind.PlusToken:
+            case ts.SyntaxKind.MinusToken:
+                return l == 0 && r == 0 ? 1 : Math.max(l, r);
+            case ts.SyntaxKind.PlusEqualsToken:
+            case ts.SyntaxKind.MinusEqualsToken:
+                return Math.max(l, r);
+            case ts.SyntaxKind.AsteriskToken:
+            case ts.SyntaxKind.AsteriskEqualsToken:
+                return l == 0 && r == 0 ? 1 : 2;
+            case ts.SyntaxKind.PercentToken:
+            case ts.SyntaxKind.PercentEqualsToken:
+                return r == 2 ? 2 : l;
+            case ts.SyntaxKind.AmpersandToken:
+            case ts.SyntaxKind.AmpersandEqualsToken:
+            case ts.SyntaxKind.BarToken:
+            case ts.SyntaxKind.BarEqualsToken:
+            case ts.SyntaxKind.CaretToken:
+            case ts.SyntaxKind.CaretEqualsToken:
+            case ts.SyntaxKind.LessThanLessThanToken:
+            case ts.SyntaxKind.LessThanLessThanEqualsToken:
+            case ts.SyntaxKind.GreaterThanGreaterThanToken:
+            case ts.SyntaxKind.GreaterThanGreaterThanEqualsToken:
+                return 0;
+            case ts.SyntaxKind.GreaterThanGreaterThanGreaterThanToken:
+            case ts.SyntaxKind.GreaterThanGreaterThanGreaterThanEqualsToken:
+                return 1;
+            case ts.SyntaxKind.EqualsToken:
+            case ts.SyntaxKind.CommaToken:
+                return r;
+        }
+        return 2;
+    }
+    function isAssignmentOperator(op) {
+        return op >= ts.SyntaxKind.FirstAssignment && op <= ts.SyntaxKind.LastAssignment;
+    }
+    function isWriteTarget(e) {
+        var p = e.parent;
+        while(ts.isParenthesizedExpression(p)){
+            e = p;
+            p = p.parent;
+        }
+        if (ts.isBinaryExpression(p)) {
+            return p.left == e && isAssignmentOperator(p.operatorToken.kind);
+        }
+        if (ts.isPrefixUnaryExpression(p) || ts.isPostfixUnaryExpression(p)) {
+            return p.operator == ts.SyntaxKind.PlusPlusToken || p.operator == ts.SyntaxKind.MinusMinusToken;
+        }
+        return false;
+    }
+    function isContainerType(type) {
+        if (!isObjectReferenceType(type)) {
+            return false;
+        }
+        let name = type.getNonNullableType().symbol.name;
+        return name == "map" || name == "orderedMap" || name == "array";
+    }
+    function assignedSymbol(e, checker) {
+        if (ts.isParenthesizedExpression(e)) {
+            return assignedSymbol(e.expression, checker);
+        }
+        if (ts.isIdentifier(e)) {
+            return checker.getSymbolAtLocation(e);
+        }
+        if (ts.isPropertyAccessExpression(e)) {
+            return checker.getSymbolAtLocation(e.name);
+        }
+        return undefined;
+    }
+    function referencesSymbol(node, symbol, checker) {
+        if (ts.isIdentifier(node) && checker.getSymbolAtLocation(node) == symbol) {
+            return true;
+        }
+        return ts.forEachChild(node, (v)=>referencesSymbol(v, symbol, checker) || undefined) === true;
+    }
+    function isAccumulation(e, symbol, checker) {
+        if (ts.isPrefixUnaryExpression(e) || ts.isPostfixUnaryExpression(e)) {
+            return true;
+        }
+        if (ts.isBinaryExpression(e)) {
+            switch(e.operatorToken.kind){
+                case ts.SyntaxKind.PlusEqualsToken:
+                case ts.SyntaxKind.MinusEqualsToken:
+                    return true;
+                case ts.SyntaxKind.EqualsToken:
+                    return referencesSymbol(e.right, symbol, checker);
+            }
+        }
+        return false;
+    }
+    function isStepExpression(e) {
+        if (ts.isPrefixUnaryExpression(e) || ts.isPostfixUnaryExpression(e)) {
+            return true;
+        }
+        return ts.isBinaryExpression(e) && ts.isNumericLiteral(e.right) && (e.operatorToken.kind == ts.SyntaxKind.PlusEqualsToken || e.operatorToken.kind == ts.SyntaxKind.MinusEqualsToken);
+    }
+    function isNumericCandidate(node, checker) {
+        if (node.type !== undefined) {
+            return node.type.kind == ts.SyntaxKind.NumberKeyword;
+        }
+        return (checker.getTypeAtLocation(node.name).flags & (ts.TypeFlags.Number | ts.TypeFlags.NumberLiteral)) != 0;
+    }
+    function isConstDeclaration(node) {
+        return ts.isVariableDeclaration(node) && ts.isVariableDeclarationList(node.parent) && (node.parent.flags & ts.NodeFlags.Const) != 0;
+    }
+    function isReadonlyMember(node) {
+        if (node.modifiers !== undefined) {
+            for (let element of node.modifiers){
+                if (element.kind == ts.SyntaxKind.ReadonlyKeyword) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    function isConstantExpression(e, checker, depth = 0) {
+        if (depth > 16) {
+            return false;
+        }
+        if (ts.isNumericLiteral(e) || e.kind == ts.SyntaxKind.TrueKeyword || e.kind == ts.SyntaxKind.FalseKeyword) {
+            return true;
+        } else if (ts.isParenthesizedExpression(e)) {
+            return isConstantExpression(e.expression, checker, depth + 1);
+        } else if (ts.isPrefixUnaryExpression(e)) {
+            return e.operator != ts.SyntaxKind.PlusPlusToken && e.operator != ts.SyntaxKind.MinusMinusToken && isConstantExpression(e.operand, checker, depth + 1);
+        } else if (ts.isBinaryExpression(e)) {
+            return !isAssignmentOperator(e.operatorToken.kind) && (checker.getTypeAtLocation(e).flags & ts.TypeFlags.StringLike) == 0 && isConstantExpression(e.left, checker, depth + 1) && isConstantExpression(e.right, checker, depth + 1);
+        } else if (ts.isIdentifier(e) || ts.isPropertyAccessExpression(e)) {
+            let symbol = assignedSymbol(e, checker);
+            let decl = symbol === undefined ? undefined : symbol.valueDeclaration;
+            if (decl === undefined) {
+                return false;
+            }
+            if (ts.isEnumMember(decl)) {
+                return true;
+            }
+            if ((isConstDeclaration(decl) || ts.isPropertyDeclaration(decl) && isStaticMember(decl) && isReadonlyMember(decl)) && decl.initializer !== undefined) {
+                return isConstantExpression(decl.initializer, checker, depth + 1);
+            }
+        }
+        return false;
+    }
+    function isConstantType(type) {
+        if ((type.flags & (ts.TypeFlags.Boolean | ts.TypeFlags.EnumLike)) != 0) {
+            return true;
+        }
+        return (type.flags & ts.TypeFlags.Union) == 0 && (type.flags & (ts.TypeFlags.NumberLike | ts.TypeFlags.BooleanLike | ts.TypeFlags.StringLike)) != 0;
+    }
+    function isStaticAccess(symbol) {
+        if ((symbol.flags & ts.SymbolFlags.EnumMember) != 0) {
+            return true;
+        }
+        let decl = symbol.valueDeclaration;
+        return decl !== undefined && (ts.isPropertyDeclaration(decl) || ts.isMethodDeclaration(decl)) && isStaticMember(decl);
+    }
+    function numericUnit(node) {
+        var unit;
+        var p = node.parent;
+        while(p !== undefined && !ts.isSourceFile(p)){
+            if (ts.isClassDeclaration(p) || isFunctionScope(p)) {
+                unit = p;
+            }
+            p = p.parent;
+        }
+        return unit;
+    }
+    const classHierarchys = new WeakMap();
+    function memberName(m) {
+        if (m.name !== undefined && (ts.isIdentifier(m.name) || ts.isStringLiteral(m.name))) {
+            return m.name.text;
+        }
+        return undefined;
+    }
+    function isStaticMember(m) {
+        if (m.modifiers !== undefined) {
+            for (let element of m.modifiers){
+                if (element.kind == ts.SyntaxKind.StaticKeyword) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    function heritageDeclarations(node, checker, token) {
+        let vs = [];
+        if (node.heritageClauses !== undefined) {
+            for (let clause of node.heritageClauses){
+                if (token !== undefined && clause.token != token) {
+                    continue;
+                }
+                for (let type of clause.types){
+                    let symbol = checker.getSymbolAtLocation(type.expression);
+                    if (symbol !== undefined && (symbol.flags & ts.SymbolFlags.Alias) != 0) {
+                        symbol = checker.getAliasedSymbol(symbol);
+                    }
+                    if (symbol === undefined || symbol.declarations === undefined) {
+                        continue;
+                    }
+                    for (let d of symbol.declarations){
+                        if (ts.isClassDeclaration(d) || ts.isInterfaceDeclaration(d)) {
+                            vs.push(d);
+                        }
+                    }
+                }
+            }
+        }
+        return vs;
+    }
+    function inheritedMembers(node, checker, vs = new Set()) {
+        for (let d of heritageDeclarations(node, checker)){
+            for (let m of d.members){
+                let name = memberName(m);
+                if (name !== undefined && !isStaticMember(m)) {
+                    vs.add(name);
+                }
+            }
+            inheritedMembers(d, checker, vs);
+        }
+        return vs;
+    }
+    function getClassHierarchy(program) {
+        let v = classHierarchys.get(program);
+        if (v !== undefined) {
+            return v;
+        }
+        let checker = program.getTypeChecker();
+        let h = {
+            subclassed: new Set(),
+            overridden: new Map()
+        };
+        let visit = (node)=>{
+            if (ts.isClassDeclaration(node)) {
+                let names = [];
+                for (let m of node.members){
+                    let name = memberName(m);
+                    if (name !== undefined && !isStaticMember(m)) {
+                        names.push(name);
+                    }
+                }
+                let bases = heritageDeclarations(node, checker, ts.SyntaxKind.ExtendsKeyword);
+                while(bases.length > 0){
+                    let base = bases.pop();
+                    if (!ts.isClassDeclaration(base) || base.name === undefined) {
+                        continue;
+                    }
+                    let symbol = checker.getSymbolAtLocation(base.name);
+                    let overridden = h.overridden.get(symbol);
+                    if (overridden === undefined) {
+                        overridden = new Set();
+                        h.overridden.set(symbol, overridden);
+                    }
+                    for (let name of names){
+                        overridden.add(name);
+                    }
+                    h.subclassed.add(symbol);
+                    for (let d of heritageDeclarations(base, checker, ts.SyntaxKind.ExtendsKeyword)){
+                        bases.push(d);
+                    }
+                }
+            }
+            ts.forEachChild(node, visit);
+        };
+        for (let file of program.getSourceFiles()){
+            if (!file.isDeclarationFile) {
+                visit(file);
+            }
+        }
+        classHierarchys.set(program, h);
+        return h;
+    }
+    function hierarchySignature(program) {
+        let checker = program.getTypeChecker();
+        let vs = [];
+        getClassHierarchy(program).overridden.forEach((names, symbol)=>{
+            vs.push(checker.getFullyQualifiedName(symbol) + ":" + Array.from(names).sort().join(","));
+        });
+        return vs.sort().join(";");
+    }
+    CC.hierarchySignature = hierarchySignature;
+    function fieldName(p, name) {
+        for (let m of p.members){
+            if (ts.isPropertyDeclaration(m) && !isStaticMember(m) && memberName(m) == name) {
+                return isPublicProperty(m) ? "_" + name : name;
+            }
+        }
+        return undefined;
+    }
+    function isThisProperty(e) {
+        return ts.isPropertyAccessExpression(e) && e.expression.kind == ts.SyntaxKind.ThisKeyword;
+    }
+    function inlineGetter(s) {
+        let p = s.parent;
+        if (ts.isPropertyDeclaration(s)) {
+            return fieldName(p, memberName(s));
+        }
+        if (s.body !== undefined && s.body.statements.length == 1) {
+            let st = s.body.statements[0];
+            if (ts.isReturnStatement(st) && st.expression !== undefined && isThisProperty(st.expression)) {
+                return fieldName(p, st.expression.name.text);
+            }
+        }
+        return undefined;
+    }
+    function inlineSetter(s) {
+        let p = s.parent;
+        if (ts.isPropertyDeclaration(s)) {
+            return fieldName(p, memberName(s));
+        }
+        if (s.body !== undefined && s.body.statements.length == 1 && s.parameters.length == 1) {
+            let st = s.body.statements[0];
+            let param = s.parameters[0].name;
+            if (ts.isExpressionStatement(st) && ts.isBinaryExpression(st.expression) && st.expression.operatorToken.kind == ts.SyntaxKind.EqualsToken && isThisProperty(st.expression.left) && ts.isIdentifier(st.expression.right) && ts.isIdentifier(param) && st.expression.right.text == param.text) {
+                return fieldName(p, st.expression.left.name.text);
+            }
+        }
+        return undefined;
+    }
+    (function(FileType) {
         FileType[FileType["Header"] = 0] = "Header";
         FileType[FileType["Source"] = 1] = "Source";
-    })(FileType = CC.FileType || (CC.FileType = {}));
+    })(CC.FileType || (CC.FileType = {}));
     class Compiler {
-        constructor(options, out) {
-            this._level = 0;
-            this._isNewLine = true;
-            this._options = options;
-            this._out = out;
-        }
+        _out;
+        _options;
+        _level = 0;
+        _sinks = new Set();
+        _numerics = new Map();
+        _numericUnits = new Set();
+        _prefix = "";
+        _isNewLine = true;
         get isNewLine() {
             return this._isNewLine;
         }
+        constructor(options, out){
+            this._options = options;
+            this._out = out;
+        }
         out(text) {
             this._out(text);
             this._isNewLine = text.endsWith("\n");
@@ -270,15 +1060,13 @@ var CC;
             this.out("#include ");
             if (isLibrary) {
                 this.out("<");
-            }
-            else {
+            } else {
                 this.out('"');
             }
             this.out(name);
             if (isLibrary) {
                 this.out(">\n");
-            }
-            else {
+            } else {
                 this.out('"\n');
             }
         }
@@ -288,14 +1076,13 @@ var CC;
             let checker = program.getTypeChecker();
             let v = this;
             function heritageClauses(clauses) {
-                for (let clause of clauses) {
-                    for (let type of clause.types) {
+                for (let clause of clauses){
+                    for (let type of clause.types){
                         var name = type.expression.getText();
                         if (names[name] === undefined) {
                             if (ns === undefined) {
                                 v.include(name + ".h", false);
-                            }
-                            else {
+                            } else {
                                 v.include(ns + "/" + name + ".h", true);
                             }
                             names[name] = true;
@@ -311,15 +1098,13 @@ var CC;
                         ts.forEachChild(node.body, each);
                     }
                     ns = undefined;
-                }
-                else if (ts.isInterfaceDeclaration(node)) {
+                } else if (ts.isInterfaceDeclaration(node)) {
                     let n = checker.getSymbolAtLocation(node.name);
                     names[n.name] = true;
                     if (node.heritageClauses !== undefined) {
                         heritageClauses(node.heritageClauses);
                     }
-                }
-                else if (ts.isClassDeclaration(node) && node.name !== undefined) {
+                } else if (ts.isClassDeclaration(node) && node.name !== undefined) {
                     let n = checker.getSymbolAtLocation(node.name);
                     names[n.name] = true;
                     if (node.heritageClauses !== undefined) {
@@ -341,10 +1126,18 @@ var CC;
             this.level();
             this.out("}\n\n");
         }
-        heritageClauses(clauses, isClass = true) {
+        heritageType(type, program) {
+            let checker = program.getTypeChecker();
+            this.out(type.expression.getText());
+            if (type.typeArguments !== undefined && type.typeArguments.length > 0) {
+                let vs = type.typeArguments.map((v)=>define("", getTypeAtLocation(v, checker), program, this._options));
+                this.out("<" + vs.join(",") + ">");
+            }
+        }
+        heritageClauses(clauses, program, isClass = true) {
             if (clauses !== undefined) {
                 var superClass;
-                for (let extend of clauses) {
+                for (let extend of clauses){
                     if (extend.token == ts.SyntaxKind.ExtendsKeyword) {
                         superClass = extend;
                         break;
@@ -352,14 +1145,13 @@ var CC;
                 }
                 var s = ":";
                 if (superClass !== undefined) {
-                    for (let type of superClass.types) {
+                    for (let type of superClass.types){
                         this.out(s);
                         this.out("public ");
-                        this.out(type.expression.getText());
+                        this.heritageType(type, program);
                         s = ",";
                     }
-                }
-                else {
+                } else {
                     this.out(s);
                     this.out("public ");
                     this.out(this._options.lib);
@@ -368,19 +1160,18 @@ var CC;
                     }
                     s = ",";
                 }
-                for (let extend of clauses) {
+                for (let extend of clauses){
                     if (superClass == extend) {
                         continue;
                     }
-                    for (let type of extend.types) {
+                    for (let type of extend.types){
                         this.out(s);
                         this.out("public ");
-                        this.out(type.expression.getText());
+                        this.heritageType(type, program);
                         s = ",";
                     }
                 }
-            }
-            else {
+            } else {
                 if (isClass) {
                     this.out(":public " + this._options.lib);
                     this.out("::Object");
@@ -391,15 +1182,326 @@ var CC;
             let checker = program.getTypeChecker();
             if (node.name !== undefined) {
                 let name = checker.getSymbolAtLocation(node.name);
+                this.templateParameters(node, program);
                 this.level();
                 this.out("class ");
                 this.out(name.name);
-                this.heritageClauses(node.heritageClauses, true);
+                if (!getClassHierarchy(program).subclassed.has(name)) {
+                    this.out(" final");
+                }
+                this.heritageClauses(node.heritageClauses, program, true);
                 this.out(" {\n");
                 this._level++;
                 console.info("[class]", name.name, ">>");
             }
         }
+        numericWidth(e, program) {
+            let checker = program.getTypeChecker();
+            if (ts.isParenthesizedExpression(e)) {
+                return this.numericWidth(e.expression, program);
+            } else if (ts.isNumericLiteral(e)) {
+                return literalWidth(Number(e.text));
+            } else if (ts.isPrefixUnaryExpression(e)) {
+                if (e.operator == ts.SyntaxKind.TildeToken) {
+                    return 0;
+                } else if (e.operator == ts.SyntaxKind.ExclamationToken) {
+                    return 2;
+                }
+                return this.numericWidth(e.operand, program);
+            } else if (ts.isPostfixUnaryExpression(e)) {
+                return this.numericWidth(e.operand, program);
+            } else if (ts.isConditionalExpression(e)) {
+                return Math.max(this.numericWidth(e.whenTrue, program), this.numericWidth(e.whenFalse, program));
+            } else if (ts.isBinaryExpression(e)) {
+                return binaryWidth(e.operatorToken.kind, this.numericWidth(e.left, program), this.numericWidth(e.right, program));
+            } else if (ts.isAsExpression(e) || ts.isTypeAssertion(e)) {
+                return typeNodeWidth(e.type);
+            } else if (ts.isCallExpression(e)) {
+                let sign = checker.getResolvedSignature(e);
+                let decl = sign === undefined ? undefined : sign.declaration;
+                if (decl !== undefined && decl.type !== undefined) {
+                    return typeNodeWidth(decl.type);
+                }
+            } else if (ts.isElementAccessExpression(e)) {
+                if (getLibType(checker.getTypeAtLocation(e.expression), this._options) == this._options.lib + "::Int32Array") {
+                    return 0;
+                }
+            } else if (ts.isIdentifier(e) || ts.isPropertyAccessExpression(e)) {
+                let symbol = assignedSymbol(e, checker);
+                if (symbol === undefined) {
+                    return 2;
+                }
+                let w = this.symbolWidth(symbol, program);
+                if (w !== undefined) {
+                    return w;
+                }
+                if (ts.isPropertyAccessExpression(e) && e.name.text == "length" && (checker.getTypeAtLocation(e).flags & ts.TypeFlags.Number) != 0) {
+                    return 0;
+                }
+                let decl = symbol.valueDeclaration;
+                if (decl === undefined && symbol.declarations !== undefined) {
+                    decl = symbol.declarations[0];
+                }
+                if (decl !== undefined && decl.type !== undefined) {
+                    return typeNodeWidth(decl.type);
+                }
+                if (decl !== undefined && (isConstDeclaration(decl) || ts.isPropertyDeclaration(decl) && isStaticMember(decl) && isReadonlyMember(decl)) && decl.initializer !== undefined && isConstantExpression(decl.initializer, checker)) {
+                    return this.numericWidth(decl.initializer, program);
+                }
+            }
+            return 2;
+        }
+        symbolWidth(symbol, program) {
+            let decl = symbol.valueDeclaration;
+            if (decl !== undefined && !this._numerics.has(symbol)) {
+                let unit = numericUnit(decl);
+                if (unit !== undefined && !this._numericUnits.has(unit)) {
+                    this.solveNumerics(unit, program);
+                }
+            }
+            return this._numerics.get(symbol);
+        }
+        solveNumerics(unit, program) {
+            let checker = program.getTypeChecker();
+            let assigns = new Map();
+            this._numericUnits.add(unit);
+            let candidates = (node)=>{
+                if (ts.isVariableDeclaration(node) && ts.isIdentifier(node.name) && (ts.isVariableStatement(node.parent.parent) || ts.isForStatement(node.parent.parent)) && isNumericCandidate(node, checker)) {
+                    assigns.set(checker.getSymbolAtLocation(node.name), []);
+                } else if (ts.isPropertyDeclaration(node) && ts.isIdentifier(node.name) && !isPublicProperty(node) && !isStaticMember(node) && isNumericCandidate(node, checker)) {
+                    assigns.set(checker.getSymbolAtLocation(node.name), []);
+                }
+                ts.forEachChild(node, candidates);
+            };
+            let assignments = (node)=>{
+                var symbol;
+                var e;
+                if ((ts.isVariableDeclaration(node) || ts.isPropertyDeclaration(node)) && node.initializer !== undefined) {
+                    symbol = checker.getSymbolAtLocation(node.name);
+                    e = node.initializer;
+                } else if (ts.isBinaryExpression(node) && isAssignmentOperator(node.operatorToken.kind)) {
+                    symbol = assignedSymbol(node.left, checker);
+                    e = node;
+                } else if ((ts.isPrefixUnaryExpression(node) || ts.isPostfixUnaryExpression(node)) && (node.operator == ts.SyntaxKind.PlusPlusToken || node.operator == ts.SyntaxKind.MinusMinusToken)) {
+                    symbol = assignedSymbol(node.operand, checker);
+                    e = node;
+                }
+                if (symbol !== undefined && e !== undefined) {
+                    let vs = assigns.get(symbol);
+                    if (vs !== undefined) {
+                        vs.push(e);
+                    }
+                }
+                ts.forEachChild(node, assignments);
+            };
+            candidates(unit);
+            assignments(unit);
+            assigns.forEach((vs, symbol)=>{
+                let decl = symbol.valueDeclaration;
+                if (decl !== undefined && ts.isVariableDeclaration(decl) && ts.isForStatement(decl.parent.parent)) {
+                    for (let v of decl.parent.declarations){
+                        if (v != decl && ts.isIdentifier(v.name)) {
+                            vs.push(v.name);
+                        }
+                    }
+                }
+            });
+            assigns.forEach((vs, symbol)=>{
+                this._numerics.set(symbol, vs.length == 0 ? 2 : 0);
+            });
+            var changed = true;
+            while(changed){
+                changed = false;
+                assigns.forEach((vs, symbol)=>{
+                    var w = this._numerics.get(symbol);
+                    let bounded = this.isBoundedIndex(symbol, vs, program);
+                    for (let e of vs){
+                        w = Math.max(w, this.numericWidth(e, program));
+                        if (!bounded && isAccumulation(e, symbol, checker)) {
+                            w = Math.max(w, 1);
+                        }
+                    }
+                    if (w != this._numerics.get(symbol)) {
+                        this._numerics.set(symbol, w);
+                        changed = true;
+                    }
+                });
+            }
+        }
+        operandWidth(e, program) {
+            let l = this.numericWidth(e.left, program);
+            let r = this.numericWidth(e.right, program);
+            switch(e.operatorToken.kind){
+                case ts.SyntaxKind.SlashToken:
+                    return l != 2 && r != 2 ? 2 : undefined;
+                case ts.SyntaxKind.PlusToken:
+                case ts.SyntaxKind.MinusToken:
+                case ts.SyntaxKind.AsteriskToken:
+                    let w = binaryWidth(e.operatorToken.kind, l, r);
+                    return w > Math.max(l, r) ? w : undefined;
+            }
+            return undefined;
+        }
+        isBoundedIndex(symbol, vs, program) {
+            let checker = program.getTypeChecker();
+            let decl = symbol.valueDeclaration;
+            if (decl === undefined || !ts.isVariableDeclaration(decl) || !ts.isForStatement(decl.parent.parent)) {
+                return false;
+            }
+            let loop = decl.parent.parent;
+            let cond = loop.condition;
+            if (cond === undefined || !ts.isBinaryExpression(cond)) {
+                return false;
+            }
+            switch(cond.operatorToken.kind){
+                case ts.SyntaxKind.LessThanToken:
+                case ts.SyntaxKind.LessThanEqualsToken:
+                case ts.SyntaxKind.GreaterThanToken:
+                case ts.SyntaxKind.GreaterThanEqualsToken:
+                case ts.SyntaxKind.ExclamationEqualsToken:
+                case ts.SyntaxKind.ExclamationEqualsEqualsToken:
+                    break;
+                default:
+                    return false;
+            }
+            var bound;
+            if (assignedSymbol(cond.left, checker) == symbol) {
+                bound = cond.right;
+            } else if (assignedSymbol(cond.right, checker) == symbol) {
+                bound = cond.left;
+            } else {
+                return false;
+            }
+            if (referencesSymbol(bound, symbol, checker) || this.numericWidth(bound, program) != 0) {
+                return false;
+            }
+            return vs.every((e)=>!isAccumulation(e, symbol, checker) || isStepExpression(e));
+        }
+        staticKind(s, program) {
+            let checker = program.getTypeChecker();
+            let readonly = isReadonlyMember(s);
+            let e = s.initializer;
+            if (e === undefined || !readonly || !isConstantType(checker.getTypeAtLocation(s.name))) {
+                return isStaticMember(s) ? readonly ? "const" : "static" : undefined;
+            }
+            let constant = isConstantExpression(e, checker);
+            if (isStaticMember(s)) {
+                return constant ? "constexpr" : "const";
+            }
+            if (!constant && !ts.isStringLiteral(e)) {
+                return undefined;
+            }
+            let symbol = checker.getSymbolAtLocation(s.name);
+            var assigned = false;
+            let visit = (node)=>{
+                if (ts.isBinaryExpression(node) && isAssignmentOperator(node.operatorToken.kind) && assignedSymbol(node.left, checker) == symbol) {
+                    assigned = true;
+                }
+                ts.forEachChild(node, visit);
+            };
+            visit(s.parent);
+            if (assigned) {
+                return undefined;
+            }
+            return constant ? "constexpr" : "const";
+        }
+        defineConstant(name, s, program) {
+            let checker = program.getTypeChecker();
+            let symbol = checker.getSymbolAtLocation(s.name);
+            if (s.type !== undefined) {
+                return this.defineSymbol(name, symbol, getTypeAtLocation(s.type, checker), program);
+            }
+            let type = checker.getTypeAtLocation(s.name);
+            let w = this.symbolWidth(symbol, program);
+            if (w === undefined && s.initializer !== undefined && (type.flags & ts.TypeFlags.EnumLike) == 0 && (type.flags & ts.TypeFlags.NumberLike) != 0) {
+                w = this.numericWidth(s.initializer, program);
+            }
+            if (w !== undefined) {
+                return this._options.lib + NumericTypes[w] + " " + name;
+            } else if ((type.flags & ts.TypeFlags.StringLike) != 0) {
+                return this._options.lib + "::String " + name;
+            } else if ((type.flags & ts.TypeFlags.BooleanLike) != 0) {
+                return this._options.lib + "::Boolean " + name;
+            } else if ((type.flags & ts.TypeFlags.EnumLike) != 0) {
+                return getType(type, this._options) + " " + name;
+            }
+            return define(name, undefined, program, this._options);
+        }
+        defineSymbol(name, symbol, type, program) {
+            let w = this.symbolWidth(symbol, program);
+            if (w !== undefined) {
+                let s = this._options.lib + NumericTypes[w];
+                return name == "" ? s : s + " " + name;
+            }
+            return define(name, type, program, this._options);
+        }
+        sinkParameters(s, program) {
+            if (ts.isMethodDeclaration(s) && this.isVirtualMember(s, program)) {
+                return new Set();
+            }
+            return sinkParameters(s, program.getTypeChecker(), this._options);
+        }
+        parameters(s, program, sinks = new Set()) {
+            let checker = program.getTypeChecker();
+            let vs = [];
+            let byValue = s.type !== undefined && isPromiseType(checker.getTypeAtLocation(s.type));
+            for (let param of s.parameters){
+                let name = checker.getSymbolAtLocation(param.name);
+                let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
+                let sink = byValue || sinks.has(name);
+                let n = this.isCopiedParameter(param, type, sink, program) ? "__" + name.name + "__" : name.name;
+                vs.push(defineParameter(n, type, program, this._options, sink));
+            }
+            return vs.join(",");
+        }
+        isCopiedParameter(param, type, sink, program) {
+            return !sink && (isConstReferenceType(type, this._options) || type !== undefined && isClassTypeParameter(type)) && isAssignedParameter(param, program.getTypeChecker());
+        }
+        parameterCopies(s, program, sink = false) {
+            let checker = program.getTypeChecker();
+            for (let param of s.parameters){
+                let name = checker.getSymbolAtLocation(param.name);
+                let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
+                if (this.isCopiedParameter(param, type, sink || this._sinks.has(name), program)) {
+                    this.level();
+                    this.out(define(name.name, type, program, this._options));
+                    this.out(" = __" + name.name + "__;\n");
+                }
+            }
+        }
+        isVirtualMember(s, program) {
+            let checker = program.getTypeChecker();
+            let p = s.parent;
+            let name = memberName(s);
+            if (name === undefined || p.name === undefined) {
+                return true;
+            }
+            if (inheritedMembers(p, checker).has(name)) {
+                return true;
+            }
+            let overridden = getClassHierarchy(program).overridden.get(checker.getSymbolAtLocation(p.name));
+            return overridden !== undefined && overridden.has(name);
+        }
+        templateParameters(node, program, defaults = true) {
+            if (node === undefined || !isGenericDeclaration(node)) {
+                return;
+            }
+            let checker = program.getTypeChecker();
+            let vs = [];
+            for (let param of node.typeParameters){
+                if (defaults && param.default !== undefined) {
+                    vs.push("typename " + param.name.text + " = " + define("", getTypeAtLocation(param.default, checker), program, this._options));
+                } else {
+                    vs.push("typename " + param.name.text);
+                }
+            }
+            this.level();
+            this.out("template <" + vs.join(",") + ">\n");
+        }
+        className(p, program) {
+            let checker = program.getTypeChecker();
+            return checker.getSymbolAtLocation(p.name).name + templateArguments(p);
+        }
         classEnd() {
             console.info("[class] <<");
             this._level--;
@@ -413,11 +1515,10 @@ var CC;
             if (mod === true) {
                 var m = "public: ";
                 if (s.modifiers !== undefined) {
-                    for (let element of s.modifiers) {
+                    for (let element of s.modifiers){
                         if (element.kind == ts.SyntaxKind.PrivateKeyword) {
                             m = "private: ";
-                        }
-                        else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
+                        } else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
                             m = "protected: ";
                         }
                     }
@@ -426,10 +1527,17 @@ var CC;
                 this.out(m);
                 this.out("\n");
             }
+            let field = inlineGetter(s);
             this.level();
-            this.out("virtual ");
+            if (this.isVirtualMember(s, program)) {
+                this.out("virtual ");
+            }
             this.out(getter(name.name, type, program, this._options));
-            this.out(";\n");
+            if (field !== undefined) {
+                this.out(" { return this->" + field + "; }\n");
+            } else {
+                this.out(";\n");
+            }
         }
         classSetter(s, program, mod = false) {
             let checker = program.getTypeChecker();
@@ -438,11 +1546,10 @@ var CC;
             if (mod === true) {
                 var m = "public: ";
                 if (s.modifiers !== undefined) {
-                    for (let element of s.modifiers) {
+                    for (let element of s.modifiers){
                         if (element.kind == ts.SyntaxKind.PrivateKeyword) {
                             m = "private: ";
-                        }
-                        else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
+                        } else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
                             m = "protected: ";
                         }
                     }
@@ -451,10 +1558,21 @@ var CC;
                 this.out(m);
                 this.out("\n");
             }
+            let field = inlineSetter(s);
             this.level();
-            this.out("virtual ");
+            if (this.isVirtualMember(s, program)) {
+                this.out("virtual ");
+            }
             this.out(setter(getSetSymbol(name.name), "v", type, program, this._options));
-            this.out(";\n");
+            if (field !== undefined) {
+                if (isConstReferenceType(type, this._options)) {
+                    this.out(" { this->" + field + " = std::move(v); }\n");
+                } else {
+                    this.out(" { this->" + field + " = v; }\n");
+                }
+            } else {
+                this.out(";\n");
+            }
         }
         classMember(s, program, prefix = "_") {
             let checker = program.getTypeChecker();
@@ -464,22 +1582,41 @@ var CC;
             if (type !== undefined && isObjectReferenceType(type)) {
                 this.out(define("", type, program, this._options));
                 this.out(" " + prefix + name.name);
-            }
-            else if (type !== undefined && (isObjectType(type) || isFunctionType(type))) {
+            } else if (type !== undefined && isTypeParameter(type)) {
+                this.out("typename " + this._options.lib + "::Field<" + getType(type, this._options) + ">::type ");
+                this.out(prefix);
+                this.out(name.name);
+            } else if (type !== undefined && (isObjectType(type) || isFunctionType(type))) {
                 this.out(this._options.lib);
                 if (isObjectWeakType(type)) {
                     this.out("::Weak<");
-                }
-                else {
+                } else {
                     this.out("::Strong<");
                 }
                 this.out(define("", type, program, this._options));
                 this.out("> ");
                 this.out(prefix);
                 this.out(name.name);
+            } else {
+                this.out(this.defineSymbol(prefix + name.name, name, type, program));
             }
-            else {
-                this.out(define(prefix + name.name, type, program, this._options));
+            this.out(";\n");
+        }
+        classStatic(s, program, kind, prefix) {
+            let checker = program.getTypeChecker();
+            let name = checker.getSymbolAtLocation(s.name);
+            this.level();
+            if (kind == "constexpr") {
+                this.out("static constexpr ");
+                this.out(this.defineConstant(prefix + name.name, s, program));
+                this.out(" = ");
+                this.expression(s.initializer, program, s.parent);
+            } else if (kind == "const") {
+                this.out("static const ");
+                this.out(this.defineConstant(prefix + name.name, s, program));
+            } else {
+                this.out("static ");
+                this.out(this.defineConstant(prefix + name.name, s, program));
             }
             this.out(";\n");
         }
@@ -491,28 +1628,29 @@ var CC;
             var st = false;
             var readonly = false;
             if (s.modifiers !== undefined) {
-                for (let element of s.modifiers) {
+                for (let element of s.modifiers){
                     if (element.kind == ts.SyntaxKind.ReadonlyKeyword) {
                         readonly = true;
-                    }
-                    else if (element.kind == ts.SyntaxKind.PrivateKeyword) {
+                    } else if (element.kind == ts.SyntaxKind.PrivateKeyword) {
                         mod = "private: ";
-                    }
-                    else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
+                    } else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
                         mod = "protected: ";
-                    }
-                    else if (element.kind == ts.SyntaxKind.StaticKeyword) {
+                    } else if (element.kind == ts.SyntaxKind.StaticKeyword) {
                         st = true;
                     }
                 }
             }
-            if (mod != "public: ") {
+            let kind = this.staticKind(s, program);
+            if (st || mod != "public: ") {
                 this.level(-1);
                 this.out(mod);
                 this.out("\n");
-                this.classMember(s, program, "");
-            }
-            else {
+                if (kind !== undefined) {
+                    this.classStatic(s, program, kind, "");
+                } else {
+                    this.classMember(s, program, "");
+                }
+            } else {
                 this.level(-1);
                 this.out(mod);
                 this.out("\n");
@@ -522,20 +1660,22 @@ var CC;
                 }
                 this.level(-1);
                 this.out("protected:\n");
-                this.classMember(s, program, "_");
+                if (kind !== undefined) {
+                    this.classStatic(s, program, kind, "_");
+                } else {
+                    this.classMember(s, program, "_");
+                }
             }
             this.out("\n");
         }
         classPropertys(s, program) {
             let v = this;
-            ts.forEachChild(s, (node) => {
+            ts.forEachChild(s, (node)=>{
                 if (ts.isPropertyDeclaration(node)) {
                     v.classProperty(node, program);
-                }
-                else if (ts.isGetAccessorDeclaration(node)) {
+                } else if (ts.isGetAccessorDeclaration(node)) {
                     v.classGetter(node, program, true);
-                }
-                else if (ts.isSetAccessorDeclaration(node)) {
+                } else if (ts.isSetAccessorDeclaration(node)) {
                     v.classSetter(node, program, true);
                 }
             });
@@ -548,14 +1688,12 @@ var CC;
             var st = false;
             var readonly = false;
             if (s.modifiers !== undefined) {
-                for (let element of s.modifiers) {
+                for (let element of s.modifiers){
                     if (element.kind == ts.SyntaxKind.PrivateKeyword) {
                         mod = "private: ";
-                    }
-                    else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
+                    } else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
                         mod = "protected: ";
-                    }
-                    else if (element.kind == ts.SyntaxKind.StaticKeyword) {
+                    } else if (element.kind == ts.SyntaxKind.StaticKeyword) {
                         st = true;
                     }
                 }
@@ -566,27 +1704,27 @@ var CC;
             this.level();
             if (st) {
                 this.out("static ");
-            }
-            else {
+            } else if (this.isVirtualMember(s, program)) {
                 this.out("virtual ");
             }
             this.out(type === undefined ? "void " + symbol.name : define(symbol.name, type, program, this._options));
             this.out("(");
-            if (s.parameters !== undefined) {
-                var dot = "";
-                for (let param of s.parameters) {
-                    let name = checker.getSymbolAtLocation(param.name);
-                    let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                    this.out(dot);
-                    this.out(define(name.name, type, program, this._options));
-                    dot = ",";
-                }
-            }
+            this.out(this.parameters(s, program, this.sinkParameters(s, program)));
             this.out(");\n");
+            if (isAsync(s) && !st) {
+                this.level();
+                this.out(define(symbol.name + "async__", type, program, this._options));
+                this.out("(");
+                this.out([
+                    this._options.lib + "::Strong<" + this._options.lib + "::IObject *> __Self__",
+                    this.parameters(s, program)
+                ].filter((v)=>v != "").join(","));
+                this.out(");\n");
+            }
         }
         classMethods(s, program) {
             let v = this;
-            ts.forEachChild(s, (node) => {
+            ts.forEachChild(s, (node)=>{
                 if (ts.isMethodDeclaration(node)) {
                     v.classMethod(node, program);
                 }
@@ -601,13 +1739,7 @@ var CC;
             this.level();
             this.out(psymbol.name);
             this.out("(");
-            var vs = [];
-            for (let param of s.parameters) {
-                let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                let name = checker.getSymbolAtLocation(param.name);
-                vs.push(define(name.name, type, program, this._options));
-            }
-            this.out(vs.join(","));
+            this.out(this.parameters(s, program, this.sinkParameters(s, program)));
             this.out(");\n\n");
         }
         classDefaultConstructor(p, program) {
@@ -624,20 +1756,16 @@ var CC;
             this.classStart(s, program);
             let v = this;
             var hasConstructor = false;
-            ts.forEachChild(s, (node) => {
+            ts.forEachChild(s, (node)=>{
                 if (ts.isPropertyDeclaration(node)) {
                     v.classProperty(node, program);
-                }
-                else if (ts.isGetAccessorDeclaration(node)) {
+                } else if (ts.isGetAccessorDeclaration(node)) {
                     v.classGetter(node, program, true);
-                }
-                else if (ts.isSetAccessorDeclaration(node)) {
+                } else if (ts.isSetAccessorDeclaration(node)) {
                     v.classSetter(node, program, true);
-                }
-                else if (ts.isMethodDeclaration(node)) {
+                } else if (ts.isMethodDeclaration(node)) {
                     v.classMethod(node, program);
-                }
-                else if (ts.isConstructorDeclaration(node)) {
+                } else if (ts.isConstructorDeclaration(node)) {
                     v.classConstructor(node, program);
                     hasConstructor = true;
                 }
@@ -650,10 +1778,11 @@ var CC;
         interfaceStart(node, program) {
             let checker = program.getTypeChecker();
             let name = checker.getSymbolAtLocation(node.name);
+            this.templateParameters(node, program);
             this.level();
             this.out("class ");
             this.out(name.name);
-            this.heritageClauses(node.heritageClauses, false);
+            this.heritageClauses(node.heritageClauses, program, false);
             this.out(" {\n");
             this._level++;
             this.level(-1);
@@ -699,7 +1828,7 @@ var CC;
         interfaceProperty(s, program) {
             var readonly = false;
             if (s.modifiers !== undefined) {
-                for (let element of s.modifiers) {
+                for (let element of s.modifiers){
                     if (element.kind == ts.SyntaxKind.ReadonlyKeyword) {
                         readonly = true;
                     }
@@ -712,7 +1841,7 @@ var CC;
         }
         interfacePropertys(s, program) {
             let v = this;
-            ts.forEachChild(s, (node) => {
+            ts.forEachChild(s, (node)=>{
                 if (ts.isPropertySignature(node)) {
                     v.interfaceProperty(node, program);
                 }
@@ -726,21 +1855,12 @@ var CC;
             this.out("virtual ");
             this.out(type === undefined ? "void " + symbol.name : define(symbol.name, type, program, this._options));
             this.out("(");
-            if (s.parameters !== undefined) {
-                var dot = "";
-                for (let param of s.parameters) {
-                    let name = checker.getSymbolAtLocation(param.name);
-                    let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                    this.out(dot);
-                    this.out(define(name.name, type, program, this._options));
-                    dot = ",";
-                }
-            }
+            this.out(this.parameters(s, program));
             this.out(") = 0;\n");
         }
         interfaceMethods(s, program) {
             let v = this;
-            ts.forEachChild(s, (node) => {
+            ts.forEachChild(s, (node)=>{
                 if (ts.isMethodSignature(node)) {
                     v.interfaceMethod(node, program);
                 }
@@ -748,7 +1868,7 @@ var CC;
         }
         interface(s, program) {
             var index;
-            ts.forEachChild(s, (node) => {
+            ts.forEachChild(s, (node)=>{
                 if (ts.isIndexSignatureDeclaration(node)) {
                     index = node;
                 }
@@ -756,22 +1876,20 @@ var CC;
             if (index === undefined) {
                 this.interfaceStart(s, program);
                 let v = this;
-                ts.forEachChild(s, (node) => {
+                ts.forEachChild(s, (node)=>{
                     if (ts.isPropertySignature(node)) {
                         v.interfaceProperty(node, program);
-                    }
-                    else if (ts.isMethodSignature(node)) {
+                    } else if (ts.isMethodSignature(node)) {
                         v.interfaceMethod(node, program);
                     }
                 });
                 this.interfaceEnd();
-            }
-            else {
+            } else {
                 let checker = program.getTypeChecker();
                 let name = checker.getSymbolAtLocation(s.name);
                 var key;
                 let type = index.type === undefined ? undefined : getTypeAtLocation(index.type, checker);
-                for (let param of index.parameters) {
+                for (let param of index.parameters){
                     let pType = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
                     key = pType;
                     break;
@@ -779,6 +1897,93 @@ var CC;
                 this.interfaceObject(name.name, getType(key, this._options), getType(type, this._options));
             }
         }
+        enumDeclaration(s, program) {
+            this.level();
+            if (isStringEnum(s)) {
+                this.out("struct ");
+                this.out(s.name.text);
+                this.out(" {\n");
+                this._level++;
+                for (let m of s.members){
+                    this.level();
+                    this.out("static const ");
+                    this.out(this._options.lib);
+                    this.out("::String ");
+                    this.out(m.name.getText());
+                    this.out(";\n");
+                }
+            } else {
+                this.out("enum class ");
+                this.out(s.name.text);
+                this.out(" {\n");
+                this._level++;
+                for (let m of s.members){
+                    this.level();
+                    this.out(m.name.getText());
+                    if (m.initializer !== undefined) {
+                        this.out(" = ");
+                        this.expression(m.initializer, program, undefined);
+                    }
+                    this.out(",\n");
+                }
+            }
+            this._level--;
+            this.level();
+            this.out("};\n\n");
+        }
+        implementEnum(s, program) {
+            if (!isStringEnum(s)) {
+                return;
+            }
+            for (let m of s.members){
+                this.level();
+                this.out("const ");
+                this.out(this._options.lib);
+                this.out("::String ");
+                this.out(s.name.text);
+                this.out("::");
+                this.out(m.name.getText());
+                this.out(" = ");
+                this.expression(m.initializer, program, undefined);
+                this.out(";\n");
+            }
+            this.out("\n");
+        }
+        constants(s, program) {
+            let checker = program.getTypeChecker();
+            for (let v of s.declarationList.declarations){
+                if (!isConstDeclaration(v) || v.initializer === undefined || !isConstantType(checker.getTypeAtLocation(v.name))) {
+                    continue;
+                }
+                let name = checker.getSymbolAtLocation(v.name);
+                this.level();
+                if (isConstantExpression(v.initializer, checker)) {
+                    this.out("constexpr ");
+                    this.out(this.defineConstant(name.name, v, program));
+                    this.out(" = ");
+                    this.expression(v.initializer, program, undefined);
+                } else {
+                    this.out("extern const ");
+                    this.out(this.defineConstant(name.name, v, program));
+                }
+                this.out(";\n\n");
+            }
+        }
+        implementConstants(s, program) {
+            let checker = program.getTypeChecker();
+            for (let v of s.declarationList.declarations){
+                if (!isConstDeclaration(v) || v.initializer === undefined || !isConstantType(checker.getTypeAtLocation(v.name)) || isConstantExpression(v.initializer, checker)) {
+                    continue;
+                }
+                let name = checker.getSymbolAtLocation(v.name);
+                this.level();
+                this.out("const ");
+                this.out(this.defineConstant(name.name, v, program));
+                this.out(" = ");
+                this.expression(v.initializer, program, undefined);
+                this.out(";\n\n");
+            }
+        }
         function(s, program) {
             if (s.name === undefined) {
                 return;
@@ -787,49 +1992,42 @@ var CC;
             let symbol = checker.getSymbolAtLocation(s.name);
             let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
             console.info("[function]", symbol.name, ">>");
+            this.templateParameters(s, program);
             this.level();
             if (type !== undefined) {
                 this.out(define(symbol.name, type, program, this._options));
-            }
-            else {
+            } else {
                 this.out("void ");
                 this.out(symbol.name);
             }
             this.out("(");
-            if (s.parameters !== undefined) {
-                var dot = "";
-                for (let param of s.parameters) {
-                    let name = checker.getSymbolAtLocation(param.name);
-                    let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                    this.out(dot);
-                    this.out(define(name.name, type, program, this._options));
-                    dot = ",";
-                }
-            }
+            this.out(this.parameters(s, program, this.sinkParameters(s, program)));
             this.out(");\n\n");
             console.info("[function]", symbol.name, "<<");
         }
         implementGetter(s, program) {
+            if (inlineGetter(s) !== undefined) {
+                return;
+            }
             let checker = program.getTypeChecker();
             let name = checker.getSymbolAtLocation(s.name);
             let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
             let p = s.parent;
-            let pname = checker.getSymbolAtLocation(p.name);
             var isPublic = true;
             if (s.modifiers !== undefined) {
-                for (let element of s.modifiers) {
+                for (let element of s.modifiers){
                     if (element.kind == ts.SyntaxKind.PrivateKeyword) {
                         isPublic = false;
                         break;
-                    }
-                    else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
+                    } else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
                         isPublic = false;
                         break;
                     }
                 }
             }
+            this.templateParameters(p, program, false);
             this.level();
-            this.out(getter(pname.name + "::" + name.name, type, program, this._options));
+            this.out(getter(this.className(p, program) + "::" + name.name, type, program, this._options));
             this.out("{\n");
             this._level++;
             if (ts.isPropertyDeclaration(s)) {
@@ -840,8 +2038,7 @@ var CC;
                 }
                 this.out(name.name);
                 this.out(";\n");
-            }
-            else if (s.body !== undefined) {
+            } else if (s.body !== undefined) {
                 this.body(s.body, program, p);
             }
             this._level--;
@@ -849,27 +2046,29 @@ var CC;
             this.out("}\n\n");
         }
         implementSetter(s, program) {
+            if (inlineSetter(s) !== undefined) {
+                return;
+            }
             let checker = program.getTypeChecker();
             let name = checker.getSymbolAtLocation(s.name);
             let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
             let p = s.parent;
-            let pname = checker.getSymbolAtLocation(p.name);
             var isPublic = true;
             if (s.modifiers !== undefined) {
-                for (let element of s.modifiers) {
+                for (let element of s.modifiers){
                     if (element.kind == ts.SyntaxKind.PrivateKeyword) {
                         isPublic = false;
                         break;
-                    }
-                    else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
+                    } else if (element.kind == ts.SyntaxKind.ProtectedKeyword) {
                         isPublic = false;
                         break;
                     }
                 }
             }
             if (ts.isPropertyDeclaration(s)) {
+                this.templateParameters(p, program, false);
                 this.level();
-                this.out(setter(pname.name + "::" + getSetSymbol(name.name), "__newValue__", type, program, this._options));
+                this.out(setter(this.className(p, program) + "::" + getSetSymbol(name.name), "__newValue__", type, program, this._options));
                 this.out("{\n");
                 this._level++;
                 this.level();
@@ -882,14 +2081,13 @@ var CC;
                 this._level--;
                 this.level();
                 this.out("}\n\n");
-            }
-            else {
+            } else {
                 this.level();
                 this.out(type === undefined ? "void " + name.name : define(name.name, type, program, this._options));
                 this.out("(");
                 if (s.parameters !== undefined) {
                     var dot = "";
-                    for (let param of s.parameters) {
+                    for (let param of s.parameters){
                         let name = checker.getSymbolAtLocation(param.name);
                         let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
                         this.out(dot);
@@ -907,15 +2105,46 @@ var CC;
                 this.out("}\n\n");
             }
         }
+        implementStatic(s, program, kind) {
+            let checker = program.getTypeChecker();
+            let name = checker.getSymbolAtLocation(s.name);
+            let p = s.parent;
+            let prefix = !isStaticMember(s) && isPublicProperty(s) ? "_" : "";
+            this.templateParameters(p, program, false);
+            this.level();
+            if (kind == "constexpr") {
+                this.out("constexpr ");
+                this.out(this.defineConstant(this.className(p, program) + "::" + prefix + name.name, s, program));
+            } else {
+                if (kind == "const") {
+                    this.out("const ");
+                }
+                this.out(this.defineConstant(this.className(p, program) + "::" + prefix + name.name, s, program));
+                this.out(" = ");
+                if (s.initializer !== undefined) {
+                    this.expression(s.initializer, program, p);
+                } else {
+                    let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
+                    this.out(getDefaultValue(type, this._options));
+                }
+            }
+            this.out(";\n\n");
+        }
         implementProperty(s, program) {
+            let kind = this.staticKind(s, program);
+            if (kind !== undefined) {
+                this.implementStatic(s, program, kind);
+                if (isStaticMember(s)) {
+                    return;
+                }
+            }
             var readonly = false;
             var isPublic = true;
             if (s.modifiers !== undefined) {
-                for (let element of s.modifiers) {
+                for (let element of s.modifiers){
                     if (element.kind == ts.SyntaxKind.ReadonlyKeyword) {
                         readonly = true;
-                    }
-                    else if (element.kind == ts.SyntaxKind.ProtectedKeyword || element.kind == ts.SyntaxKind.PrivateKeyword) {
+                    } else if (element.kind == ts.SyntaxKind.ProtectedKeyword || element.kind == ts.SyntaxKind.PrivateKeyword) {
                         isPublic = false;
                     }
                 }
@@ -932,46 +2161,55 @@ var CC;
             let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
             let name = checker.getSymbolAtLocation(s.name);
             let p = s.parent;
-            let pname = checker.getSymbolAtLocation(p.name);
+            this.templateParameters(p, program, false);
             this.level();
-            this.out(define(pname.name + "::" + name.name, type, program, this._options));
+            this.out(define(this.className(p, program) + "::" + name.name, type, program, this._options));
             this.out("(");
-            if (s.parameters !== undefined) {
-                var dot = "";
-                for (let param of s.parameters) {
-                    let name = checker.getSymbolAtLocation(param.name);
-                    let type = getTypeAtLocation(param.type, checker);
-                    this.out(dot);
-                    this.out(define(name.name, type, program, this._options));
-                    dot = ",";
-                }
-            }
+            this._sinks = this.sinkParameters(s, program);
+            this.out(this.parameters(s, program, this._sinks));
             this.out(") {\n");
+            if (isAsync(s) && !isStaticMember(s)) {
+                let names = s.parameters.map((param)=>checker.getSymbolAtLocation(param.name).name);
+                this.level(1);
+                this.out("return " + name.name + "async__(" + [
+                    "this"
+                ].concat(names).join(",") + ");\n");
+                this.level();
+                this.out("}\n\n");
+                this.templateParameters(p, program, false);
+                this.level();
+                this.out(define(this.className(p, program) + "::" + name.name + "async__", type, program, this._options));
+                this.out("(");
+                this.out([
+                    this._options.lib + "::Strong<" + this._options.lib + "::IObject *> __Self__",
+                    this.parameters(s, program, this._sinks)
+                ].filter((v)=>v != "").join(","));
+                this.out(") {\n");
+            }
             if (s.body !== undefined) {
                 this._level++;
+                this.parameterCopies(s, program, isPromiseType(type));
                 this.body(s.body, program, p);
+                this.asyncEnd(s, type);
                 this._level--;
             }
+            this._sinks.clear();
             this.level();
             this.out("}\n\n");
         }
         implementClass(s, program) {
             let v = this;
             var hasConstructor = false;
-            ts.forEachChild(s, (node) => {
+            ts.forEachChild(s, (node)=>{
                 if (ts.isPropertyDeclaration(node)) {
                     v.implementProperty(node, program);
-                }
-                else if (ts.isGetAccessorDeclaration(node)) {
+                } else if (ts.isGetAccessorDeclaration(node)) {
                     v.implementGetter(node, program);
-                }
-                else if (ts.isSetAccessorDeclaration(node)) {
+                } else if (ts.isSetAccessorDeclaration(node)) {
                     v.implementSetter(node, program);
-                }
-                else if (ts.isMethodDeclaration(node)) {
+                } else if (ts.isMethodDeclaration(node)) {
                     v.implementMethod(node, program);
-                }
-                else if (ts.isConstructorDeclaration(node)) {
+                } else if (ts.isConstructorDeclaration(node)) {
                     v.implementConstructor(node, program);
                     hasConstructor = true;
                 }
@@ -984,42 +2222,40 @@ var CC;
             let checker = program.getTypeChecker();
             let name = checker.getSymbolAtLocation(s.name);
             let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
+            this.templateParameters(s, program, false);
             this.level();
             if (type !== undefined) {
                 this.out(define(name.name, type, program, this._options));
-            }
-            else {
+            } else {
                 this.out("void ");
-                this.out(name.name);
-            }
-            this.out("(");
-            if (s.parameters !== undefined) {
-                var dot = "";
-                for (let param of s.parameters) {
-                    let name = checker.getSymbolAtLocation(param.name);
-                    let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                    this.out(dot);
-                    this.out(define(name.name, type, program, this._options));
-                    dot = ",";
-                }
+                this.out(name.name);
             }
+            this.out("(");
+            this._sinks = this.sinkParameters(s, program);
+            this.out(this.parameters(s, program, this._sinks));
             this.out(") {\n");
             if (s.body !== undefined) {
                 this._level++;
+                this.parameterCopies(s, program, isPromiseType(type));
                 this.body(s.body, program, undefined);
+                this.asyncEnd(s, type);
                 this._level--;
             }
+            this._sinks.clear();
             this.level();
             this.out("}\n\n");
         }
         implementInitializer(s, program) {
+            if (this.staticKind(s, program) !== undefined) {
+                return;
+            }
             let checker = program.getTypeChecker();
             let name = checker.getSymbolAtLocation(s.name);
             let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
             let p = s.parent;
             var isPublic = true;
             if (s.modifiers !== undefined) {
-                for (let element of s.modifiers) {
+                for (let element of s.modifiers){
                     if (element.kind == ts.SyntaxKind.PrivateKeyword || ts.SyntaxKind.ProtectedKeyword) {
                         isPublic = false;
                         break;
@@ -1028,9 +2264,9 @@ var CC;
             }
             if (s.initializer !== undefined && ts.isObjectLiteralExpression(s.initializer)) {
                 let e = s.initializer;
-                if (type !== undefined && type.symbol !== undefined && type.symbol.name == "map") {
+                if (type !== undefined && type.symbol !== undefined && (type.symbol.name == "map" || type.symbol.name == "orderedMap")) {
                     var count = 0;
-                    for (let prop of e.properties) {
+                    for (let prop of e.properties){
                         if (ts.isPropertyAssignment(prop)) {
                             count++;
                         }
@@ -1049,7 +2285,7 @@ var CC;
                         }
                         this.out(name.name);
                         this.out(";\n");
-                        for (let prop of e.properties) {
+                        for (let prop of e.properties){
                             if (ts.isPropertyAssignment(prop)) {
                                 let n = checker.getSymbolAtLocation(prop.name);
                                 this.level(1);
@@ -1076,7 +2312,7 @@ var CC;
                     this.out(" * __V__ = new ");
                     this.out(type.symbol.name);
                     this.out("();\n");
-                    for (let prop of e.properties) {
+                    for (let prop of e.properties){
                         if (ts.isPropertyAssignment(prop)) {
                             let n = checker.getSymbolAtLocation(prop.name);
                             this.level(1);
@@ -1097,30 +2333,26 @@ var CC;
                 }
                 this.level();
                 this.out("}\n");
-            }
-            else if (s.initializer !== undefined) {
+            } else if (s.initializer !== undefined) {
                 this.level();
                 if (isPublic) {
                     this.out("this->_");
                     this.out(name.name);
                     this.out("=");
-                }
-                else {
+                } else {
                     this.out("this->");
                     this.out(name.name);
                     this.out("=");
                 }
                 this.expression(s.initializer, program, p);
                 this.out(";\n");
-            }
-            else {
+            } else {
                 this.level();
                 if (isPublic) {
                     this.out("this->_");
                     this.out(name.name);
                     this.out("=");
-                }
-                else {
+                } else {
                     this.out("this->");
                     this.out(name.name);
                     this.out("=");
@@ -1132,15 +2364,16 @@ var CC;
         implementDefaultConstructor(p, program) {
             let checker = program.getTypeChecker();
             let pname = checker.getSymbolAtLocation(p.name);
+            this.templateParameters(p, program, false);
             this.level();
-            this.out(pname.name);
+            this.out(this.className(p, program));
             this.out("::");
             this.out(pname.name);
             this.out("(");
             this.out(") {\n");
             this._level++;
             let v = this;
-            ts.forEachChild(p, (node) => {
+            ts.forEachChild(p, (node)=>{
                 if (ts.isPropertyDeclaration(node)) {
                     v.implementInitializer(node, program);
                 }
@@ -1153,22 +2386,19 @@ var CC;
             let checker = program.getTypeChecker();
             let p = s.parent;
             let pname = checker.getSymbolAtLocation(p.name);
+            this.templateParameters(p, program, false);
             this.level();
-            this.out(pname.name);
+            this.out(this.className(p, program));
             this.out("::");
             this.out(pname.name);
             this.out("(");
-            var vs = [];
-            for (let param of s.parameters) {
-                let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                let name = checker.getSymbolAtLocation(param.name);
-                vs.push(define(name.name, type, program, this._options));
-            }
-            this.out(vs.join(","));
+            this._sinks = this.sinkParameters(s, program);
+            this.out(this.parameters(s, program, this._sinks));
             this.out(") {\n");
             this._level++;
+            this.parameterCopies(s, program);
             let v = this;
-            ts.forEachChild(p, (node) => {
+            ts.forEachChild(p, (node)=>{
                 if (ts.isPropertyDeclaration(node)) {
                     v.implementInitializer(node, program);
                 }
@@ -1176,6 +2406,7 @@ var CC;
             if (s.body !== undefined) {
                 this.body(s.body, program, p);
             }
+            this._sinks.clear();
             this._level--;
             this.level();
             this.out("}\n\n");
@@ -1186,7 +2417,7 @@ var CC;
                 let name = checker.getSymbolAtLocation(e.name);
                 if (e.expression.kind == ts.SyntaxKind.ThisKeyword && isa !== undefined) {
                     var property;
-                    ts.forEachChild(isa, (node) => {
+                    ts.forEachChild(isa, (node)=>{
                         if (ts.isPropertyDeclaration(node)) {
                             let n = checker.getSymbolAtLocation(node.name);
                             if (n.name == name.name) {
@@ -1201,8 +2432,7 @@ var CC;
                             let name = checker.getSymbolAtLocation(e.name);
                             this.out("_");
                             this.out(name.name);
-                        }
-                        else {
+                        } else {
                             this.out("this->");
                             let name = checker.getSymbolAtLocation(e.name);
                             this.out(name.name);
@@ -1210,178 +2440,254 @@ var CC;
                         if (type != undefined && isObjectType(type)) {
                             this.out(".as()");
                         }
-                    }
-                    else {
+                    } else {
                         this.out("this->");
                         this.out(name.name);
                         this.out("()");
                     }
-                }
-                else {
+                } else if (isStaticAccess(name)) {
+                    this.expression(e.expression, program, isa);
+                    this.out("::");
+                    this.out(name.name);
+                } else {
                     this.expression(e.expression, program, isa);
                     this.out("->");
                     this.out(name.name);
                     this.out("()");
                 }
-            }
-            else if (ts.isBinaryExpression(e)) {
-                this.expression(e.left, program, isa);
+            } else if (ts.isBinaryExpression(e) && isStringConcat(e, checker)) {
+                let vs = [];
+                stringConcatOperands(e, checker, vs);
+                this.out(this._options.lib);
+                this.out("::concat(");
+                var dot = "";
+                for (let v of vs){
+                    this.out(dot);
+                    this.expression(v, program, isa);
+                    dot = ",";
+                }
+                this.out(")");
+            } else if (ts.isBinaryExpression(e)) {
+                let w = this.operandWidth(e, program);
+                if (w !== undefined) {
+                    this.out("(" + this._options.lib + NumericTypes[w] + ")(");
+                    this.expression(e.left, program, isa);
+                    this.out(")");
+                } else {
+                    this.expression(e.left, program, isa);
+                }
                 this.out(e.operatorToken.getText());
                 this.expression(e.right, program, isa);
-            }
-            else if (ts.isIdentifier(e)) {
+            } else if (ts.isIdentifier(e)) {
                 if (e.text == "undefined" || e.text == "null") {
                     this.out("nullptr");
-                }
-                else {
+                } else if (this._sinks.has(checker.getSymbolAtLocation(e))) {
+                    this.out("std::move(");
+                    this.out(e.text);
+                    this.out(")");
+                } else {
                     this.out(e.text);
                 }
-            }
-            else if (ts.isCallExpression(e)) {
-                if (ts.isPropertyAccessExpression(e.expression)) {
+            } else if (ts.isCallExpression(e)) {
+                let lib = getLibFunction(e.expression, checker, this._options);
+                if (lib !== undefined) {
+                    this.out(lib);
+                    this.out("(");
+                    var dot = "";
+                    for (let arg of e.arguments){
+                        this.out(dot);
+                        this.expression(arg, program, isa);
+                        dot = ",";
+                    }
+                    this.out(")");
+                } else if (ts.isPropertyAccessExpression(e.expression)) {
                     this.expression(e.expression.expression, program, isa);
-                    this.out("->");
+                    let callee = checker.getSymbolAtLocation(e.expression.name);
+                    this.out(callee !== undefined && isStaticAccess(callee) ? "::" : "->");
                     this.out(e.expression.name.escapedText);
                     this.out("(");
-                    var vs = [];
-                    for (let arg of e.arguments) {
+                    var dot = "";
+                    for (let arg of e.arguments){
+                        this.out(dot);
                         this.expression(arg, program, isa);
+                        dot = ",";
                     }
-                    this.out(vs.join(","));
                     this.out(")");
-                }
-                else {
-                    this.out("(*(");
+                } else if (this.isGenericCall(e, program)) {
                     this.expression(e.expression, program, isa);
-                    this.out("))(");
-                    var vs = [];
-                    for (let arg of e.arguments) {
+                    this.out(this.typeArguments(e.typeArguments, program));
+                    this.out("(");
+                    var dot = "";
+                    for (let arg of e.arguments){
+                        this.out(dot);
                         this.expression(arg, program, isa);
+                        dot = ",";
                     }
-                    this.out(vs.join(","));
                     this.out(")");
-                }
-            }
-            else if (ts.isNewExpression(e)) {
-                this.out("new ");
-                var n = e.expression;
-                var ns = [];
-                while (1) {
-                    if (ts.isPropertyAccessExpression(n)) {
-                        ns.push(n.name.escapedText);
-                        n = n.expression;
-                    }
-                    else if (ts.isToken(n)) {
-                        ns.push(n.getText());
-                        break;
-                    }
-                    else {
-                        break;
-                    }
-                }
-                this.out(ns.reverse().join("::"));
-                this.out("(");
-                var dot = "";
-                if (e.arguments != undefined) {
-                    for (let arg of e.arguments) {
+                } else {
+                    this.out("(*(");
+                    this.expression(e.expression, program, isa);
+                    this.out("))(");
+                    var dot = "";
+                    for (let arg of e.arguments){
                         this.out(dot);
                         this.expression(arg, program, isa);
                         dot = ",";
                     }
+                    this.out(")");
                 }
+            } else if (ts.isNewExpression(e)) {
+                this.newExpression(e, program, isa);
+            } else if (ts.isAwaitExpression(e)) {
+                this.out("(co_await ");
+                this.expression(e.expression, program, isa);
                 this.out(")");
-            }
-            else if (ts.isNumericLiteral(e)) {
+            } else if (ts.isNumericLiteral(e)) {
                 this.out(e.getText());
-            }
-            else if (ts.isStringLiteral(e)) {
+            } else if (ts.isStringLiteral(e)) {
                 this.out(JSON.stringify(e.text));
-            }
-            else if (e.kind == ts.SyntaxKind.ThisKeyword) {
+            } else if (e.kind == ts.SyntaxKind.ThisKeyword) {
                 this.out("this");
-            }
-            else if (e.kind == ts.SyntaxKind.FalseKeyword) {
+            } else if (e.kind == ts.SyntaxKind.FalseKeyword) {
                 this.out("false");
-            }
-            else if (e.kind == ts.SyntaxKind.TrueKeyword) {
+            } else if (e.kind == ts.SyntaxKind.TrueKeyword) {
                 this.out("true");
-            }
-            else if (e.kind == ts.SyntaxKind.UndefinedKeyword) {
+            } else if (e.kind == ts.SyntaxKind.UndefinedKeyword) {
                 this.out("nullptr");
-            }
-            else if (e.kind == ts.SyntaxKind.NullKeyword) {
+            } else if (e.kind == ts.SyntaxKind.NullKeyword) {
                 this.out("nullptr");
-            }
-            else if (ts.isPostfixUnaryExpression(e)) {
+            } else if (ts.isPostfixUnaryExpression(e)) {
                 this.expression(e.operand, program, isa);
                 if (e.operator == ts.SyntaxKind.PlusPlusToken) {
                     this.out("++");
-                }
-                else {
+                } else {
                     this.out("--");
                 }
-            }
-            else if (ts.isPrefixUnaryExpression(e)) {
+            } else if (ts.isPrefixUnaryExpression(e)) {
                 if (e.operator == ts.SyntaxKind.PlusPlusToken) {
                     this.out("++");
-                }
-                else {
+                } else {
                     this.out("--");
                 }
                 this.expression(e.operand, program, isa);
-            }
-            else if (ts.isArrowFunction(e)) {
+            } else if (ts.isArrowFunction(e)) {
                 let func = e;
                 let closure = func.closure;
-                this.out("(new ");
-                this.out(this._options.lib);
-                this.out("::Closure<");
-                let args = [];
-                let returnType = e.type === undefined ? undefined : checker.getTypeAtLocation(e.type);
-                args.push(define("", returnType, program, this._options));
-                for (let param of e.parameters) {
-                    let vType = getTypeAtLocation(param.type, checker);
-                    args.push(define("", vType, program, this._options));
-                }
-                this.out(args.join(","));
-                this.out(">(");
-                this.out(closure.name);
-                this.out("))");
-                for (let local of closure.locals) {
-                    this.out("->as(");
-                    this.out(JSON.stringify(local.name));
-                    this.out(",");
+                if (closure.locals.length == 0) {
                     this.out(this._options.lib);
-                    this.out("::Any(");
-                    this.out(local.name);
-                    this.out("))");
+                    this.out("::StaticClosure<");
+                    this.out(closure.args.join(","));
+                    this.out(closure.template == "" ? ">::get<" : ">::template get<");
+                    this.out(closure.name + closure.template);
+                    this.out(">()");
+                } else {
+                    this.out("new ");
+                    this.out(closure.name);
+                    this.out("type__" + closure.template + "(");
+                    this.out(closure.name + closure.template);
+                    for (let local of closure.locals){
+                        this.out(",");
+                        this.out(local.name);
+                    }
+                    this.out(")");
                 }
-            }
-            else if (ts.isIdentifier(e)) {
+            } else if (ts.isIdentifier(e)) {
                 this.out(e.text);
-            }
-            else if (ts.isElementAccessExpression(e)) {
+            } else if (ts.isElementAccessExpression(e) && !isWriteTarget(e) && isContainerType(checker.getTypeAtLocation(e.expression))) {
                 this.expression(e.expression, program, isa);
+                this.out(".get(");
+                this.expression(e.argumentExpression, program, isa);
+                this.out(")");
+            } else if (ts.isElementAccessExpression(e)) {
+                if (getLibType(checker.getTypeAtLocation(e.expression), this._options) !== undefined) {
+                    this.out("(*");
+                    this.expression(e.expression, program, isa);
+                    this.out(")");
+                } else {
+                    this.expression(e.expression, program, isa);
+                }
                 this.out("[");
                 this.expression(e.argumentExpression, program, isa);
                 this.out("]");
-            }
-            else {
+            } else {
                 this.out(e.getText());
                 console.info("[EX]", e.kind, e.getText());
             }
         }
+        newExpression(e, program, isa, local) {
+            let checker = program.getTypeChecker();
+            if (local === undefined) {
+                this.out("new ");
+            }
+            var n = e.expression;
+            var ns = [];
+            let lib = getLibType(checker.getTypeAtLocation(e), this._options);
+            if (lib !== undefined) {
+                ns.push(lib);
+            }
+            while(lib === undefined){
+                if (ts.isPropertyAccessExpression(n)) {
+                    ns.push(n.name.escapedText);
+                    n = n.expression;
+                } else if (ts.isToken(n)) {
+                    ns.push(n.getText());
+                    break;
+                } else {
+                    break;
+                }
+            }
+            this.out(ns.reverse().join("::"));
+            let type = checker.getTypeAtLocation(e);
+            if (lib === undefined && isGenericType(type)) {
+                if (e.typeArguments !== undefined) {
+                    this.out(this.typeArguments(e.typeArguments, program));
+                } else {
+                    this.out("<" + genericArguments(type).map((v)=>define("", v, program, this._options)).join(",") + ">");
+                }
+            }
+            if (local !== undefined) {
+                this.out(" ");
+                this.out(local);
+                if (e.arguments === undefined || e.arguments.length == 0) {
+                    return;
+                }
+            }
+            this.out("(");
+            var dot = "";
+            if (e.arguments != undefined) {
+                for (let arg of e.arguments){
+                    this.out(dot);
+                    this.expression(arg, program, isa);
+                    dot = ",";
+                }
+            }
+            this.out(")");
+        }
+        typeArguments(args, program) {
+            if (args === undefined || args.length == 0) {
+                return "";
+            }
+            let checker = program.getTypeChecker();
+            return "<" + args.map((v)=>define("", getTypeAtLocation(v, checker), program, this._options)).join(",") + ">";
+        }
+        isGenericCall(e, program) {
+            let checker = program.getTypeChecker();
+            var symbol = checker.getSymbolAtLocation(e.expression);
+            if (symbol !== undefined && (symbol.flags & ts.SymbolFlags.Alias) != 0) {
+                symbol = checker.getAliasedSymbol(symbol);
+            }
+            return symbol !== undefined && symbol.valueDeclaration !== undefined && ts.isFunctionDeclaration(symbol.valueDeclaration) && isGenericDeclaration(symbol.valueDeclaration);
+        }
         statement(st, program, isa) {
             let checker = program.getTypeChecker();
             if (ts.isReturnStatement(st)) {
                 this.level();
-                this.out("return ");
+                this.out(isAsyncScope(st) ? "co_return " : "return ");
                 if (st.expression !== undefined) {
                     this.expression(st.expression, program, isa);
                 }
                 this.out(";\n");
-            }
-            else if (ts.isIfStatement(st)) {
+            } else if (ts.isIfStatement(st)) {
                 this.level();
                 this.out("if(");
                 this.expression(st.expression, program, isa);
@@ -1392,21 +2698,19 @@ var CC;
                     this.out("else ");
                     this.statement(st.elseStatement, program, isa);
                 }
-            }
-            else if (ts.isForStatement(st)) {
+            } else if (ts.isForStatement(st)) {
                 this.level();
                 this.out("for(");
                 if (st.initializer !== undefined) {
                     if (ts.isVariableDeclarationList(st.initializer)) {
                         var dot = "";
-                        for (let v of st.initializer.declarations) {
+                        for (let v of st.initializer.declarations){
                             let n = checker.getSymbolAtLocation(v.name);
                             this.out(dot);
                             if (dot == "") {
                                 let type = getTypeAtLocation(v.type, checker);
-                                this.out(define(n.name, type, program, this._options));
-                            }
-                            else {
+                                this.out(this.defineSymbol(n.name, n, type, program));
+                            } else {
                                 this.out(n.name);
                             }
                             if (v.initializer !== undefined) {
@@ -1415,8 +2719,7 @@ var CC;
                             }
                             dot = ",";
                         }
-                    }
-                    else {
+                    } else {
                         this.expression(st.initializer, program, isa);
                     }
                 }
@@ -1430,36 +2733,33 @@ var CC;
                 }
                 this.out(") ");
                 this.statement(st.statement, program, isa);
-            }
-            else if (ts.isWhileStatement(st)) {
+            } else if (ts.isWhileStatement(st)) {
                 this.level();
                 this.out("while(");
                 this.expression(st.expression, program, isa);
                 this.out(") ");
                 this.statement(st.statement, program, isa);
-            }
-            else if (ts.isSwitchStatement(st)) {
+            } else if (ts.isSwitchStatement(st)) {
                 this.level();
                 this.out("switch(");
                 this.expression(st.expression, program, isa);
                 this.out(") {\n");
-                for (let clause of st.caseBlock.clauses) {
+                for (let clause of st.caseBlock.clauses){
                     if (ts.isCaseClause(clause)) {
                         this.level();
                         this.out("case ");
                         this.expression(clause.expression, program, isa);
                         this.out(" :\n");
                         this._level++;
-                        for (let s of clause.statements) {
+                        for (let s of clause.statements){
                             this.statement(s, program, isa);
                         }
                         this._level--;
-                    }
-                    else {
+                    } else {
                         this.level();
                         this.out("default:\n");
                         this._level++;
-                        for (let s of clause.statements) {
+                        for (let s of clause.statements){
                             this.statement(s, program, isa);
                         }
                         this._level--;
@@ -1467,54 +2767,74 @@ var CC;
                 }
                 this.level();
                 this.out("}\n");
-            }
-            else if (ts.isBlock(st)) {
+            } else if (ts.isBlock(st)) {
                 if (this._isNewLine) {
                     this.level();
                 }
                 this.out("{\n");
                 this._level++;
-                for (let v of st.statements) {
+                for (let v of st.statements){
                     this.statement(v, program, isa);
                 }
                 this._level--;
                 this.level();
                 this.out("}\n");
-            }
-            else if (ts.isExpressionStatement(st)) {
+            } else if (ts.isExpressionStatement(st)) {
                 this.level();
                 this.expression(st.expression, program, isa);
                 this.out(";\n");
-            }
-            else if (ts.isVariableStatement(st)) {
-                for (let v of st.declarationList.declarations) {
+            } else if (ts.isVariableStatement(st)) {
+                for (let v of st.declarationList.declarations){
                     this.level();
                     let n = checker.getSymbolAtLocation(v.name);
                     let t = v.type === undefined ? undefined : getTypeAtLocation(v.type, checker);
-                    this.out(define(n.name, t, program, this._options));
-                    if (v.initializer !== undefined) {
+                    if (v.initializer !== undefined && ts.isNewExpression(v.initializer) && isLocalObject(v, checker, this._options)) {
+                        this.newExpression(v.initializer, program, isa, "__new__" + n.name + "__");
+                        this.out(";\n");
+                        this.level();
+                        this.out(define(n.name, t, program, this._options));
                         this.out(" = (");
                         this.out(define("", t, program, this._options));
+                        this.out(")&__new__" + n.name + "__;\n");
+                        continue;
+                    }
+                    if (v.initializer !== undefined && ts.isArrowFunction(v.initializer) && isLocalClosure(v, checker) && v.initializer.closure.locals.length > 0) {
+                        let closure = v.initializer.closure;
+                        let args = [
+                            closure.name + closure.template
+                        ].concat(closure.locals.map((local)=>local.name));
+                        this.out(closure.name + "type__" + closure.template + " __closure__" + n.name + "__(" + args.join(",") + ");\n");
+                        this.level();
+                        this.out(this._options.lib + "::Closure<" + closure.args.join(",") + "> * " + n.name + " = &__closure__" + n.name + "__;\n");
+                        continue;
+                    }
+                    this.out(this.defineSymbol(n.name, n, t, program));
+                    if (v.initializer !== undefined) {
+                        this.out(" = (");
+                        this.out(this.defineSymbol("", n, t, program));
                         this.out(")");
                         this.expression(v.initializer, program, isa);
                     }
                     this.out(";\n");
                 }
-            }
-            else if (ts.isBreakStatement(st)) {
+            } else if (ts.isBreakStatement(st)) {
                 this.level();
                 this.out("break;\n");
-            }
-            else if (ts.isContinueStatement(st)) {
+            } else if (ts.isContinueStatement(st)) {
                 this.level();
                 this.out("continue;\n");
-            }
-            else {
+            } else {
                 console.info("[ST]", st.kind, st.getText());
             }
         }
+        asyncEnd(s, type) {
+            if (isAsync(s) && isVoidPromiseType(type)) {
+                this.level();
+                this.out("co_return;\n");
+            }
+        }
         body(body, program, isa) {
-            for (let st of body.statements) {
+            for (let st of body.statements){
                 this.statement(st, program, isa);
             }
         }
@@ -1523,23 +2843,20 @@ var CC;
             let vs = [];
             let p = s.parent;
             let locals = new Map();
-            while (p !== undefined) {
+            while(p !== undefined){
                 var fn;
-                if (ts.isArrowFunction(p)
-                    || ts.isMethodDeclaration(p) || ts.isGetAccessorDeclaration(p)
-                    || ts.isSetAccessorDeclaration(p) || ts.isFunctionDeclaration(p)) {
+                if (ts.isArrowFunction(p) || ts.isMethodDeclaration(p) || ts.isGetAccessorDeclaration(p) || ts.isSetAccessorDeclaration(p) || ts.isFunctionDeclaration(p)) {
                     fn = p;
                 }
                 if (fn !== undefined && fn.locals !== undefined) {
                     let v = fn.locals;
-                    for (let key of v.keys()) {
+                    for (let key of v.keys()){
                         if (!locals.has(key)) {
                             locals.set(key, v.get(key));
                         }
                     }
                 }
-                if (ts.isMethodDeclaration(p) || ts.isGetAccessorDeclaration(p)
-                    || ts.isSetAccessorDeclaration(p) || ts.isFunctionDeclaration(p)) {
+                if (ts.isMethodDeclaration(p) || ts.isGetAccessorDeclaration(p) || ts.isSetAccessorDeclaration(p) || ts.isFunctionDeclaration(p)) {
                     break;
                 }
                 p = p.parent;
@@ -1547,152 +2864,341 @@ var CC;
             {
                 let fn = s;
                 let v = fn.locals;
-                for (let key of v.keys()) {
+                for (let key of v.keys()){
                     locals.delete(key);
                 }
             }
             function each(node) {
                 if (ts.isIdentifier(node)) {
                     if (locals.has(node.text)) {
-                        vs.push(checker.getSymbolAtLocation(node));
+                        let symbol = checker.getSymbolAtLocation(node);
+                        if (vs.indexOf(symbol) < 0) {
+                            vs.push(symbol);
+                        }
                     }
-                }
-                else {
+                } else {
                     ts.forEachChild(node, each);
                 }
             }
             ts.forEachChild(s.body, each);
             return vs;
         }
+        closureLocalType(local, program) {
+            let checker = program.getTypeChecker();
+            if (ts.isVariableDeclaration(local.valueDeclaration) || ts.isParameter(local.valueDeclaration)) {
+                return local.valueDeclaration.type === undefined ? undefined : getTypeAtLocation(local.valueDeclaration.type, checker);
+            }
+            return undefined;
+        }
+        implementClosureLocals(closure, program, scope) {
+            let name = closure.name + "locals__";
+            this.templateParameters(scope, program, false);
+            this.level();
+            this.out("struct ");
+            this.out(name);
+            this.out(" {\n");
+            this._level++;
+            let params = [];
+            let inits = [];
+            for (let local of closure.locals){
+                let type = this.closureLocalType(local, program);
+                params.push(this.defineSymbol(local.name, local, type, program));
+                inits.push(local.name + "(" + local.name + ")");
+            }
+            this.level();
+            this.out(name);
+            this.out("(");
+            this.out(params.join(","));
+            this.out("):");
+            this.out(inits.join(","));
+            this.out(" {}\n");
+            for (let local of closure.locals){
+                let type = this.closureLocalType(local, program);
+                this.level();
+                if (type !== undefined && !isObjectReferenceType(type) && (isObjectType(type) || isFunctionType(type))) {
+                    this.out(this._options.lib);
+                    if (isObjectWeakType(type)) {
+                        this.out("::Weak<");
+                    } else {
+                        this.out("::Strong<");
+                    }
+                    this.out(define("", type, program, this._options));
+                    this.out("> ");
+                    this.out(local.name);
+                } else {
+                    this.out(this.defineSymbol("", local, type, program));
+                    this.out(" ");
+                    this.out(local.name);
+                }
+                this.out(";\n");
+            }
+            this._level--;
+            this.level();
+            this.out("};\n\n");
+            if (scope !== undefined) {
+                this.templateParameters(scope, program, false);
+                this.level();
+                this.out("using ");
+                this.out(closure.name);
+                this.out("type__ = ");
+                this.out(this._options.lib);
+                this.out("::LocalClosure<");
+                this.out(name + closure.template);
+                this.out(",");
+                this.out(closure.args.join(","));
+                this.out(">;\n\n");
+                return;
+            }
+            this.level();
+            this.out("typedef ");
+            this.out(this._options.lib);
+            this.out("::LocalClosure<");
+            this.out(name);
+            this.out(",");
+            this.out(closure.args.join(","));
+            this.out("> ");
+            this.out(closure.name);
+            this.out("type__;\n\n");
+        }
         implementArrowFunction(s, program, isa) {
             let checker = program.getTypeChecker();
+            let returnType = s.type === undefined ? undefined : checker.getTypeAtLocation(s.type);
+            let scope = genericScope(s);
             let closure = {
-                name: "__closure__func__" + s.pos + "_" + s.end + "__",
-                locals: this.closureSymbolsInFunction(s, program, isa)
+                name: "__closure__" + this._prefix + "__" + s.pos + "_" + s.end + "__",
+                args: [
+                    define("", returnType, program, this._options)
+                ],
+                locals: this.closureSymbolsInFunction(s, program, isa),
+                template: templateArguments(scope)
             };
+            for (let param of s.parameters){
+                let vType = getTypeAtLocation(param.type, checker);
+                closure.args.push(define("", vType, program, this._options));
+            }
             s.closure = closure;
-            let returnType = s.type === undefined ? undefined : checker.getTypeAtLocation(s.type);
+            if (closure.locals.length > 0) {
+                this.implementClosureLocals(closure, program, scope);
+            }
+            let async = isAsync(s);
+            let args = [];
+            let names = [];
+            for (let param of s.parameters){
+                let n = checker.getSymbolAtLocation(param.name);
+                let vType = getTypeAtLocation(param.type, checker);
+                args.push(defineParameter(this.isCopiedParameter(param, vType, async, program) ? "__" + n.name + "__" : n.name, vType, program, this._options, async));
+                names.push(n.name);
+            }
+            this.templateParameters(scope, program, false);
             this.level();
             this.out("inline static ");
             this.out(define("", returnType, program, this._options));
             this.out(" ");
             this.out(closure.name);
-            this.out("(");
-            let args = [];
-            args.push(this._options.lib + "::_Closure * __Closure__");
-            for (let param of s.parameters) {
-                let n = checker.getSymbolAtLocation(param.name);
-                let vType = getTypeAtLocation(param.type, checker);
-                args.push(define(n.name, vType, program, this._options));
+            if (async) {
+                this.out("async__(");
+                this.out([
+                    this._options.lib + "::Strong<" + this._options.lib + "::_Closure *> __Self__"
+                ].concat(args).join(","));
+                this.out(") {\n");
+                this._level++;
+                this.level();
+                this.out(this._options.lib + "::_Closure * __Closure__ = __Self__;\n");
+            } else {
+                this.out("(");
+                this.out([
+                    this._options.lib + "::_Closure * __Closure__"
+                ].concat(args).join(","));
+                this.out(") {\n");
+                this._level++;
             }
-            this.out(args.join(","));
-            this.out(") {\n");
-            this._level++;
-            for (let local of closure.locals) {
+            if (closure.locals.length > 0) {
+                this.level();
+                this.out(closure.name);
+                this.out("locals__" + closure.template + " & __Locals__ = ");
+                this.out(closure.name);
+                this.out("type__" + closure.template + "::get(__Closure__);\n");
+            }
+            for (let local of closure.locals){
+                let type = this.closureLocalType(local, program);
                 this.level();
-                if (ts.isVariableDeclaration(local.valueDeclaration) || ts.isParameter(local.valueDeclaration)) {
-                    let type = local.valueDeclaration.type === undefined ? undefined : checker.getTypeAtLocation(local.valueDeclaration.type);
+                if (type !== undefined && !isObjectReferenceType(type) && (isObjectType(type) || isFunctionType(type))) {
                     this.out(define(local.name, type, program, this._options));
-                    this.out(" = __Closure__->get(");
-                    this.out(JSON.stringify(local.name));
-                    this.out(")");
+                } else {
+                    this.out(this.defineSymbol("", local, type, program));
+                    this.out(" & ");
+                    this.out(local.name);
                 }
+                this.out(" = __Locals__.");
+                this.out(local.name);
                 this.out(";\n");
             }
+            this.parameterCopies(s, program, async);
             if (ts.isBlock(s.body)) {
                 this.body(s.body, program, isa);
-            }
-            else {
+                this.asyncEnd(s, returnType);
+            } else {
+                this.level();
+                this.out(async ? "co_return " : "return ");
                 this.expression(s.body, program, isa);
+                this.out(";\n");
             }
             this._level--;
             this.level();
             this.out("}\n\n");
+            if (async) {
+                this.templateParameters(scope, program, false);
+                this.level();
+                this.out("inline static ");
+                this.out(define("", returnType, program, this._options));
+                this.out(" ");
+                this.out(closure.name);
+                this.out("(");
+                args = [
+                    this._options.lib + "::_Closure * __Closure__"
+                ];
+                for (let param of s.parameters){
+                    let n = checker.getSymbolAtLocation(param.name);
+                    args.push(defineParameter(n.name, getTypeAtLocation(param.type, checker), program, this._options));
+                }
+                this.out(args.join(","));
+                this.out(") {\n");
+                this._level++;
+                this.level();
+                this.out("return ");
+                this.out(closure.name);
+                this.out("async__" + closure.template + "(" + [
+                    "__Closure__"
+                ].concat(names).join(",") + ");\n");
+                this._level--;
+                this.level();
+                this.out("}\n\n");
+            }
         }
         implementClosure(node, program, isa) {
             let v = this;
             function each(node) {
                 if (ts.isArrowFunction(node)) {
                     v.implementArrowFunction(node, program, isa);
-                }
-                else {
+                } else {
                     ts.forEachChild(node, each);
                 }
             }
             ts.forEachChild(node, each);
         }
-        import(s, program) {
+        import(s, program, type = 0) {
             let name = s.moduleSpecifier.getText().replace(/\"/g, "");
             if (name.startsWith("./")) {
+                if (type == 0) {
+                    let vs = forwardDeclarations(s, program.getTypeChecker());
+                    if (vs !== undefined) {
+                        return vs;
+                    }
+                }
                 this.include(name.substr(2) + ".h", false);
-            }
-            else if (!name.startsWith(".")) {
+            } else if (!name.startsWith(".") && type == 0) {
                 this.include(name + "/" + name + ".h", true);
             }
-            this.out("\n");
+            return [];
         }
         file(type, file, program, name) {
-            if (type == FileType.Header) {
+            this._prefix = name.replace(/[^A-Za-z0-9_]/g, "_");
+            if (type == 0) {
                 let fileName = name.replace("/", "_").toLocaleUpperCase();
                 this.out("#ifndef _" + fileName + "_H\n");
                 this.out("#define _" + fileName + "_H\n\n");
                 this.include(this._options.lib + "/" + this._options.lib + ".h", true);
                 this.includeFile(file, program);
+                let forwards = [];
+                for (let st of file.statements){
+                    if (ts.isImportDeclaration(st)) {
+                        forwards = forwards.concat(this.import(st, program));
+                    }
+                }
                 this.out("\n");
                 let v = this;
                 let checker = program.getTypeChecker();
+                let generics = [];
                 if (this._options.namespace !== undefined) {
                     this.namespaceStart(this._options.namespace);
                 }
+                for (let forward of forwards){
+                    this.level();
+                    this.out("class " + forward + ";\n");
+                }
+                if (forwards.length > 0) {
+                    this.out("\n");
+                }
                 function each(node) {
                     if (ts.isModuleDeclaration(node)) {
                         if (node.body !== undefined) {
                             ts.forEachChild(node.body, each);
                         }
-                    }
-                    else if (ts.isInterfaceDeclaration(node)) {
+                    } else if (ts.isInterfaceDeclaration(node)) {
                         v.interface(node, program);
-                    }
-                    else if (ts.isClassDeclaration(node) && node.name !== undefined) {
+                    } else if (ts.isClassDeclaration(node) && node.name !== undefined) {
                         v.class(node, program);
-                    }
-                    else if (ts.isFunctionDeclaration(node) && node.name !== undefined) {
+                        if (isGenericDeclaration(node)) {
+                            generics.push(node);
+                        }
+                    } else if (ts.isFunctionDeclaration(node) && node.name !== undefined) {
                         v.function(node, program);
-                    }
-                    else if (ts.isImportDeclaration(node)) {
-                        v.import(node, program);
+                        if (isGenericDeclaration(node)) {
+                            generics.push(node);
+                        }
+                    } else if (ts.isEnumDeclaration(node)) {
+                        v.enumDeclaration(node, program);
+                    } else if (ts.isVariableStatement(node)) {
+                        v.constants(node, program);
                     }
                 }
                 ts.forEachChild(file, each);
+                for (let node of generics){
+                    if (ts.isClassDeclaration(node)) {
+                        this.implementClosure(node, program, node);
+                        this.implementClass(node, program);
+                    } else if (ts.isFunctionDeclaration(node)) {
+                        this.implementClosure(node, program, undefined);
+                        this.implementFunction(node, program);
+                    }
+                }
                 if (this._options.namespace !== undefined) {
                     this.namespaceEnd();
                 }
                 this.out("#endif\n\n");
-            }
-            else {
+            } else {
                 this.include(name + ".h");
+                for (let st of file.statements){
+                    if (ts.isImportDeclaration(st)) {
+                        this.import(st, program, 1);
+                    }
+                }
                 this.out("\n");
                 let v = this;
                 let checker = program.getTypeChecker();
                 if (this._options.namespace !== undefined) {
                     this.namespaceStart(this._options.namespace);
                 }
-                function each(node) {
+                function each1(node) {
                     if (ts.isModuleDeclaration(node)) {
                         if (node.body !== undefined) {
-                            ts.forEachChild(node.body, each);
+                            ts.forEachChild(node.body, each1);
                         }
-                    }
-                    else if (ts.isClassDeclaration(node) && node.name !== undefined) {
+                    } else if (isGenericDeclaration(node)) {
+                        return;
+                    } else if (ts.isClassDeclaration(node) && node.name !== undefined) {
                         v.implementClosure(node, program, node);
                         v.implementClass(node, program);
-                    }
-                    else if (ts.isFunctionDeclaration(node) && node.name !== undefined) {
+                    } else if (ts.isFunctionDeclaration(node) && node.name !== undefined) {
                         v.implementClosure(node, program, undefined);
                         v.implementFunction(node, program);
+                    } else if (ts.isEnumDeclaration(node)) {
+                        v.implementEnum(node, program);
+                    } else if (ts.isVariableStatement(node)) {
+                        v.implementConstants(node, program);
                     }
                 }
-                ts.forEachChild(file, each);
+                ts.forEachChild(file, each1);
                 if (this._options.namespace !== undefined) {
                     this.namespaceEnd();
                 }
@@ -1700,6 +3206,6 @@ var CC;
         }
     }
     CC.Compiler = Compiler;
-    ;
-})(CC = exports.CC || (exports.CC = {}));
+})(CC || (CC = {}));
+var CC; exports.CC = CC;
 //# sourceMappingURL=CCompiler.js.map
\ No newline at end of file
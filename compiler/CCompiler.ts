@@ -12,7 +12,9 @@ export namespace CC {
 
     interface Closure {
         name: string,
-        locals: ts.Symbol[]
+        args: string[],
+        locals: ts.Symbol[],
+        template: string
     }
 
     interface ArrowFunction extends ts.ArrowFunction {
@@ -23,6 +25,7 @@ export namespace CC {
         name: string | undefined;
         typeArguments?: Type[];
         types?: Type[];
+        argumentNames?: string[];
     }
 
     function isPublicProperty(node: ts.PropertyDeclaration): boolean {
@@ -56,7 +59,7 @@ export namespace CC {
         }
         if ((type.flags & ts.TypeFlags.Object) != 0 && !type.isClassOrInterface()) {
             let t: Type = type as Type;
-            return t.typeArguments !== undefined;
+            return t.typeArguments !== undefined && !isGenericType(type) && !isLibType(type);
         }
         return false;
     }
@@ -91,6 +94,98 @@ export namespace CC {
     }
 
 
+    type GenericDeclaration = ts.ClassDeclaration | ts.InterfaceDeclaration | ts.FunctionDeclaration;
+
+    function isGenericDeclaration(node: ts.Node): node is GenericDeclaration {
+        return (ts.isClassDeclaration(node) || ts.isInterfaceDeclaration(node) || ts.isFunctionDeclaration(node))
+            && node.typeParameters !== undefined && node.typeParameters.length > 0;
+    }
+
+    function getGenericDeclaration(type: ts.Type): GenericDeclaration | undefined {
+        if (type.symbol === undefined || type.symbol.declarations === undefined) {
+            return undefined;
+        }
+        return type.symbol.declarations.find((d) => {
+            return (ts.isClassDeclaration(d) || ts.isInterfaceDeclaration(d))
+                && isGenericDeclaration(d) && !d.getSourceFile().isDeclarationFile;
+        }) as GenericDeclaration | undefined;
+    }
+
+    function isGenericType(type: ts.Type): boolean {
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        return (type.flags & ts.TypeFlags.Object) != 0 && (type as Type).typeArguments !== undefined
+            && getGenericDeclaration(type) !== undefined;
+    }
+
+    function genericArguments(type: ts.Type): Type[] {
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        let t: Type = type as Type;
+        return typeArguments(t, t.typeArguments!.slice(0, getGenericDeclaration(type)!.typeParameters!.length));
+    }
+
+    function typeArguments(t: Type, vs: Type[]): Type[] {
+        vs.forEach((v: Type, i: number): void => {
+            if ((v.flags & ts.TypeFlags.Number) != 0) {
+                v.name = t.argumentNames !== undefined ? t.argumentNames[i] : "number";
+            }
+        });
+        return vs;
+    }
+
+    function isTypeParameter(type: ts.Type): boolean {
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        return (type.flags & ts.TypeFlags.TypeParameter) != 0;
+    }
+
+    function isClassTypeParameter(type: ts.Type): boolean {
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        if (!isTypeParameter(type) || type.symbol === undefined || type.symbol.declarations === undefined) {
+            return false;
+        }
+        let p = type.symbol.declarations[0].parent;
+        return ts.isClassDeclaration(p) || ts.isInterfaceDeclaration(p);
+    }
+
+    function genericScope(node: ts.Node): GenericDeclaration | undefined {
+        var p: ts.Node | undefined = node.parent;
+        while (p !== undefined) {
+            if (isGenericDeclaration(p)) {
+                return p;
+            }
+            p = p.parent;
+        }
+        return undefined;
+    }
+
+    function templateArguments(node: GenericDeclaration | undefined): string {
+        if (node === undefined || !isGenericDeclaration(node)) {
+            return "";
+        }
+        return "<" + node.typeParameters!.map((v) => v.name.text).join(",") + ">";
+    }
+
+    function isStringConcat(e: ts.Expression, checker: ts.TypeChecker): boolean {
+        return ts.isBinaryExpression(e) && e.operatorToken.kind == ts.SyntaxKind.PlusToken
+            && (checker.getTypeAtLocation(e).flags & ts.TypeFlags.StringLike) != 0;
+    }
+
+    function stringConcatOperands(e: ts.Expression, checker: ts.TypeChecker, vs: ts.Expression[]): void {
+        if (ts.isBinaryExpression(e) && isStringConcat(e, checker)) {
+            stringConcatOperands(e.left, checker, vs);
+            stringConcatOperands(e.right, checker, vs);
+        } else {
+            vs.push(e);
+        }
+    }
+
     interface Symbol extends ts.Symbol {
         readonly parent: Symbol | undefined;
     }
@@ -104,18 +199,78 @@ export namespace CC {
             return undefined;
         }
         type.name = node.getText();
+        if (ts.isTypeReferenceNode(node) && node.typeArguments !== undefined) {
+            type.argumentNames = node.typeArguments.map((v) => v.getText());
+        }
         if (type.types !== undefined) {
             var i = 0;
             ts.forEachChild(node, (node: ts.Node): void => {
                 if (ts.isTypeNode(node)) {
                     let type: Type = checker.getTypeAtLocation(node)! as Type;
                     type.name = node.getText();
+                    if (ts.isTypeReferenceNode(node) && node.typeArguments !== undefined) {
+                        type.argumentNames = node.typeArguments.map((v) => v.getText());
+                    }
                 }
             });
         }
         return type;
     }
 
+    interface LibTypeSet {
+        [key: string]: string
+    }
+
+    const LibTypes: LibTypeSet = {
+        "float64array": "Float64Array",
+        "int32array": "Int32Array",
+        "channel": "Channel",
+        "concurrentMap": "ConcurrentMap"
+    };
+
+    function isLibType(type: ts.Type): boolean {
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        let symbol = type.symbol;
+        if (symbol === undefined || LibTypes[symbol.name] === undefined || symbol.declarations === undefined) {
+            return false;
+        }
+        return symbol.declarations.some((d) => d.getSourceFile().isDeclarationFile);
+    }
+
+    function getLibType(type: ts.Type | undefined, options: Options): string | undefined {
+        if (type === undefined || !isLibType(type)) {
+            return undefined;
+        }
+        let t = type.getNonNullableType() as Type;
+        let s = options.lib + "::" + LibTypes[t.symbol.name];
+        if (t.typeArguments !== undefined && t.typeArguments.length > 0) {
+            s += "<" + typeArguments(t, t.typeArguments.slice()).map((v) => getType(v, options)).join(",") + ">";
+        }
+        return s;
+    }
+
+    const LibFunctions: LibTypeSet = {
+        "parallelFor": "parallelFor",
+        "parallelMap": "parallelMap",
+        "parallelReduce": "parallelReduce"
+    };
+
+    function getLibFunction(e: ts.Expression, checker: ts.TypeChecker, options: Options): string | undefined {
+        var symbol = checker.getSymbolAtLocation(ts.isPropertyAccessExpression(e) ? e.name : e);
+        if (symbol !== undefined && (symbol.flags & ts.SymbolFlags.Alias) != 0) {
+            symbol = checker.getAliasedSymbol(symbol);
+        }
+        if (symbol === undefined || LibFunctions[symbol.name] === undefined || symbol.valueDeclaration === undefined) {
+            return undefined;
+        }
+        if (ts.isFunctionDeclaration(symbol.valueDeclaration) && symbol.valueDeclaration.getSourceFile().isDeclarationFile) {
+            return options.lib + "::" + LibFunctions[symbol.name];
+        }
+        return undefined;
+    }
+
     function getSymbolString(symbol: Symbol, options: Options): string {
         let vs: string[] = [];
         var s: Symbol | undefined = symbol;
@@ -143,6 +298,12 @@ export namespace CC {
                 type = v;
             }
         }
+        if ((type.flags & ts.TypeFlags.EnumLike) != 0) {
+            let e = getEnumDeclaration(type);
+            if (e !== undefined) {
+                return isStringEnum(e) ? options.lib + "::String" : getSymbolString(getEnumSymbol(type)!, options);
+            }
+        }
         if ((type.flags & ts.TypeFlags.String) != 0) {
             return options.lib + "::String";
         }
@@ -168,7 +329,18 @@ export namespace CC {
 
             return options.lib + "::Number";
         }
+        if ((type.flags & ts.TypeFlags.TypeParameter) != 0) {
+            return type.symbol.name;
+        }
         if ((type.flags & ts.TypeFlags.Object) != 0) {
+            let lib = getLibType(type, options);
+            if (lib !== undefined) {
+                return lib + " *";
+            }
+            if (isGenericType(type)) {
+                let vs = genericArguments(type).map((v) => getType(v, options));
+                return getSymbolString(type.symbol as Symbol, options) + "<" + vs.join(",") + "> *";
+            }
             return getSymbolString(type.symbol as Symbol, options) + " *";
         }
         if ((type.flags & ts.TypeFlags.Void) != 0) {
@@ -181,6 +353,31 @@ export namespace CC {
         throw new Error("[TYPE] " + type.flags.toString());
     }
 
+    function getEnumSymbol(type: ts.Type): Symbol | undefined {
+        var symbol = type.symbol as Symbol | undefined;
+        if (symbol !== undefined && (symbol.flags & ts.SymbolFlags.EnumMember) != 0) {
+            symbol = symbol.parent;
+        }
+        if (symbol === undefined || (symbol.flags & ts.SymbolFlags.Enum) == 0) {
+            return undefined;
+        }
+        return symbol;
+    }
+
+    function getEnumDeclaration(type: ts.Type): ts.EnumDeclaration | undefined {
+        let symbol = getEnumSymbol(type);
+        if (symbol === undefined || symbol.declarations === undefined) {
+            return undefined;
+        }
+        return symbol.declarations.find((d) => ts.isEnumDeclaration(d)) as ts.EnumDeclaration | undefined;
+    }
+
+    function isStringEnum(node: ts.EnumDeclaration): boolean {
+        return node.members.length > 0 && node.members.every((m: ts.EnumMember): boolean => {
+            return m.initializer !== undefined && ts.isStringLiteral(m.initializer);
+        });
+    }
+
     function getDefaultValue(type: ts.Type | undefined, options: Options): string {
         if (type === undefined) {
             return "nullptr";
@@ -188,6 +385,12 @@ export namespace CC {
         if ((type.flags & ts.TypeFlags.Union) != 0) {
             type = type.getNonNullableType();
         }
+        if ((type.flags & ts.TypeFlags.EnumLike) != 0 && getEnumDeclaration(type) !== undefined) {
+            return "(" + getType(type, options) + ")0";
+        }
+        if ((type.flags & ts.TypeFlags.TypeParameter) != 0) {
+            return getType(type, options) + "()";
+        }
         if ((type.flags & ts.TypeFlags.String) != 0) {
             return '""';
         }
@@ -241,11 +444,18 @@ export namespace CC {
             }
 
             return vs.join('');
+        } else if (type !== undefined && isGenericType(type)) {
+            let vs = genericArguments(type).map((v) => define("", v, program, options));
+            let s = getSymbolString(type.getNonNullableType().symbol as Symbol, options) + "<" + vs.join(",") + "> *";
+            if (name != "") {
+                s += " " + name;
+            }
+            return s;
         } else if (type !== undefined && isObjectReferenceType(type)) {
             let vs: string[] = [];
             let t: Type = type as Type;
             if (t.typeArguments !== undefined) {
-                for (let v of t.typeArguments) {
+                for (let v of isPromiseType(type) ? typeArguments(t, t.typeArguments) : t.typeArguments) {
                     vs.push(define("", v, program, options));
                 }
             }
@@ -254,13 +464,19 @@ export namespace CC {
             
             if(type.symbol.name == "map") {
                 s = options.lib + "::Map";
+            } else if(type.symbol.name == "orderedMap") {
+                s = options.lib + "::OrderedMap";
             } else if(type.symbol.name == "array") {
                 s = options.lib + "::Array";
+            } else if (isPromiseType(type)) {
+                s = options.lib + "::Promise";
             }
             
             s = s + "<" + vs.join(",") + ">";
             
-            if (name != "") {
+            if (name != "" && isPromiseType(type)) {
+                s += " " + name;
+            } else if (name != "") {
                 s += " &" + name;
             }
             return s;
@@ -306,160 +522,942 @@ export namespace CC {
         return "set" + name.substr(0, 1).toLocaleUpperCase() + name.substr(1);
     }
 
-    export interface Options {
-        lib: string
-        namespace?: string
-        outDir?: string
+    function isConstReferenceType(type: ts.Type | undefined, options: Options): boolean {
+        if (type !== undefined && (isFunctionType(type) || isObjectReferenceType(type))) {
+            return false;
+        }
+        let s = getType(type, options);
+        return s == options.lib + "::String" || s == options.lib + "::Any";
     }
 
-    export enum FileType {
-        Header, Source
+    function defineParameter(name: string, type: ts.Type | undefined, program: ts.Program, options: Options, sink: boolean = false): string {
+        if (!sink && isConstReferenceType(type, options)) {
+            return "const " + getType(type, options) + " &" + name;
+        }
+        if (!sink && type !== undefined && isClassTypeParameter(type)) {
+            return "typename " + options.lib + "::Param<" + getType(type, options) + ">::type " + name;
+        }
+        return define(name, type, program, options);
     }
 
-    interface NameSet {
-        [key: string]: boolean
+    function isAssignedParameter(param: ts.ParameterDeclaration, checker: ts.TypeChecker): boolean {
+
+        let body = (param.parent as ts.FunctionLikeDeclaration).body;
+        let symbol = checker.getSymbolAtLocation(param.name);
+        var assigned = false;
+
+        if (body === undefined || symbol === undefined) {
+            return false;
+        }
+
+        let visit = (node: ts.Node): void => {
+            if (ts.isIdentifier(node) && checker.getSymbolAtLocation(node) == symbol && isWriteTarget(node)) {
+                assigned = true;
+            }
+            if (!assigned) {
+                ts.forEachChild(node, visit);
+            }
+        };
+
+        visit(body);
+
+        return assigned;
     }
 
-    export class Compiler {
+    function sinkParameters(s: ts.SignatureDeclaration, checker: ts.TypeChecker, options: Options): Set<ts.Symbol> {
 
-        private _out: (text: string) => void;
-        private _options: Options;
-        private _level: number = 0;
-        private _isNewLine: boolean = true;
+        let vs = new Set<ts.Symbol>();
+        let body = (s as ts.FunctionLikeDeclaration).body;
 
-        public get isNewLine(): boolean {
-            return this._isNewLine
+        if (body === undefined || !ts.isBlock(body)) {
+            return vs;
         }
 
-        constructor(options: Options, out: (text: string) => void) {
-            this._options = options;
-            this._out = out;
-        }
+        for (let param of s.parameters) {
 
-        protected out(text: string): void {
-            this._out(text);
-            this._isNewLine = text.endsWith("\n");
-        }
+            let symbol = checker.getSymbolAtLocation(param.name);
+            let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
 
-        protected level(level: number = 0): void {
-            this.out("\t".repeat(Math.max(this._level + level, 0)));
-        }
+            if (symbol === undefined || !isConstReferenceType(type, options)) {
+                continue;
+            }
 
-        public include(name: string, isLibrary: boolean = false): void {
-            this.out("#include ");
-            if (isLibrary) {
-                this.out("<");
-            } else {
-                this.out('"');
+            let refs: ts.Identifier[] = [];
+
+            let visit = (node: ts.Node): void => {
+                if (ts.isIdentifier(node) && checker.getSymbolAtLocation(node) == symbol) {
+                    refs.push(node);
+                }
+                ts.forEachChild(node, visit);
+            };
+
+            visit(body);
+
+            if (refs.length != 1) {
+                continue;
             }
-            this.out(name);
-            if (isLibrary) {
-                this.out(">\n");
-            } else {
-                this.out('"\n');
+
+            let e = refs[0].parent;
+
+            if (e !== undefined && ts.isBinaryExpression(e) && e.right == refs[0]
+                && e.operatorToken.kind == ts.SyntaxKind.EqualsToken && isThisProperty(e.left)
+                && e.parent !== undefined && ts.isExpressionStatement(e.parent) && e.parent.parent == body) {
+                vs.add(symbol);
             }
         }
 
+        return vs;
+    }
 
-        public includeFile(file: ts.SourceFile, program: ts.Program): void {
+    function isAsync(node: ts.Node): boolean {
+        return (ts.getCombinedModifierFlags(node as ts.Declaration) & ts.ModifierFlags.Async) != 0;
+    }
 
-            let names: NameSet = {};
-            let ns: string | undefined = undefined;
-            let checker = program.getTypeChecker();
-            let v = this;
+    function isPromiseType(type: ts.Type | undefined): boolean {
+        if (type === undefined) {
+            return false;
+        }
+        if ((type.flags & ts.TypeFlags.Union) != 0) {
+            type = type.getNonNullableType();
+        }
+        return type.symbol !== undefined && type.symbol.name == "Promise" && (type as Type).typeArguments !== undefined
+            && type.symbol.declarations !== undefined && type.symbol.declarations.every((d) => d.getSourceFile().isDeclarationFile);
+    }
 
-            function heritageClauses(clauses: ts.NodeArray<ts.HeritageClause>): void {
+    function isVoidPromiseType(type: ts.Type | undefined): boolean {
+        return type !== undefined && isPromiseType(type)
+            && (((type.getNonNullableType() as Type).typeArguments![0].flags & ts.TypeFlags.Void) != 0);
+    }
 
-                for (let clause of clauses) {
+    function isAsyncScope(node: ts.Node): boolean {
+        var p: ts.Node | undefined = node.parent;
+        while (p !== undefined && !isFunctionScope(p)) {
+            p = p.parent;
+        }
+        return p !== undefined && isAsync(p);
+    }
 
-                    for (let type of clause.types) {
-                        var name = type.expression.getText();
-                        if (names[name] === undefined) {
-                            if (ns === undefined) {
-                                v.include(name + ".h", false);
-                            } else {
-                                v.include(ns + "/" + name + ".h", true);
-                            }
-                            names[name] = true;
-                        }
-                    }
+    function isFunctionScope(node: ts.Node): boolean {
+        return ts.isFunctionDeclaration(node) || ts.isFunctionExpression(node) || ts.isArrowFunction(node)
+            || ts.isMethodDeclaration(node) || ts.isConstructorDeclaration(node)
+            || ts.isGetAccessorDeclaration(node) || ts.isSetAccessorDeclaration(node);
+    }
 
+    function thisEscapes(node: ts.ClassDeclaration, checker: ts.TypeChecker): boolean {
 
-                }
+        if (node.getSourceFile().isDeclarationFile) {
+            return true;
+        }
 
-            }
+        if (node.members.some((m) => isAsync(m))) {
+            return true;
+        }
 
-            function each(node: ts.Node): void {
+        var escapes = false;
 
-                if (ts.isModuleDeclaration(node)) {
-                    let n = checker.getSymbolAtLocation(node.name)!;
-                    ns = n.name;
-                    if (node.body !== undefined) {
-                        ts.forEachChild(node.body, each);
-                    }
-                    ns = undefined;
-                } else if (ts.isInterfaceDeclaration(node)) {
-                    let n = checker.getSymbolAtLocation(node.name)!;
-                    names[n.name] = true;
-                    if (node.heritageClauses !== undefined) {
-                        heritageClauses(node.heritageClauses);
-                    }
-                } else if (ts.isClassDeclaration(node) && node.name !== undefined) {
-                    let n = checker.getSymbolAtLocation(node.name)!;
-                    names[n.name] = true;
-                    if (node.heritageClauses !== undefined) {
-                        heritageClauses(node.heritageClauses);
-                    }
+        let visit = (node: ts.Node, nested: boolean): void => {
+            if (escapes) {
+                return;
+            }
+            if (node.kind == ts.SyntaxKind.ThisKeyword) {
+                if (nested || node.parent === undefined || !ts.isPropertyAccessExpression(node.parent) || node.parent.expression != node) {
+                    escapes = true;
                 }
+                return;
+            }
+            if (ts.isClassDeclaration(node) || ts.isClassExpression(node)) {
+                return;
             }
+            let n = nested || isFunctionScope(node);
+            ts.forEachChild(node, (child: ts.Node): void => {
+                visit(child, n);
+            });
+        };
 
-            ts.forEachChild(file, each);
+        for (let m of node.members) {
+            ts.forEachChild(m, (child: ts.Node): void => {
+                visit(child, false);
+            });
         }
 
-        public namespaceStart(name: string): void {
-            this.level();
-            this.out("namespace ");
-            this.out(name);
-            this.out(" {\n\n");
-            this._level++;
+        if (escapes) {
+            return true;
         }
 
-        public namespaceEnd(): void {
-            this._level--;
-            this.level();
-            this.out("}\n\n");
+        for (let base of heritageDeclarations(node, checker, ts.SyntaxKind.ExtendsKeyword)) {
+            if (!ts.isClassDeclaration(base) || thisEscapes(base, checker)) {
+                return true;
+            }
         }
 
-        protected heritageClauses(clauses?: ts.NodeArray<ts.HeritageClause>, isClass = true): void {
+        return false;
+    }
 
-            if (clauses !== undefined) {
+    function isLocalObject(v: ts.VariableDeclaration, checker: ts.TypeChecker, options: Options): boolean {
 
-                var superClass: ts.HeritageClause | undefined;
+        if (v.type === undefined || v.initializer === undefined || !ts.isNewExpression(v.initializer) || !ts.isIdentifier(v.name)) {
+            return false;
+        }
 
-                for (let extend of clauses) {
+        let type = checker.getTypeAtLocation(v.initializer);
 
-                    if (extend.token == ts.SyntaxKind.ExtendsKeyword) {
-                        superClass = extend;
-                        break;
-                    }
+        if (getLibType(type, options) === undefined) {
 
-                }
+            if (type.symbol === undefined || type.symbol.declarations === undefined) {
+                return false;
+            }
 
-                var s = ":";
+            let decl = type.symbol.declarations.find((d) => ts.isClassDeclaration(d));
 
-                if (superClass !== undefined) {
-                    for (let type of superClass.types) {
-                        this.out(s);
-                        this.out("public ")
-                        this.out(type.expression.getText());
-                        s = ",";
-                    }
-                } else {
-                    this.out(s);
-                    this.out("public ")
-                    this.out(this._options.lib);
-                    if (isClass) {
-                        this.out("::Object");
+            if (decl === undefined || thisEscapes(decl as ts.ClassDeclaration, checker)) {
+                return false;
+            }
+        }
+
+        var scope: ts.Node | undefined = v.parent;
+
+        while (scope !== undefined && !isFunctionScope(scope)) {
+            scope = scope.parent;
+        }
+
+        if (scope === undefined) {
+            return false;
+        }
+
+        let symbol = checker.getSymbolAtLocation(v.name);
+        var escapes = false;
+
+        let visit = (node: ts.Node, depth: number): void => {
+            if (escapes || node == v.name) {
+                return;
+            }
+            if (ts.isIdentifier(node) && checker.getSymbolAtLocation(node) == symbol) {
+                if (depth > 0 || node.parent === undefined || !ts.isPropertyAccessExpression(node.parent) || node.parent.expression != node) {
+                    escapes = true;
+                }
+                return;
+            }
+            let d = isFunctionScope(node) ? depth + 1 : depth;
+            ts.forEachChild(node, (child: ts.Node): void => {
+                visit(child, d);
+            });
+        };
+
+        ts.forEachChild(scope, (child: ts.Node): void => {
+            visit(child, 0);
+        });
+
+        return !escapes;
+    }
+
+    function isLocalClosure(v: ts.VariableDeclaration, checker: ts.TypeChecker): boolean {
+
+        if (v.initializer === undefined || !ts.isArrowFunction(v.initializer) || !ts.isIdentifier(v.name)) {
+            return false;
+        }
+
+        var scope: ts.Node | undefined = v.parent;
+
+        while (scope !== undefined && !isFunctionScope(scope)) {
+            scope = scope.parent;
+        }
+
+        if (scope === undefined) {
+            return false;
+        }
+
+        let symbol = checker.getSymbolAtLocation(v.name);
+        var escapes = false;
+
+        let visit = (node: ts.Node, depth: number): void => {
+            if (escapes || node == v.name) {
+                return;
+            }
+            if (ts.isIdentifier(node) && checker.getSymbolAtLocation(node) == symbol) {
+                if (depth > 0 || node.parent === undefined || !ts.isCallExpression(node.parent) || node.parent.expression != node) {
+                    escapes = true;
+                }
+                return;
+            }
+            let d = isFunctionScope(node) ? depth + 1 : depth;
+            ts.forEachChild(node, (child: ts.Node): void => {
+                visit(child, d);
+            });
+        };
+
+        ts.forEachChild(scope, (child: ts.Node): void => {
+            visit(child, 0);
+        });
+
+        return !escapes;
+    }
+
+    function forwardDeclarations(s: ts.ImportDeclaration, checker: ts.TypeChecker): string[] | undefined {
+
+        let clause = s.importClause;
+
+        if (clause === undefined || clause.name !== undefined || clause.namedBindings === undefined
+            || !ts.isNamedImports(clause.namedBindings)) {
+            return undefined;
+        }
+
+        let aliases = new Set<ts.Symbol>();
+        let vs: string[] = [];
+
+        for (let element of clause.namedBindings.elements) {
+
+            let alias = checker.getSymbolAtLocation(element.name);
+
+            if (alias === undefined) {
+                return undefined;
+            }
+
+            let symbol = checker.getAliasedSymbol(alias);
+
+            if ((symbol.flags & (ts.SymbolFlags.Class | ts.SymbolFlags.Interface)) == 0
+                || (symbol.flags & (ts.SymbolFlags.Enum | ts.SymbolFlags.Function | ts.SymbolFlags.Variable | ts.SymbolFlags.ValueModule)) != 0
+                || symbol.declarations === undefined
+                || symbol.declarations.some((d) => !ts.isSourceFile(d.parent) || isGenericDeclaration(d))) {
+                return undefined;
+            }
+
+            aliases.add(alias);
+            vs.push(element.name.text);
+        }
+
+        var complete = false;
+
+        let visit = (node: ts.Node): void => {
+            if (complete || ts.isImportDeclaration(node)) {
+                return;
+            }
+            if (ts.isIdentifier(node) && aliases.has(checker.getSymbolAtLocation(node)!)) {
+                var p: ts.Node | undefined = node.parent;
+                var body = false;
+                while (p !== undefined && !ts.isSourceFile(p)) {
+                    if (isGenericDeclaration(p) || (!body && (ts.isHeritageClause(p) || ts.isPropertyDeclaration(p)))) {
+                        complete = true;
+                        return;
+                    }
+                    if (isFunctionScope(p) && (p as ts.FunctionLikeDeclaration).body !== undefined
+                        && node.pos >= (p as ts.FunctionLikeDeclaration).body!.pos) {
+                        body = true;
+                    }
+                    p = p.parent;
+                }
+                return;
+            }
+            ts.forEachChild(node, visit);
+        };
+
+        ts.forEachChild(s.getSourceFile(), visit);
+
+        return complete ? undefined : vs;
+    }
+
+    enum NumericWidth {
+        Int32, Int64, Number
+    }
+
+    const NumericTypes = ["::Int32", "::Int64", "::Number"];
+
+    function literalWidth(v: number): NumericWidth {
+        if (!Number.isInteger(v)) {
+            return NumericWidth.Number;
+        }
+        if (v >= -2147483648 && v <= 2147483647) {
+            return NumericWidth.Int32;
+        }
+        if (Number.isSafeInteger(v)) {
+            return NumericWidth.Int64;
+        }
+        return NumericWidth.Number;
+    }
+
+    function typeNodeWidth(node: ts.TypeNode): NumericWidth {
+        let n = node.getText().split(".");
+        switch (n[n.length - 1]) {
+            case "int":
+            case "int32":
+                return NumericWidth.Int32;
+            case "uint":
+            case "uint32":
+            case "int64":
+            case "uint64":
+                return NumericWidth.Int64;
+        }
+        return NumericWidth.Number;
+    }
+
+    function binaryWidth(op: ts.SyntaxKind, l: NumericWidth, r: NumericWidth): NumericWidth {
+        switch (op) {
+            case ts.SyntaxKind.PlusToken:
+            case ts.SyntaxKind.MinusToken:
+                return l == NumericWidth.Int32 && r == NumericWidth.Int32 ? NumericWidth.Int64 : Math.max(l, r);
+            case ts.SyntaxKind.PlusEqualsToken:
+            case ts.SyntaxKind.MinusEqualsToken:
+                return Math.max(l, r);
+            case ts.SyntaxKind.AsteriskToken:
+            case ts.SyntaxKind.AsteriskEqualsToken:
+                return l == NumericWidth.Int32 && r == NumericWidth.Int32 ? NumericWidth.Int64 : NumericWidth.Number;
+            case ts.SyntaxKind.PercentToken:
+            case ts.SyntaxKind.PercentEqualsToken:
+                return r == NumericWidth.Number ? NumericWidth.Number : l;
+            case ts.SyntaxKind.AmpersandToken:
+            case ts.SyntaxKind.AmpersandEqualsToken:
+            case ts.SyntaxKind.BarToken:
+            case ts.SyntaxKind.BarEqualsToken:
+            case ts.SyntaxKind.CaretToken:
+            case ts.SyntaxKind.CaretEqualsToken:
+            case ts.SyntaxKind.LessThanLessThanToken:
+            case ts.SyntaxKind.LessThanLessThanEqualsToken:
+            case ts.SyntaxKind.GreaterThanGreaterThanToken:
+            case ts.SyntaxKind.GreaterThanGreaterThanEqualsToken:
+                return NumericWidth.Int32;
+            case ts.SyntaxKind.GreaterThanGreaterThanGreaterThanToken:
+            case ts.SyntaxKind.GreaterThanGreaterThanGreaterThanEqualsToken:
+                return NumericWidth.Int64;
+            case ts.SyntaxKind.EqualsToken:
+            case ts.SyntaxKind.CommaToken:
+                return r;
+        }
+        return NumericWidth.Number;
+    }
+
+    function isAssignmentOperator(op: ts.SyntaxKind): boolean {
+        return op >= ts.SyntaxKind.FirstAssignment && op <= ts.SyntaxKind.LastAssignment;
+    }
+
+    function isWriteTarget(e: ts.Expression): boolean {
+        var p = e.parent;
+        while (ts.isParenthesizedExpression(p)) {
+            e = p;
+            p = p.parent;
+        }
+        if (ts.isBinaryExpression(p)) {
+            return p.left == e && isAssignmentOperator(p.operatorToken.kind);
+        }
+        if (ts.isPrefixUnaryExpression(p) || ts.isPostfixUnaryExpression(p)) {
+            return p.operator == ts.SyntaxKind.PlusPlusToken || p.operator == ts.SyntaxKind.MinusMinusToken;
+        }
+        return false;
+    }
+
+    function isContainerType(type: ts.Type): boolean {
+        if (!isObjectReferenceType(type)) {
+            return false;
+        }
+        let name = type.getNonNullableType().symbol.name;
+        return name == "map" || name == "orderedMap" || name == "array";
+    }
+
+    function assignedSymbol(e: ts.Expression, checker: ts.TypeChecker): ts.Symbol | undefined {
+        if (ts.isParenthesizedExpression(e)) {
+            return assignedSymbol(e.expression, checker);
+        }
+        if (ts.isIdentifier(e)) {
+            return checker.getSymbolAtLocation(e);
+        }
+        if (ts.isPropertyAccessExpression(e)) {
+            return checker.getSymbolAtLocation(e.name);
+        }
+        return undefined;
+    }
+
+    function referencesSymbol(node: ts.Node, symbol: ts.Symbol, checker: ts.TypeChecker): boolean {
+        if (ts.isIdentifier(node) && checker.getSymbolAtLocation(node) == symbol) {
+            return true;
+        }
+        return ts.forEachChild(node, (v: ts.Node): boolean | undefined => referencesSymbol(v, symbol, checker) || undefined) === true;
+    }
+
+    function isAccumulation(e: ts.Expression, symbol: ts.Symbol, checker: ts.TypeChecker): boolean {
+        if (ts.isPrefixUnaryExpression(e) || ts.isPostfixUnaryExpression(e)) {
+            return true;
+        }
+        if (ts.isBinaryExpression(e)) {
+            switch (e.operatorToken.kind) {
+                case ts.SyntaxKind.PlusEqualsToken:
+                case ts.SyntaxKind.MinusEqualsToken:
+                    return true;
+                case ts.SyntaxKind.EqualsToken:
+                    return referencesSymbol(e.right, symbol, checker);
+            }
+        }
+        return false;
+    }
+
+    function isStepExpression(e: ts.Expression): boolean {
+        if (ts.isPrefixUnaryExpression(e) || ts.isPostfixUnaryExpression(e)) {
+            return true;
+        }
+        return ts.isBinaryExpression(e) && ts.isNumericLiteral(e.right)
+            && (e.operatorToken.kind == ts.SyntaxKind.PlusEqualsToken || e.operatorToken.kind == ts.SyntaxKind.MinusEqualsToken);
+    }
+
+    function isNumericCandidate(node: ts.VariableDeclaration | ts.PropertyDeclaration, checker: ts.TypeChecker): boolean {
+        if (node.type !== undefined) {
+            return node.type.kind == ts.SyntaxKind.NumberKeyword;
+        }
+        return (checker.getTypeAtLocation(node.name).flags & (ts.TypeFlags.Number | ts.TypeFlags.NumberLiteral)) != 0;
+    }
+
+    function isConstDeclaration(node: ts.Node): node is ts.VariableDeclaration {
+        return ts.isVariableDeclaration(node) && ts.isVariableDeclarationList(node.parent)
+            && (node.parent.flags & ts.NodeFlags.Const) != 0;
+    }
+
+    function isReadonlyMember(node: ts.Node): boolean {
+        if (node.modifiers !== undefined) {
+            for (let element of node.modifiers) {
+                if (element.kind == ts.SyntaxKind.ReadonlyKeyword) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    function isConstantExpression(e: ts.Expression, checker: ts.TypeChecker, depth: number = 0): boolean {
+
+        if (depth > 16) {
+            return false;
+        }
+
+        if (ts.isNumericLiteral(e) || e.kind == ts.SyntaxKind.TrueKeyword || e.kind == ts.SyntaxKind.FalseKeyword) {
+            return true;
+        } else if (ts.isParenthesizedExpression(e)) {
+            return isConstantExpression(e.expression, checker, depth + 1);
+        } else if (ts.isPrefixUnaryExpression(e)) {
+            return e.operator != ts.SyntaxKind.PlusPlusToken && e.operator != ts.SyntaxKind.MinusMinusToken
+                && isConstantExpression(e.operand, checker, depth + 1);
+        } else if (ts.isBinaryExpression(e)) {
+            return !isAssignmentOperator(e.operatorToken.kind)
+                && (checker.getTypeAtLocation(e).flags & ts.TypeFlags.StringLike) == 0
+                && isConstantExpression(e.left, checker, depth + 1) && isConstantExpression(e.right, checker, depth + 1);
+        } else if (ts.isIdentifier(e) || ts.isPropertyAccessExpression(e)) {
+            let symbol = assignedSymbol(e, checker);
+            let decl = symbol === undefined ? undefined : symbol.valueDeclaration;
+            if (decl === undefined) {
+                return false;
+            }
+            if (ts.isEnumMember(decl)) {
+                return true;
+            }
+            if ((isConstDeclaration(decl) || (ts.isPropertyDeclaration(decl) && isStaticMember(decl) && isReadonlyMember(decl)))
+                && decl.initializer !== undefined) {
+                return isConstantExpression(decl.initializer, checker, depth + 1);
+            }
+        }
+
+        return false;
+    }
+
+    function isConstantType(type: ts.Type): boolean {
+        if ((type.flags & (ts.TypeFlags.Boolean | ts.TypeFlags.EnumLike)) != 0) {
+            return true;
+        }
+        return (type.flags & ts.TypeFlags.Union) == 0
+            && (type.flags & (ts.TypeFlags.NumberLike | ts.TypeFlags.BooleanLike | ts.TypeFlags.StringLike)) != 0;
+    }
+
+    function isStaticAccess(symbol: ts.Symbol): boolean {
+        if ((symbol.flags & ts.SymbolFlags.EnumMember) != 0) {
+            return true;
+        }
+        let decl = symbol.valueDeclaration;
+        return decl !== undefined && (ts.isPropertyDeclaration(decl) || ts.isMethodDeclaration(decl)) && isStaticMember(decl);
+    }
+
+    function numericUnit(node: ts.Node): ts.Node | undefined {
+        var unit: ts.Node | undefined;
+        var p: ts.Node | undefined = node.parent;
+        while (p !== undefined && !ts.isSourceFile(p)) {
+            if (ts.isClassDeclaration(p) || isFunctionScope(p)) {
+                unit = p;
+            }
+            p = p.parent;
+        }
+        return unit;
+    }
+
+    type HeritageDeclaration = ts.ClassDeclaration | ts.InterfaceDeclaration;
+
+    interface ClassHierarchy {
+        subclassed: Set<ts.Symbol>;
+        overridden: Map<ts.Symbol, Set<string>>;
+    }
+
+    const classHierarchys = new WeakMap<ts.Program, ClassHierarchy>();
+
+    function memberName(m: ts.ClassElement | ts.TypeElement): string | undefined {
+        if (m.name !== undefined && (ts.isIdentifier(m.name) || ts.isStringLiteral(m.name))) {
+            return m.name.text;
+        }
+        return undefined;
+    }
+
+    function isStaticMember(m: ts.Node): boolean {
+        if (m.modifiers !== undefined) {
+            for (let element of m.modifiers) {
+                if (element.kind == ts.SyntaxKind.StaticKeyword) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    function heritageDeclarations(node: HeritageDeclaration, checker: ts.TypeChecker, token?: ts.SyntaxKind): HeritageDeclaration[] {
+
+        let vs: HeritageDeclaration[] = [];
+
+        if (node.heritageClauses !== undefined) {
+            for (let clause of node.heritageClauses) {
+                if (token !== undefined && clause.token != token) {
+                    continue;
+                }
+                for (let type of clause.types) {
+                    let symbol = checker.getSymbolAtLocation(type.expression);
+                    if (symbol !== undefined && (symbol.flags & ts.SymbolFlags.Alias) != 0) {
+                        symbol = checker.getAliasedSymbol(symbol);
+                    }
+                    if (symbol === undefined || symbol.declarations === undefined) {
+                        continue;
+                    }
+                    for (let d of symbol.declarations) {
+                        if (ts.isClassDeclaration(d) || ts.isInterfaceDeclaration(d)) {
+                            vs.push(d);
+                        }
+                    }
+                }
+            }
+        }
+
+        return vs;
+    }
+
+    function inheritedMembers(node: HeritageDeclaration, checker: ts.TypeChecker, vs: Set<string> = new Set<string>()): Set<string> {
+
+        for (let d of heritageDeclarations(node, checker)) {
+            for (let m of (d.members as ts.NodeArray<ts.ClassElement | ts.TypeElement>)) {
+                let name = memberName(m);
+                if (name !== undefined && !isStaticMember(m)) {
+                    vs.add(name);
+                }
+            }
+            inheritedMembers(d, checker, vs);
+        }
+
+        return vs;
+    }
+
+    function getClassHierarchy(program: ts.Program): ClassHierarchy {
+
+        let v = classHierarchys.get(program);
+
+        if (v !== undefined) {
+            return v;
+        }
+
+        let checker = program.getTypeChecker();
+        let h: ClassHierarchy = { subclassed: new Set<ts.Symbol>(), overridden: new Map<ts.Symbol, Set<string>>() };
+
+        let visit = (node: ts.Node): void => {
+
+            if (ts.isClassDeclaration(node)) {
+
+                let names: string[] = [];
+
+                for (let m of node.members) {
+                    let name = memberName(m);
+                    if (name !== undefined && !isStaticMember(m)) {
+                        names.push(name);
+                    }
+                }
+
+                let bases = heritageDeclarations(node, checker, ts.SyntaxKind.ExtendsKeyword);
+
+                while (bases.length > 0) {
+
+                    let base = bases.pop()!;
+
+                    if (!ts.isClassDeclaration(base) || base.name === undefined) {
+                        continue;
+                    }
+
+                    let symbol = checker.getSymbolAtLocation(base.name)!;
+                    let overridden = h.overridden.get(symbol);
+
+                    if (overridden === undefined) {
+                        overridden = new Set<string>();
+                        h.overridden.set(symbol, overridden);
+                    }
+
+                    for (let name of names) {
+                        overridden.add(name);
+                    }
+
+                    h.subclassed.add(symbol);
+
+                    for (let d of heritageDeclarations(base, checker, ts.SyntaxKind.ExtendsKeyword)) {
+                        bases.push(d);
+                    }
+                }
+            }
+
+            ts.forEachChild(node, visit);
+        };
+
+        for (let file of program.getSourceFiles()) {
+            if (!file.isDeclarationFile) {
+                visit(file);
+            }
+        }
+
+        classHierarchys.set(program, h);
+
+        return h;
+    }
+
+    export function hierarchySignature(program: ts.Program): string {
+
+        let checker = program.getTypeChecker();
+        let vs: string[] = [];
+
+        getClassHierarchy(program).overridden.forEach((names: Set<string>, symbol: ts.Symbol): void => {
+            vs.push(checker.getFullyQualifiedName(symbol) + ":" + Array.from(names).sort().join(","));
+        });
+
+        return vs.sort().join(";");
+    }
+
+    function fieldName(p: ts.ClassDeclaration, name: string): string | undefined {
+        for (let m of p.members) {
+            if (ts.isPropertyDeclaration(m) && !isStaticMember(m) && memberName(m) == name) {
+                return isPublicProperty(m) ? "_" + name : name;
+            }
+        }
+        return undefined;
+    }
+
+    function isThisProperty(e: ts.Expression): e is ts.PropertyAccessExpression {
+        return ts.isPropertyAccessExpression(e) && e.expression.kind == ts.SyntaxKind.ThisKeyword;
+    }
+
+    function inlineGetter(s: ts.PropertyDeclaration | ts.GetAccessorDeclaration): string | undefined {
+
+        let p = s.parent as ts.ClassDeclaration;
+
+        if (ts.isPropertyDeclaration(s)) {
+            return fieldName(p, memberName(s)!);
+        }
+
+        if (s.body !== undefined && s.body.statements.length == 1) {
+            let st = s.body.statements[0];
+            if (ts.isReturnStatement(st) && st.expression !== undefined && isThisProperty(st.expression)) {
+                return fieldName(p, st.expression.name.text);
+            }
+        }
+
+        return undefined;
+    }
+
+    function inlineSetter(s: ts.PropertyDeclaration | ts.SetAccessorDeclaration): string | undefined {
+
+        let p = s.parent as ts.ClassDeclaration;
+
+        if (ts.isPropertyDeclaration(s)) {
+            return fieldName(p, memberName(s)!);
+        }
+
+        if (s.body !== undefined && s.body.statements.length == 1 && s.parameters.length == 1) {
+            let st = s.body.statements[0];
+            let param = s.parameters[0].name;
+            if (ts.isExpressionStatement(st) && ts.isBinaryExpression(st.expression)
+                && st.expression.operatorToken.kind == ts.SyntaxKind.EqualsToken
+                && isThisProperty(st.expression.left)
+                && ts.isIdentifier(st.expression.right) && ts.isIdentifier(param)
+                && st.expression.right.text == param.text) {
+                return fieldName(p, st.expression.left.name.text);
+            }
+        }
+
+        return undefined;
+    }
+
+    export interface Options {
+        lib: string
+        namespace?: string
+        outDir?: string
+        unity?: number
+        pch?: boolean
+    }
+
+    export enum FileType {
+        Header, Source
+    }
+
+    interface NameSet {
+        [key: string]: boolean
+    }
+
+    export class Compiler {
+
+        private _out: (text: string) => void;
+        private _options: Options;
+        private _level: number = 0;
+        private _sinks: Set<ts.Symbol> = new Set<ts.Symbol>();
+        private _numerics: Map<ts.Symbol, NumericWidth> = new Map<ts.Symbol, NumericWidth>();
+        private _numericUnits: Set<ts.Node> = new Set<ts.Node>();
+        private _prefix: string = "";
+        private _isNewLine: boolean = true;
+
+        public get isNewLine(): boolean {
+            return this._isNewLine
+        }
+
+        constructor(options: Options, out: (text: string) => void) {
+            this._options = options;
+            this._out = out;
+        }
+
+        protected out(text: string): void {
+            this._out(text);
+            this._isNewLine = text.endsWith("\n");
+        }
+
+        protected level(level: number = 0): void {
+            this.out("\t".repeat(Math.max(this._level + level, 0)));
+        }
+
+        public include(name: string, isLibrary: boolean = false): void {
+            this.out("#include ");
+            if (isLibrary) {
+                this.out("<");
+            } else {
+                this.out('"');
+            }
+            this.out(name);
+            if (isLibrary) {
+                this.out(">\n");
+            } else {
+                this.out('"\n');
+            }
+        }
+
+
+        public includeFile(file: ts.SourceFile, program: ts.Program): void {
+
+            let names: NameSet = {};
+            let ns: string | undefined = undefined;
+            let checker = program.getTypeChecker();
+            let v = this;
+
+            function heritageClauses(clauses: ts.NodeArray<ts.HeritageClause>): void {
+
+                for (let clause of clauses) {
+
+                    for (let type of clause.types) {
+                        var name = type.expression.getText();
+                        if (names[name] === undefined) {
+                            if (ns === undefined) {
+                                v.include(name + ".h", false);
+                            } else {
+                                v.include(ns + "/" + name + ".h", true);
+                            }
+                            names[name] = true;
+                        }
+                    }
+
+
+                }
+
+            }
+
+            function each(node: ts.Node): void {
+
+                if (ts.isModuleDeclaration(node)) {
+                    let n = checker.getSymbolAtLocation(node.name)!;
+                    ns = n.name;
+                    if (node.body !== undefined) {
+                        ts.forEachChild(node.body, each);
+                    }
+                    ns = undefined;
+                } else if (ts.isInterfaceDeclaration(node)) {
+                    let n = checker.getSymbolAtLocation(node.name)!;
+                    names[n.name] = true;
+                    if (node.heritageClauses !== undefined) {
+                        heritageClauses(node.heritageClauses);
+                    }
+                } else if (ts.isClassDeclaration(node) && node.name !== undefined) {
+                    let n = checker.getSymbolAtLocation(node.name)!;
+                    names[n.name] = true;
+                    if (node.heritageClauses !== undefined) {
+                        heritageClauses(node.heritageClauses);
+                    }
+                }
+            }
+
+            ts.forEachChild(file, each);
+        }
+
+        public namespaceStart(name: string): void {
+            this.level();
+            this.out("namespace ");
+            this.out(name);
+            this.out(" {\n\n");
+            this._level++;
+        }
+
+        public namespaceEnd(): void {
+            this._level--;
+            this.level();
+            this.out("}\n\n");
+        }
+
+        protected heritageType(type: ts.ExpressionWithTypeArguments, program: ts.Program): void {
+
+            let checker = program.getTypeChecker();
+
+            this.out(type.expression.getText());
+
+            if (type.typeArguments !== undefined && type.typeArguments.length > 0) {
+                let vs = type.typeArguments.map((v) => define("", getTypeAtLocation(v, checker), program, this._options));
+                this.out("<" + vs.join(",") + ">");
+            }
+        }
+
+        protected heritageClauses(clauses: ts.NodeArray<ts.HeritageClause> | undefined, program: ts.Program, isClass = true): void {
+
+            if (clauses !== undefined) {
+
+                var superClass: ts.HeritageClause | undefined;
+
+                for (let extend of clauses) {
+
+                    if (extend.token == ts.SyntaxKind.ExtendsKeyword) {
+                        superClass = extend;
+                        break;
+                    }
+
+                }
+
+                var s = ":";
+
+                if (superClass !== undefined) {
+                    for (let type of superClass.types) {
+                        this.out(s);
+                        this.out("public ")
+                        this.heritageType(type, program);
+                        s = ",";
+                    }
+                } else {
+                    this.out(s);
+                    this.out("public ")
+                    this.out(this._options.lib);
+                    if (isClass) {
+                        this.out("::Object");
                     }
                     s = ",";
                 }
@@ -473,7 +1471,7 @@ export namespace CC {
                     for (let type of extend.types) {
                         this.out(s);
                         this.out("public ")
-                        this.out(type.expression.getText());
+                        this.heritageType(type, program);
                         s = ",";
                     }
 
@@ -488,23 +1486,427 @@ export namespace CC {
 
         }
 
-        public classStart(node: ts.ClassDeclaration, program: ts.Program): void {
-
+        public classStart(node: ts.ClassDeclaration, program: ts.Program): void {
+
+            let checker = program.getTypeChecker();
+
+            if (node.name !== undefined) {
+
+                let name = checker.getSymbolAtLocation(node.name)!;
+
+                this.templateParameters(node, program);
+                this.level();
+                this.out("class ");
+                this.out(name.name);
+                if (!getClassHierarchy(program).subclassed.has(name)) {
+                    this.out(" final");
+                }
+                this.heritageClauses(node.heritageClauses, program, true);
+                this.out(" {\n");
+                this._level++;
+                console.info("[class]", name.name, ">>");
+
+            }
+        }
+
+        public numericWidth(e: ts.Expression, program: ts.Program): NumericWidth {
+
+            let checker = program.getTypeChecker();
+
+            if (ts.isParenthesizedExpression(e)) {
+                return this.numericWidth(e.expression, program);
+            } else if (ts.isNumericLiteral(e)) {
+                return literalWidth(Number(e.text));
+            } else if (ts.isPrefixUnaryExpression(e)) {
+                if (e.operator == ts.SyntaxKind.TildeToken) {
+                    return NumericWidth.Int32;
+                } else if (e.operator == ts.SyntaxKind.ExclamationToken) {
+                    return NumericWidth.Number;
+                }
+                return this.numericWidth(e.operand, program);
+            } else if (ts.isPostfixUnaryExpression(e)) {
+                return this.numericWidth(e.operand, program);
+            } else if (ts.isConditionalExpression(e)) {
+                return Math.max(this.numericWidth(e.whenTrue, program), this.numericWidth(e.whenFalse, program));
+            } else if (ts.isBinaryExpression(e)) {
+                return binaryWidth(e.operatorToken.kind, this.numericWidth(e.left, program), this.numericWidth(e.right, program));
+            } else if (ts.isAsExpression(e) || ts.isTypeAssertion(e)) {
+                return typeNodeWidth(e.type);
+            } else if (ts.isCallExpression(e)) {
+                let sign = checker.getResolvedSignature(e);
+                let decl = sign === undefined ? undefined : sign.declaration as (ts.SignatureDeclaration | undefined);
+                if (decl !== undefined && decl.type !== undefined) {
+                    return typeNodeWidth(decl.type);
+                }
+            } else if (ts.isElementAccessExpression(e)) {
+                if (getLibType(checker.getTypeAtLocation(e.expression), this._options) == this._options.lib + "::Int32Array") {
+                    return NumericWidth.Int32;
+                }
+            } else if (ts.isIdentifier(e) || ts.isPropertyAccessExpression(e)) {
+
+                let symbol = assignedSymbol(e, checker);
+
+                if (symbol === undefined) {
+                    return NumericWidth.Number;
+                }
+
+                let w = this.symbolWidth(symbol, program);
+
+                if (w !== undefined) {
+                    return w;
+                }
+
+                if (ts.isPropertyAccessExpression(e) && e.name.text == "length"
+                    && (checker.getTypeAtLocation(e).flags & ts.TypeFlags.Number) != 0) {
+                    return NumericWidth.Int32;
+                }
+
+                let decl = symbol.valueDeclaration as (ts.Declaration & { type?: ts.TypeNode }) | undefined;
+
+                if (decl === undefined && symbol.declarations !== undefined) {
+                    decl = symbol.declarations[0];
+                }
+
+                if (decl !== undefined && decl.type !== undefined) {
+                    return typeNodeWidth(decl.type);
+                }
+
+                if (decl !== undefined && (isConstDeclaration(decl) || (ts.isPropertyDeclaration(decl) && isStaticMember(decl) && isReadonlyMember(decl)))
+                    && decl.initializer !== undefined && isConstantExpression(decl.initializer, checker)) {
+                    return this.numericWidth(decl.initializer, program);
+                }
+            }
+
+            return NumericWidth.Number;
+        }
+
+        public symbolWidth(symbol: ts.Symbol, program: ts.Program): NumericWidth | undefined {
+
+            let decl = symbol.valueDeclaration;
+
+            if (decl !== undefined && !this._numerics.has(symbol)) {
+                let unit = numericUnit(decl);
+                if (unit !== undefined && !this._numericUnits.has(unit)) {
+                    this.solveNumerics(unit, program);
+                }
+            }
+
+            return this._numerics.get(symbol);
+        }
+
+        protected solveNumerics(unit: ts.Node, program: ts.Program): void {
+
+            let checker = program.getTypeChecker();
+            let assigns = new Map<ts.Symbol, ts.Expression[]>();
+
+            this._numericUnits.add(unit);
+
+            let candidates = (node: ts.Node): void => {
+                if (ts.isVariableDeclaration(node) && ts.isIdentifier(node.name)
+                    && (ts.isVariableStatement(node.parent.parent) || ts.isForStatement(node.parent.parent))
+                    && isNumericCandidate(node, checker)) {
+                    assigns.set(checker.getSymbolAtLocation(node.name)!, []);
+                } else if (ts.isPropertyDeclaration(node) && ts.isIdentifier(node.name)
+                    && !isPublicProperty(node) && !isStaticMember(node) && isNumericCandidate(node, checker)) {
+                    assigns.set(checker.getSymbolAtLocation(node.name)!, []);
+                }
+                ts.forEachChild(node, candidates);
+            };
+
+            let assignments = (node: ts.Node): void => {
+                var symbol: ts.Symbol | undefined;
+                var e: ts.Expression | undefined;
+                if ((ts.isVariableDeclaration(node) || ts.isPropertyDeclaration(node)) && node.initializer !== undefined) {
+                    symbol = checker.getSymbolAtLocation(node.name);
+                    e = node.initializer;
+                } else if (ts.isBinaryExpression(node) && isAssignmentOperator(node.operatorToken.kind)) {
+                    symbol = assignedSymbol(node.left, checker);
+                    e = node;
+                } else if ((ts.isPrefixUnaryExpression(node) || ts.isPostfixUnaryExpression(node))
+                    && (node.operator == ts.SyntaxKind.PlusPlusToken || node.operator == ts.SyntaxKind.MinusMinusToken)) {
+                    symbol = assignedSymbol(node.operand, checker);
+                    e = node;
+                }
+                if (symbol !== undefined && e !== undefined) {
+                    let vs = assigns.get(symbol);
+                    if (vs !== undefined) {
+                        vs.push(e);
+                    }
+                }
+                ts.forEachChild(node, assignments);
+            };
+
+            candidates(unit);
+            assignments(unit);
+
+            assigns.forEach((vs: ts.Expression[], symbol: ts.Symbol): void => {
+                let decl = symbol.valueDeclaration;
+                if (decl !== undefined && ts.isVariableDeclaration(decl) && ts.isForStatement(decl.parent.parent)) {
+                    for (let v of (decl.parent as ts.VariableDeclarationList).declarations) {
+                        if (v != decl && ts.isIdentifier(v.name)) {
+                            vs.push(v.name);
+                        }
+                    }
+                }
+            });
+
+            assigns.forEach((vs: ts.Expression[], symbol: ts.Symbol): void => {
+                this._numerics.set(symbol, vs.length == 0 ? NumericWidth.Number : NumericWidth.Int32);
+            });
+
+            var changed = true;
+
+            while (changed) {
+                changed = false;
+                assigns.forEach((vs: ts.Expression[], symbol: ts.Symbol): void => {
+                    var w = this._numerics.get(symbol)!;
+                    let bounded = this.isBoundedIndex(symbol, vs, program);
+                    for (let e of vs) {
+                        w = Math.max(w, this.numericWidth(e, program));
+                        if (!bounded && isAccumulation(e, symbol, checker)) {
+                            w = Math.max(w, NumericWidth.Int64);
+                        }
+                    }
+                    if (w != this._numerics.get(symbol)) {
+                        this._numerics.set(symbol, w);
+                        changed = true;
+                    }
+                });
+            }
+        }
+
+        public operandWidth(e: ts.BinaryExpression, program: ts.Program): NumericWidth | undefined {
+
+            let l = this.numericWidth(e.left, program);
+            let r = this.numericWidth(e.right, program);
+
+            switch (e.operatorToken.kind) {
+                case ts.SyntaxKind.SlashToken:
+                    return l != NumericWidth.Number && r != NumericWidth.Number ? NumericWidth.Number : undefined;
+                case ts.SyntaxKind.PlusToken:
+                case ts.SyntaxKind.MinusToken:
+                case ts.SyntaxKind.AsteriskToken:
+                    let w = binaryWidth(e.operatorToken.kind, l, r);
+                    return w > Math.max(l, r) ? w : undefined;
+            }
+
+            return undefined;
+        }
+
+        public isBoundedIndex(symbol: ts.Symbol, vs: ts.Expression[], program: ts.Program): boolean {
+
+            let checker = program.getTypeChecker();
+            let decl = symbol.valueDeclaration;
+
+            if (decl === undefined || !ts.isVariableDeclaration(decl) || !ts.isForStatement(decl.parent.parent)) {
+                return false;
+            }
+
+            let loop = decl.parent.parent as ts.ForStatement;
+            let cond = loop.condition;
+
+            if (cond === undefined || !ts.isBinaryExpression(cond)) {
+                return false;
+            }
+
+            switch (cond.operatorToken.kind) {
+                case ts.SyntaxKind.LessThanToken:
+                case ts.SyntaxKind.LessThanEqualsToken:
+                case ts.SyntaxKind.GreaterThanToken:
+                case ts.SyntaxKind.GreaterThanEqualsToken:
+                case ts.SyntaxKind.ExclamationEqualsToken:
+                case ts.SyntaxKind.ExclamationEqualsEqualsToken:
+                    break;
+                default:
+                    return false;
+            }
+
+            var bound: ts.Expression;
+
+            if (assignedSymbol(cond.left, checker) == symbol) {
+                bound = cond.right;
+            } else if (assignedSymbol(cond.right, checker) == symbol) {
+                bound = cond.left;
+            } else {
+                return false;
+            }
+
+            if (referencesSymbol(bound, symbol, checker) || this.numericWidth(bound, program) != NumericWidth.Int32) {
+                return false;
+            }
+
+            return vs.every((e: ts.Expression): boolean => !isAccumulation(e, symbol, checker) || isStepExpression(e));
+        }
+
+        public staticKind(s: ts.PropertyDeclaration, program: ts.Program): string | undefined {
+
+            let checker = program.getTypeChecker();
+            let readonly = isReadonlyMember(s);
+            let e = s.initializer;
+
+            if (e === undefined || !readonly || !isConstantType(checker.getTypeAtLocation(s.name))) {
+                return isStaticMember(s) ? (readonly ? "const" : "static") : undefined;
+            }
+
+            let constant = isConstantExpression(e, checker);
+
+            if (isStaticMember(s)) {
+                return constant ? "constexpr" : "const";
+            }
+
+            if (!constant && !ts.isStringLiteral(e)) {
+                return undefined;
+            }
+
+            let symbol = checker.getSymbolAtLocation(s.name);
+            var assigned = false;
+
+            let visit = (node: ts.Node): void => {
+                if (ts.isBinaryExpression(node) && isAssignmentOperator(node.operatorToken.kind)
+                    && assignedSymbol(node.left, checker) == symbol) {
+                    assigned = true;
+                }
+                ts.forEachChild(node, visit);
+            };
+
+            visit(s.parent);
+
+            if (assigned) {
+                return undefined;
+            }
+
+            return constant ? "constexpr" : "const";
+        }
+
+        public defineConstant(name: string, s: ts.PropertyDeclaration | ts.VariableDeclaration, program: ts.Program): string {
+
+            let checker = program.getTypeChecker();
+            let symbol = checker.getSymbolAtLocation(s.name)!;
+
+            if (s.type !== undefined) {
+                return this.defineSymbol(name, symbol, getTypeAtLocation(s.type, checker), program);
+            }
+
+            let type = checker.getTypeAtLocation(s.name);
+            let w = this.symbolWidth(symbol, program);
+
+            if (w === undefined && s.initializer !== undefined && (type.flags & ts.TypeFlags.EnumLike) == 0
+                && (type.flags & ts.TypeFlags.NumberLike) != 0) {
+                w = this.numericWidth(s.initializer, program);
+            }
+
+            if (w !== undefined) {
+                return this._options.lib + NumericTypes[w] + " " + name;
+            } else if ((type.flags & ts.TypeFlags.StringLike) != 0) {
+                return this._options.lib + "::String " + name;
+            } else if ((type.flags & ts.TypeFlags.BooleanLike) != 0) {
+                return this._options.lib + "::Boolean " + name;
+            } else if ((type.flags & ts.TypeFlags.EnumLike) != 0) {
+                return getType(type, this._options) + " " + name;
+            }
+
+            return define(name, undefined, program, this._options);
+        }
+
+        public defineSymbol(name: string, symbol: ts.Symbol, type: ts.Type | undefined, program: ts.Program): string {
+
+            let w = this.symbolWidth(symbol, program);
+
+            if (w !== undefined) {
+                let s = this._options.lib + NumericTypes[w];
+                return name == "" ? s : s + " " + name;
+            }
+
+            return define(name, type, program, this._options);
+        }
+
+        public sinkParameters(s: ts.SignatureDeclaration, program: ts.Program): Set<ts.Symbol> {
+            if (ts.isMethodDeclaration(s) && this.isVirtualMember(s, program)) {
+                return new Set<ts.Symbol>();
+            }
+            return sinkParameters(s, program.getTypeChecker(), this._options);
+        }
+
+        public parameters(s: ts.SignatureDeclaration, program: ts.Program, sinks: Set<ts.Symbol> = new Set<ts.Symbol>()): string {
+
+            let checker = program.getTypeChecker();
+            let vs: string[] = [];
+            let byValue = s.type !== undefined && isPromiseType(checker.getTypeAtLocation(s.type));
+
+            for (let param of s.parameters) {
+                let name = checker.getSymbolAtLocation(param.name)!;
+                let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
+                let sink = byValue || sinks.has(name);
+                let n = this.isCopiedParameter(param, type, sink, program) ? "__" + name.name + "__" : name.name;
+                vs.push(defineParameter(n, type, program, this._options, sink));
+            }
+
+            return vs.join(",");
+        }
+
+        public isCopiedParameter(param: ts.ParameterDeclaration, type: ts.Type | undefined, sink: boolean, program: ts.Program): boolean {
+            return !sink && (isConstReferenceType(type, this._options) || (type !== undefined && isClassTypeParameter(type)))
+                && isAssignedParameter(param, program.getTypeChecker());
+        }
+
+        public parameterCopies(s: ts.SignatureDeclaration, program: ts.Program, sink: boolean = false): void {
+
+            let checker = program.getTypeChecker();
+
+            for (let param of s.parameters) {
+                let name = checker.getSymbolAtLocation(param.name)!;
+                let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
+                if (this.isCopiedParameter(param, type, sink || this._sinks.has(name), program)) {
+                    this.level();
+                    this.out(define(name.name, type, program, this._options));
+                    this.out(" = __" + name.name + "__;\n");
+                }
+            }
+        }
+
+        public isVirtualMember(s: ts.ClassElement, program: ts.Program): boolean {
+
+            let checker = program.getTypeChecker();
+            let p = s.parent as ts.ClassDeclaration;
+            let name = memberName(s);
+
+            if (name === undefined || p.name === undefined) {
+                return true;
+            }
+
+            if (inheritedMembers(p, checker).has(name)) {
+                return true;
+            }
+
+            let overridden = getClassHierarchy(program).overridden.get(checker.getSymbolAtLocation(p.name)!);
+
+            return overridden !== undefined && overridden.has(name);
+        }
+
+        public templateParameters(node: GenericDeclaration | undefined, program: ts.Program, defaults: boolean = true): void {
+
+            if (node === undefined || !isGenericDeclaration(node)) {
+                return;
+            }
+
+            let checker = program.getTypeChecker();
+            let vs: string[] = [];
+
+            for (let param of node.typeParameters!) {
+                if (defaults && param.default !== undefined) {
+                    vs.push("typename " + param.name.text + " = " + define("", getTypeAtLocation(param.default, checker), program, this._options));
+                } else {
+                    vs.push("typename " + param.name.text);
+                }
+            }
+
+            this.level();
+            this.out("template <" + vs.join(",") + ">\n");
+        }
+
+        public className(p: ts.ClassDeclaration, program: ts.Program): string {
             let checker = program.getTypeChecker();
-
-            if (node.name !== undefined) {
-
-                let name = checker.getSymbolAtLocation(node.name)!;
-
-                this.level();
-                this.out("class ");
-                this.out(name.name);
-                this.heritageClauses(node.heritageClauses, true);
-                this.out(" {\n");
-                this._level++;
-                console.info("[class]", name.name, ">>");
-
-            }
+            return checker.getSymbolAtLocation(p.name!)!.name + templateArguments(p);
         }
 
         public classEnd() {
@@ -537,10 +1939,18 @@ export namespace CC {
                 this.out(m);
                 this.out("\n");
             }
+            let field = inlineGetter(s);
+
             this.level();
-            this.out("virtual ")
+            if (this.isVirtualMember(s, program)) {
+                this.out("virtual ");
+            }
             this.out(getter(name.name, type, program, this._options));
-            this.out(";\n");
+            if (field !== undefined) {
+                this.out(" { return this->" + field + "; }\n");
+            } else {
+                this.out(";\n");
+            }
 
         }
 
@@ -568,10 +1978,22 @@ export namespace CC {
                 this.out("\n");
             }
 
+            let field = inlineSetter(s);
+
             this.level();
-            this.out("virtual ")
+            if (this.isVirtualMember(s, program)) {
+                this.out("virtual ");
+            }
             this.out(setter(getSetSymbol(name.name), "v", type, program, this._options));
-            this.out(";\n");
+            if (field !== undefined) {
+                if (isConstReferenceType(type, this._options)) {
+                    this.out(" { this->" + field + " = std::move(v); }\n");
+                } else {
+                    this.out(" { this->" + field + " = v; }\n");
+                }
+            } else {
+                this.out(";\n");
+            }
 
         }
 
@@ -586,6 +2008,10 @@ export namespace CC {
             if (type !== undefined && isObjectReferenceType(type)) {
                 this.out(define("", type, program, this._options));
                 this.out(" " + prefix + name.name);
+            } else if (type !== undefined && isTypeParameter(type)) {
+                this.out("typename " + this._options.lib + "::Field<" + getType(type, this._options) + ">::type ");
+                this.out(prefix);
+                this.out(name.name);
             } else if (type !== undefined && (isObjectType(type) || isFunctionType(type))) {
                 this.out(this._options.lib);
                 if (isObjectWeakType(type)) {
@@ -598,13 +2024,36 @@ export namespace CC {
                 this.out(prefix);
                 this.out(name.name);
             } else {
-                this.out(define(prefix + name.name, type, program, this._options));
+                this.out(this.defineSymbol(prefix + name.name, name, type, program));
             }
 
             this.out(";\n");
 
         }
 
+        public classStatic(s: ts.PropertyDeclaration, program: ts.Program, kind: string, prefix: string): void {
+
+            let checker = program.getTypeChecker();
+            let name = checker.getSymbolAtLocation(s.name)!;
+
+            this.level();
+
+            if (kind == "constexpr") {
+                this.out("static constexpr ");
+                this.out(this.defineConstant(prefix + name.name, s, program));
+                this.out(" = ");
+                this.expression(s.initializer!, program, s.parent as ts.ClassDeclaration);
+            } else if (kind == "const") {
+                this.out("static const ");
+                this.out(this.defineConstant(prefix + name.name, s, program));
+            } else {
+                this.out("static ");
+                this.out(this.defineConstant(prefix + name.name, s, program));
+            }
+
+            this.out(";\n");
+        }
+
         public classProperty(s: ts.PropertyDeclaration, program: ts.Program): void {
 
             let checker = program.getTypeChecker();
@@ -630,12 +2079,19 @@ export namespace CC {
                 }
             }
 
-            if (mod != "public: ") {
+            let kind = this.staticKind(s, program);
+
+            if (st || mod != "public: ") {
 
                 this.level(-1);
                 this.out(mod);
                 this.out("\n");
-                this.classMember(s, program, "");
+
+                if (kind !== undefined) {
+                    this.classStatic(s, program, kind, "");
+                } else {
+                    this.classMember(s, program, "");
+                }
 
             } else {
 
@@ -651,7 +2107,12 @@ export namespace CC {
 
                 this.level(-1);
                 this.out("protected:\n");
-                this.classMember(s, program, "_");
+
+                if (kind !== undefined) {
+                    this.classStatic(s, program, kind, "_");
+                } else {
+                    this.classMember(s, program, "_");
+                }
 
             }
 
@@ -709,24 +2170,21 @@ export namespace CC {
             this.level();
             if (st) {
                 this.out("static ");
-            } else {
+            } else if (this.isVirtualMember(s, program)) {
                 this.out("virtual ");
             }
             this.out(type === undefined ? "void " + symbol.name : define(symbol.name, type, program, this._options));
             this.out("(");
+            this.out(this.parameters(s, program, this.sinkParameters(s, program)));
+            this.out(");\n");
 
-            if (s.parameters !== undefined) {
-                var dot = "";
-                for (let param of s.parameters) {
-                    let name = checker.getSymbolAtLocation(param.name)!;
-                    let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                    this.out(dot);
-                    this.out(define(name.name, type, program, this._options));
-                    dot = ",";
-                }
+            if (isAsync(s) && !st) {
+                this.level();
+                this.out(define(symbol.name + "async__", type, program, this._options));
+                this.out("(");
+                this.out([this._options.lib + "::Strong<" + this._options.lib + "::IObject *> __Self__", this.parameters(s, program)].filter((v) => v != "").join(","));
+                this.out(");\n");
             }
-
-            this.out(");\n");
         }
 
         public classMethods(s: ts.ClassDeclaration, program: ts.Program): void {
@@ -756,18 +2214,7 @@ export namespace CC {
             this.level();
             this.out(psymbol.name);
             this.out("(");
-
-            var vs: string[] = [];
-
-            for (let param of s.parameters) {
-
-                let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                let name = checker.getSymbolAtLocation(param.name)!;
-                vs.push(define(name.name, type, program, this._options));
-            }
-
-            this.out(vs.join(","));
-
+            this.out(this.parameters(s, program, this.sinkParameters(s, program)));
             this.out(");\n\n");
         }
 
@@ -823,10 +2270,11 @@ export namespace CC {
 
             let name = checker.getSymbolAtLocation(node.name)!;
 
+            this.templateParameters(node, program);
             this.level();
             this.out("class ");
             this.out(name.name);
-            this.heritageClauses(node.heritageClauses, false);
+            this.heritageClauses(node.heritageClauses, program, false);
             this.out(" {\n");
             this._level++;
             this.level(-1);
@@ -928,18 +2376,7 @@ export namespace CC {
             this.out("virtual ");
             this.out(type === undefined ? "void " + symbol.name : define(symbol.name, type, program, this._options));
             this.out("(");
-
-            if (s.parameters !== undefined) {
-                var dot = "";
-                for (let param of s.parameters) {
-                    let name = checker.getSymbolAtLocation(param.name)!;
-                    let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                    this.out(dot);
-                    this.out(define(name.name, type, program, this._options));
-                    dot = ",";
-                }
-            }
-
+            this.out(this.parameters(s, program));
             this.out(") = 0;\n");
         }
 
@@ -1004,6 +2441,121 @@ export namespace CC {
 
         }
 
+        public enumDeclaration(s: ts.EnumDeclaration, program: ts.Program): void {
+
+            this.level();
+
+            if (isStringEnum(s)) {
+
+                this.out("struct ");
+                this.out(s.name.text);
+                this.out(" {\n");
+                this._level++;
+
+                for (let m of s.members) {
+                    this.level();
+                    this.out("static const ");
+                    this.out(this._options.lib);
+                    this.out("::String ");
+                    this.out(m.name.getText());
+                    this.out(";\n");
+                }
+
+            } else {
+
+                this.out("enum class ");
+                this.out(s.name.text);
+                this.out(" {\n");
+                this._level++;
+
+                for (let m of s.members) {
+                    this.level();
+                    this.out(m.name.getText());
+                    if (m.initializer !== undefined) {
+                        this.out(" = ");
+                        this.expression(m.initializer, program, undefined);
+                    }
+                    this.out(",\n");
+                }
+            }
+
+            this._level--;
+            this.level();
+            this.out("};\n\n");
+        }
+
+        public implementEnum(s: ts.EnumDeclaration, program: ts.Program): void {
+
+            if (!isStringEnum(s)) {
+                return;
+            }
+
+            for (let m of s.members) {
+                this.level();
+                this.out("const ");
+                this.out(this._options.lib);
+                this.out("::String ");
+                this.out(s.name.text);
+                this.out("::");
+                this.out(m.name.getText());
+                this.out(" = ");
+                this.expression(m.initializer!, program, undefined);
+                this.out(";\n");
+            }
+
+            this.out("\n");
+        }
+
+        public constants(s: ts.VariableStatement, program: ts.Program): void {
+
+            let checker = program.getTypeChecker();
+
+            for (let v of s.declarationList.declarations) {
+
+                if (!isConstDeclaration(v) || v.initializer === undefined || !isConstantType(checker.getTypeAtLocation(v.name))) {
+                    continue;
+                }
+
+                let name = checker.getSymbolAtLocation(v.name)!;
+
+                this.level();
+
+                if (isConstantExpression(v.initializer, checker)) {
+                    this.out("constexpr ");
+                    this.out(this.defineConstant(name.name, v, program));
+                    this.out(" = ");
+                    this.expression(v.initializer, program, undefined);
+                } else {
+                    this.out("extern const ");
+                    this.out(this.defineConstant(name.name, v, program));
+                }
+
+                this.out(";\n\n");
+            }
+        }
+
+        public implementConstants(s: ts.VariableStatement, program: ts.Program): void {
+
+            let checker = program.getTypeChecker();
+
+            for (let v of s.declarationList.declarations) {
+
+                if (!isConstDeclaration(v) || v.initializer === undefined || !isConstantType(checker.getTypeAtLocation(v.name))
+                    || isConstantExpression(v.initializer, checker)) {
+                    continue;
+                }
+
+                let name = checker.getSymbolAtLocation(v.name)!;
+
+                this.level();
+                this.out("const ");
+                this.out(this.defineConstant(name.name, v, program));
+                this.out(" = ");
+                this.expression(v.initializer, program, undefined);
+                this.out(";\n\n");
+            }
+        }
+
         public function(s: ts.FunctionDeclaration, program: ts.Program): void {
 
             if (s.name === undefined) {
@@ -1017,6 +2569,7 @@ export namespace CC {
 
             console.info("[function]", symbol.name, ">>");
 
+            this.templateParameters(s, program);
             this.level();
 
             if (type !== undefined) {
@@ -1027,18 +2580,7 @@ export namespace CC {
             }
 
             this.out("(");
-
-            if (s.parameters !== undefined) {
-                var dot = "";
-                for (let param of s.parameters) {
-                    let name = checker.getSymbolAtLocation(param.name)!;
-                    let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                    this.out(dot);
-                    this.out(define(name.name, type, program, this._options));
-                    dot = ",";
-                }
-            }
-
+            this.out(this.parameters(s, program, this.sinkParameters(s, program)));
             this.out(");\n\n");
 
             console.info("[function]", symbol.name, "<<");
@@ -1048,11 +2590,14 @@ export namespace CC {
 
         public implementGetter(s: ts.PropertyDeclaration | ts.GetAccessorDeclaration, program: ts.Program): void {
 
+            if (inlineGetter(s) !== undefined) {
+                return;
+            }
+
             let checker = program.getTypeChecker();
             let name = checker.getSymbolAtLocation(s.name)!;
             let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
             let p: ts.ClassDeclaration = s.parent as ts.ClassDeclaration;
-            let pname = checker.getSymbolAtLocation(p.name!)!;
             var isPublic = true;
 
             if (s.modifiers !== undefined) {
@@ -1067,8 +2612,9 @@ export namespace CC {
                 }
             }
 
+            this.templateParameters(p, program, false);
             this.level();
-            this.out(getter(pname.name + "::" + name.name, type, program, this._options));
+            this.out(getter(this.className(p, program) + "::" + name.name, type, program, this._options));
             this.out("{\n");
 
             this._level++;
@@ -1098,11 +2644,14 @@ export namespace CC {
 
         public implementSetter(s: ts.PropertyDeclaration | ts.SetAccessorDeclaration, program: ts.Program): void {
 
+            if (inlineSetter(s) !== undefined) {
+                return;
+            }
+
             let checker = program.getTypeChecker();
             let name = checker.getSymbolAtLocation(s.name)!;
             let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
             let p: ts.ClassDeclaration = s.parent as ts.ClassDeclaration;
-            let pname = checker.getSymbolAtLocation(p.name!)!;
             var isPublic = true;
 
             if (s.modifiers !== undefined) {
@@ -1119,8 +2668,9 @@ export namespace CC {
 
             if (ts.isPropertyDeclaration(s)) {
 
+                this.templateParameters(p, program, false);
                 this.level();
-                this.out(setter(pname.name + "::" + getSetSymbol(name.name), "__newValue__", type, program, this._options));
+                this.out(setter(this.className(p, program) + "::" + getSetSymbol(name.name), "__newValue__", type, program, this._options));
                 this.out("{\n");
 
                 this._level++;
@@ -1172,8 +2722,47 @@ export namespace CC {
 
         }
 
+        public implementStatic(s: ts.PropertyDeclaration, program: ts.Program, kind: string): void {
+
+            let checker = program.getTypeChecker();
+            let name = checker.getSymbolAtLocation(s.name)!;
+            let p: ts.ClassDeclaration = s.parent as ts.ClassDeclaration;
+            let prefix = !isStaticMember(s) && isPublicProperty(s) ? "_" : "";
+
+            this.templateParameters(p, program, false);
+            this.level();
+
+            if (kind == "constexpr") {
+                this.out("constexpr ");
+                this.out(this.defineConstant(this.className(p, program) + "::" + prefix + name.name, s, program));
+            } else {
+                if (kind == "const") {
+                    this.out("const ");
+                }
+                this.out(this.defineConstant(this.className(p, program) + "::" + prefix + name.name, s, program));
+                this.out(" = ");
+                if (s.initializer !== undefined) {
+                    this.expression(s.initializer, program, p);
+                } else {
+                    let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
+                    this.out(getDefaultValue(type, this._options));
+                }
+            }
+
+            this.out(";\n\n");
+        }
+
         public implementProperty(s: ts.PropertyDeclaration, program: ts.Program): void {
 
+            let kind = this.staticKind(s, program);
+
+            if (kind !== undefined) {
+                this.implementStatic(s, program, kind);
+                if (isStaticMember(s)) {
+                    return;
+                }
+            }
+
             var readonly = false;
             var isPublic = true;
 
@@ -1206,31 +2795,40 @@ export namespace CC {
             let type = s.type === undefined ? undefined : getTypeAtLocation(s.type, checker);
             let name = checker.getSymbolAtLocation(s.name)!;
             let p: ts.ClassDeclaration = s.parent as ts.ClassDeclaration;
-            let pname = checker.getSymbolAtLocation(p.name!)!;
 
+            this.templateParameters(p, program, false);
             this.level();
-            this.out(define(pname.name + "::" + name.name, type, program, this._options));
+            this.out(define(this.className(p, program) + "::" + name.name, type, program, this._options));
             this.out("(");
+            this._sinks = this.sinkParameters(s, program);
+            this.out(this.parameters(s, program, this._sinks));
+            this.out(") {\n");
 
-            if (s.parameters !== undefined) {
-                var dot = "";
-                for (let param of s.parameters) {
-                    let name = checker.getSymbolAtLocation(param.name)!;
-                    let type = getTypeAtLocation(param.type!, checker);
-                    this.out(dot);
-                    this.out(define(name.name, type, program, this._options));
-                    dot = ",";
-                }
-            }
+            if (isAsync(s) && !isStaticMember(s)) {
+                let names = s.parameters.map((param) => checker.getSymbolAtLocation(param.name)!.name);
+                this.level(1);
+                this.out("return " + name.name + "async__(" + ["this"].concat(names).join(",") + ");\n");
+                this.level();
+                this.out("}\n\n");
 
-            this.out(") {\n");
+                this.templateParameters(p, program, false);
+                this.level();
+                this.out(define(this.className(p, program) + "::" + name.name + "async__", type, program, this._options));
+                this.out("(");
+                this.out([this._options.lib + "::Strong<" + this._options.lib + "::IObject *> __Self__", this.parameters(s, program, this._sinks)].filter((v) => v != "").join(","));
+                this.out(") {\n");
+            }
 
             if (s.body !== undefined) {
                 this._level++;
+                this.parameterCopies(s, program, isPromiseType(type));
                 this.body(s.body, program, p);
+                this.asyncEnd(s, type);
                 this._level--;
             }
 
+            this._sinks.clear();
+
             this.level();
             this.out("}\n\n");
 
@@ -1270,6 +2868,7 @@ export namespace CC {
 
             let type = s.type === undefined ? undefined : getTypeAtLocation(s.type!, checker);
 
+            this.templateParameters(s, program, false);
             this.level();
 
             if (type !== undefined) {
@@ -1280,32 +2879,30 @@ export namespace CC {
             }
 
             this.out("(");
-
-            if (s.parameters !== undefined) {
-                var dot = "";
-                for (let param of s.parameters) {
-                    let name = checker.getSymbolAtLocation(param.name)!;
-                    let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                    this.out(dot);
-                    this.out(define(name.name, type, program, this._options));
-                    dot = ",";
-                }
-            }
-
+            this._sinks = this.sinkParameters(s, program);
+            this.out(this.parameters(s, program, this._sinks));
             this.out(") {\n");
 
             if (s.body !== undefined) {
                 this._level++;
+                this.parameterCopies(s, program, isPromiseType(type));
                 this.body(s.body, program, undefined);
+                this.asyncEnd(s, type);
                 this._level--;
             }
 
+            this._sinks.clear();
+
             this.level();
             this.out("}\n\n");
         }
 
         public implementInitializer(s: ts.PropertyDeclaration, program: ts.Program): void {
 
+            if (this.staticKind(s, program) !== undefined) {
+                return;
+            }
+
             let checker = program.getTypeChecker();
 
             let name = checker.getSymbolAtLocation(s.name)!
@@ -1327,7 +2924,8 @@ export namespace CC {
 
                 let e = s.initializer;
 
-                if (type !== undefined && type.symbol !== undefined && type.symbol.name == "map") {
+                if (type !== undefined && type.symbol !== undefined
+                    && (type.symbol.name == "map" || type.symbol.name == "orderedMap")) {
 
                     var count = 0;
 
@@ -1453,8 +3051,9 @@ export namespace CC {
             let checker = program.getTypeChecker();
             let pname = checker.getSymbolAtLocation(p.name!)!;
 
+            this.templateParameters(p, program, false);
             this.level();
-            this.out(pname.name);
+            this.out(this.className(p, program));
             this.out("::");
             this.out(pname.name);
             this.out("(");
@@ -1486,26 +3085,20 @@ export namespace CC {
             let p: ts.ClassDeclaration = s.parent as ts.ClassDeclaration;
             let pname = checker.getSymbolAtLocation(p.name!)!;
 
+            this.templateParameters(p, program, false);
             this.level();
-            this.out(pname.name);
+            this.out(this.className(p, program));
             this.out("::");
             this.out(pname.name);
             this.out("(");
-
-            var vs: string[] = [];
-
-            for (let param of s.parameters) {
-                let type = param.type === undefined ? undefined : getTypeAtLocation(param.type, checker);
-                let name = checker.getSymbolAtLocation(param.name)!;
-                vs.push(define(name.name, type, program, this._options));
-            }
-
-            this.out(vs.join(","));
-
+            this._sinks = this.sinkParameters(s, program);
+            this.out(this.parameters(s, program, this._sinks));
             this.out(") {\n");
 
             this._level++;
 
+            this.parameterCopies(s, program);
+
             let v = this;
 
             ts.forEachChild(p, (node: ts.Node): void => {
@@ -1520,6 +3113,8 @@ export namespace CC {
                 this.body(s.body, program, p);
             }
 
+            this._sinks.clear();
+
             this._level--;
 
             this.level();
@@ -1577,6 +3172,10 @@ export namespace CC {
                         this.out("()");
                     }
 
+                } else if (isStaticAccess(name)) {
+                    this.expression(e.expression, program, isa);
+                    this.out("::");
+                    this.out(name.name);
                 } else {
                     this.expression(e.expression, program, isa);
                     this.out("->")
@@ -1584,85 +3183,113 @@ export namespace CC {
                     this.out(name.name);
                     this.out("()");
                 }
+            } else if (ts.isBinaryExpression(e) && isStringConcat(e, checker)) {
+                let vs: ts.Expression[] = [];
+                stringConcatOperands(e, checker, vs);
+                this.out(this._options.lib);
+                this.out("::concat(");
+                var dot = "";
+                for (let v of vs) {
+                    this.out(dot);
+                    this.expression(v, program, isa);
+                    dot = ",";
+                }
+                this.out(")");
             } else if (ts.isBinaryExpression(e)) {
-                this.expression(e.left, program, isa);
+                let w = this.operandWidth(e, program);
+                if (w !== undefined) {
+                    this.out("(" + this._options.lib + NumericTypes[w] + ")(");
+                    this.expression(e.left, program, isa);
+                    this.out(")");
+                } else {
+                    this.expression(e.left, program, isa);
+                }
                 this.out(e.operatorToken.getText());
                 this.expression(e.right, program, isa);
             } else if (ts.isIdentifier(e)) {
                 if (e.text == "undefined" || e.text == "null") {
                     this.out("nullptr");
+                } else if (this._sinks.has(checker.getSymbolAtLocation(e)!)) {
+                    this.out("std::move(");
+                    this.out(e.text);
+                    this.out(")");
                 } else {
                     this.out(e.text);
                 }
             } else if (ts.isCallExpression(e)) {
-                if (ts.isPropertyAccessExpression(e.expression)) {
+                let lib = getLibFunction(e.expression, checker, this._options);
+                if (lib !== undefined) {
+
+                    this.out(lib);
+                    this.out("(");
+
+                    var dot = "";
+
+                    for (let arg of e.arguments) {
+                        this.out(dot);
+                        this.expression(arg, program, isa);
+                        dot = ",";
+                    }
+
+                    this.out(")");
+
+                } else if (ts.isPropertyAccessExpression(e.expression)) {
                     this.expression(e.expression.expression, program, isa);
-                    this.out("->");
+                    let callee = checker.getSymbolAtLocation(e.expression.name);
+                    this.out(callee !== undefined && isStaticAccess(callee) ? "::" : "->");
                     this.out(e.expression.name.escapedText as string);
 
                     this.out("(");
 
-                    var vs: string[] = [];
+                    var dot = "";
 
                     for (let arg of e.arguments) {
+                        this.out(dot);
                         this.expression(arg, program, isa);
+                        dot = ",";
                     }
 
-                    this.out(vs.join(","));
-
                     this.out(")");
 
-                } else {
+                } else if (this.isGenericCall(e, program)) {
 
-                    this.out("(*(")
                     this.expression(e.expression, program, isa);
-                    this.out("))(");
+                    this.out(this.typeArguments(e.typeArguments, program));
+                    this.out("(");
 
-                    var vs: string[] = [];
+                    var dot = "";
 
                     for (let arg of e.arguments) {
+                        this.out(dot);
                         this.expression(arg, program, isa);
+                        dot = ",";
                     }
 
-                    this.out(vs.join(","));
-
                     this.out(")");
 
-                }
-
-            } else if (ts.isNewExpression(e)) {
-
-                this.out("new ")
-
-                var n = e.expression;
-                var ns: string[] = [];
-
-                while (1) {
-
-                    if (ts.isPropertyAccessExpression(n)) {
-                        ns.push(n.name.escapedText as string);
-                        n = n.expression;
-                    } else if (ts.isToken(n)) {
-                        ns.push(n.getText());
-                        break;
-                    } else {
-                        break;
-                    }
-                }
-
-                this.out(ns.reverse().join("::"));
+                } else {
 
-                this.out("(");
+                    this.out("(*(")
+                    this.expression(e.expression, program, isa);
+                    this.out("))(");
 
-                var dot = "";
+                    var dot = "";
 
-                if (e.arguments != undefined) {
                     for (let arg of e.arguments) {
                         this.out(dot);
                         this.expression(arg, program, isa);
                         dot = ",";
                     }
+
+                    this.out(")");
+
                 }
+
+            } else if (ts.isNewExpression(e)) {
+                this.newExpression(e, program, isa);
+            } else if (ts.isAwaitExpression(e)) {
+                this.out("(co_await ");
+                this.expression(e.expression, program, isa);
                 this.out(")");
             } else if (ts.isNumericLiteral(e)) {
                 this.out(e.getText());
@@ -1697,40 +3324,40 @@ export namespace CC {
                 let func: ArrowFunction = e as ArrowFunction;
                 let closure = func.closure!;
 
-                this.out("(new ");
-                this.out(this._options.lib);
-                this.out("::Closure<");
-
-                let args: string[] = [];
-                let returnType: ts.Type | undefined = e.type === undefined ? undefined : checker.getTypeAtLocation(e.type);
-
-                args.push(define("", returnType, program, this._options));
-
-                for (let param of e.parameters) {
-                    let vType = getTypeAtLocation(param.type, checker);
-                    args.push(define("", vType, program, this._options));
-                }
-
-                this.out(args.join(","));
-
-                this.out(">(");
-                this.out(closure.name);
-                this.out("))");
-
-                for (let local of closure.locals) {
-                    this.out("->as(");
-                    this.out(JSON.stringify(local.name));
-                    this.out(",");
+                if (closure.locals.length == 0) {
                     this.out(this._options.lib);
-                    this.out("::Any(")
-                    this.out(local.name);
-                    this.out("))");
+                    this.out("::StaticClosure<");
+                    this.out(closure.args.join(","));
+                    this.out(closure.template == "" ? ">::get<" : ">::template get<");
+                    this.out(closure.name + closure.template);
+                    this.out(">()");
+                } else {
+                    this.out("new ");
+                    this.out(closure.name);
+                    this.out("type__" + closure.template + "(");
+                    this.out(closure.name + closure.template);
+                    for (let local of closure.locals) {
+                        this.out(",");
+                        this.out(local.name);
+                    }
+                    this.out(")");
                 }
 
             } else if (ts.isIdentifier(e)) {
                 this.out(e.text);
-            } else if (ts.isElementAccessExpression(e)) {
+            } else if (ts.isElementAccessExpression(e) && !isWriteTarget(e) && isContainerType(checker.getTypeAtLocation(e.expression))) {
                 this.expression(e.expression, program, isa);
+                this.out(".get(");
+                this.expression(e.argumentExpression, program, isa);
+                this.out(")");
+            } else if (ts.isElementAccessExpression(e)) {
+                if (getLibType(checker.getTypeAtLocation(e.expression), this._options) !== undefined) {
+                    this.out("(*");
+                    this.expression(e.expression, program, isa);
+                    this.out(")");
+                } else {
+                    this.expression(e.expression, program, isa);
+                }
                 this.out("[");
                 this.expression(e.argumentExpression, program, isa);
                 this.out("]");
@@ -1741,13 +3368,94 @@ export namespace CC {
 
         }
 
+        public newExpression(e: ts.NewExpression, program: ts.Program, isa: ts.ClassDeclaration | undefined, local?: string): void {
+
+            let checker = program.getTypeChecker();
+
+            if (local === undefined) {
+                this.out("new ");
+            }
+
+            var n = e.expression;
+            var ns: string[] = [];
+            let lib = getLibType(checker.getTypeAtLocation(e), this._options);
+
+            if (lib !== undefined) {
+                ns.push(lib);
+            }
+
+            while (lib === undefined) {
+
+                if (ts.isPropertyAccessExpression(n)) {
+                    ns.push(n.name.escapedText as string);
+                    n = n.expression;
+                } else if (ts.isToken(n)) {
+                    ns.push(n.getText());
+                    break;
+                } else {
+                    break;
+                }
+            }
+
+            this.out(ns.reverse().join("::"));
+
+            let type = checker.getTypeAtLocation(e);
+
+            if (lib === undefined && isGenericType(type)) {
+                if (e.typeArguments !== undefined) {
+                    this.out(this.typeArguments(e.typeArguments, program));
+                } else {
+                    this.out("<" + genericArguments(type).map((v) => define("", v, program, this._options)).join(",") + ">");
+                }
+            }
+
+            if (local !== undefined) {
+                this.out(" ");
+                this.out(local);
+                if (e.arguments === undefined || e.arguments.length == 0) {
+                    return;
+                }
+            }
+
+            this.out("(");
+
+            var dot = "";
+
+            if (e.arguments != undefined) {
+                for (let arg of e.arguments) {
+                    this.out(dot);
+                    this.expression(arg, program, isa);
+                    dot = ",";
+                }
+            }
+            this.out(")");
+        }
+
+        public typeArguments(args: ts.NodeArray<ts.TypeNode> | undefined, program: ts.Program): string {
+            if (args === undefined || args.length == 0) {
+                return "";
+            }
+            let checker = program.getTypeChecker();
+            return "<" + args.map((v) => define("", getTypeAtLocation(v, checker), program, this._options)).join(",") + ">";
+        }
+
+        public isGenericCall(e: ts.CallExpression, program: ts.Program): boolean {
+            let checker = program.getTypeChecker();
+            var symbol = checker.getSymbolAtLocation(e.expression);
+            if (symbol !== undefined && (symbol.flags & ts.SymbolFlags.Alias) != 0) {
+                symbol = checker.getAliasedSymbol(symbol);
+            }
+            return symbol !== undefined && symbol.valueDeclaration !== undefined
+                && ts.isFunctionDeclaration(symbol.valueDeclaration) && isGenericDeclaration(symbol.valueDeclaration);
+        }
+
         public statement(st: ts.Statement, program: ts.Program, isa: ts.ClassDeclaration | undefined): void {
 
             let checker = program.getTypeChecker();
 
             if (ts.isReturnStatement(st)) {
                 this.level();
-                this.out("return ");
+                this.out(isAsyncScope(st) ? "co_return " : "return ");
                 if (st.expression !== undefined) {
                     this.expression(st.expression, program, isa);
                 }
@@ -1776,7 +3484,7 @@ export namespace CC {
                             this.out(dot);
                             if (dot == "") {
                                 let type = getTypeAtLocation(v.type, checker);
-                                this.out(define(n.name, type, program, this._options));
+                                this.out(this.defineSymbol(n.name, n, type, program));
                             } else {
                                 this.out(n.name);
                             }
@@ -1856,10 +3564,29 @@ export namespace CC {
                     this.level();
                     let n = checker.getSymbolAtLocation(v.name)!;
                     let t = v.type === undefined ? undefined : getTypeAtLocation(v.type, checker);
-                    this.out(define(n.name, t, program, this._options));
-                    if (v.initializer !== undefined) {
+                    if (v.initializer !== undefined && ts.isNewExpression(v.initializer) && isLocalObject(v, checker, this._options)) {
+                        this.newExpression(v.initializer, program, isa, "__new__" + n.name + "__");
+                        this.out(";\n");
+                        this.level();
+                        this.out(define(n.name, t, program, this._options));
                         this.out(" = (");
                         this.out(define("", t, program, this._options));
+                        this.out(")&__new__" + n.name + "__;\n");
+                        continue;
+                    }
+                    if (v.initializer !== undefined && ts.isArrowFunction(v.initializer) && isLocalClosure(v, checker)
+                        && (v.initializer as ArrowFunction).closure!.locals.length > 0) {
+                        let closure = (v.initializer as ArrowFunction).closure!;
+                        let args = [closure.name + closure.template].concat(closure.locals.map((local) => local.name));
+                        this.out(closure.name + "type__" + closure.template + " __closure__" + n.name + "__(" + args.join(",") + ");\n");
+                        this.level();
+                        this.out(this._options.lib + "::Closure<" + closure.args.join(",") + "> * " + n.name + " = &__closure__" + n.name + "__;\n");
+                        continue;
+                    }
+                    this.out(this.defineSymbol(n.name, n, t, program));
+                    if (v.initializer !== undefined) {
+                        this.out(" = (");
+                        this.out(this.defineSymbol("", n, t, program));
                         this.out(")");
                         this.expression(v.initializer, program, isa);
                     }
@@ -1876,6 +3603,13 @@ export namespace CC {
             }
         }
 
+        public asyncEnd(s: ts.Node, type: ts.Type | undefined): void {
+            if (isAsync(s) && isVoidPromiseType(type)) {
+                this.level();
+                this.out("co_return;\n");
+            }
+        }
+
         public body(body: ts.FunctionBody, program: ts.Program, isa: ts.ClassDeclaration | undefined): void {
 
             for (let st of body.statements) {
@@ -1928,7 +3662,10 @@ export namespace CC {
 
                 if (ts.isIdentifier(node)) {
                     if (locals.has(node.text)) {
-                        vs.push(checker.getSymbolAtLocation(node)!);
+                        let symbol = checker.getSymbolAtLocation(node)!;
+                        if (vs.indexOf(symbol) < 0) {
+                            vs.push(symbol);
+                        }
                     }
                 } else {
                     ts.forEachChild(node, each);
@@ -1941,59 +3678,187 @@ export namespace CC {
             return vs;
         }
 
+        protected closureLocalType(local: ts.Symbol, program: ts.Program): ts.Type | undefined {
+            let checker = program.getTypeChecker();
+            if (ts.isVariableDeclaration(local.valueDeclaration) || ts.isParameter(local.valueDeclaration)) {
+                return local.valueDeclaration.type === undefined ? undefined : getTypeAtLocation(local.valueDeclaration.type, checker);
+            }
+            return undefined;
+        }
+
+        public implementClosureLocals(closure: Closure, program: ts.Program, scope?: GenericDeclaration): void {
+
+            let name = closure.name + "locals__";
+
+            this.templateParameters(scope, program, false);
+            this.level();
+            this.out("struct ");
+            this.out(name);
+            this.out(" {\n");
+
+            this._level++;
+
+            let params: string[] = [];
+            let inits: string[] = [];
+
+            for (let local of closure.locals) {
+                let type = this.closureLocalType(local, program);
+                params.push(this.defineSymbol(local.name, local, type, program));
+                inits.push(local.name + "(" + local.name + ")");
+            }
+
+            this.level();
+            this.out(name);
+            this.out("(");
+            this.out(params.join(","));
+            this.out("):");
+            this.out(inits.join(","));
+            this.out(" {}\n");
+
+            for (let local of closure.locals) {
+                let type = this.closureLocalType(local, program);
+                this.level();
+                if (type !== undefined && !isObjectReferenceType(type) && (isObjectType(type) || isFunctionType(type))) {
+                    this.out(this._options.lib);
+                    if (isObjectWeakType(type)) {
+                        this.out("::Weak<");
+                    } else {
+                        this.out("::Strong<");
+                    }
+                    this.out(define("", type, program, this._options));
+                    this.out("> ");
+                    this.out(local.name);
+                } else {
+                    this.out(this.defineSymbol("", local, type, program));
+                    this.out(" ");
+                    this.out(local.name);
+                }
+                this.out(";\n");
+            }
+
+            this._level--;
+
+            this.level();
+            this.out("};\n\n");
+
+            if (scope !== undefined) {
+                this.templateParameters(scope, program, false);
+                this.level();
+                this.out("using ");
+                this.out(closure.name);
+                this.out("type__ = ");
+                this.out(this._options.lib);
+                this.out("::LocalClosure<");
+                this.out(name + closure.template);
+                this.out(",");
+                this.out(closure.args.join(","));
+                this.out(">;\n\n");
+                return;
+            }
+
+            this.level();
+            this.out("typedef ");
+            this.out(this._options.lib);
+            this.out("::LocalClosure<");
+            this.out(name);
+            this.out(",");
+            this.out(closure.args.join(","));
+            this.out("> ");
+            this.out(closure.name);
+            this.out("type__;\n\n");
+        }
+
         public implementArrowFunction(s: ArrowFunction, program: ts.Program, isa: ts.ClassDeclaration | undefined): void {
 
             let checker = program.getTypeChecker();
 
+            let returnType: ts.Type | undefined = s.type === undefined ? undefined : checker.getTypeAtLocation(s.type);
+            let scope = genericScope(s);
+
             let closure: Closure = {
-                name: "__closure__func__" + s.pos + "_" + s.end + "__",
-                locals: this.closureSymbolsInFunction(s, program, isa)
+                name: "__closure__" + this._prefix + "__" + s.pos + "_" + s.end + "__",
+                args: [define("", returnType, program, this._options)],
+                locals: this.closureSymbolsInFunction(s, program, isa),
+                template: templateArguments(scope)
             };
 
-            s.closure = closure;
+            for (let param of s.parameters) {
+                let vType = getTypeAtLocation(param.type, checker);
+                closure.args.push(define("", vType, program, this._options));
+            }
 
-            let returnType: ts.Type | undefined = s.type === undefined ? undefined : checker.getTypeAtLocation(s.type);
+            s.closure = closure;
 
-            this.level();
-            this.out("inline static ");
-            this.out(define("", returnType, program, this._options));
-            this.out(" ");
-            this.out(closure.name);
-            this.out("(");
+            if (closure.locals.length > 0) {
+                this.implementClosureLocals(closure, program, scope);
+            }
 
+            let async = isAsync(s);
             let args: string[] = [];
-
-            args.push(this._options.lib + "::_Closure * __Closure__");
+            let names: string[] = [];
 
             for (let param of s.parameters) {
                 let n = checker.getSymbolAtLocation(param.name)!;
                 let vType = getTypeAtLocation(param.type, checker);
 
-                args.push(define(n.name, vType, program, this._options));
+                args.push(defineParameter(this.isCopiedParameter(param, vType, async, program) ? "__" + n.name + "__" : n.name, vType, program, this._options, async));
+                names.push(n.name);
             }
 
-            this.out(args.join(","));
+            this.templateParameters(scope, program, false);
+            this.level();
+            this.out("inline static ");
+            this.out(define("", returnType, program, this._options));
+            this.out(" ");
+            this.out(closure.name);
 
-            this.out(") {\n");
+            if (async) {
+                this.out("async__(");
+                this.out([this._options.lib + "::Strong<" + this._options.lib + "::_Closure *> __Self__"].concat(args).join(","));
+                this.out(") {\n");
+                this._level++;
+                this.level();
+                this.out(this._options.lib + "::_Closure * __Closure__ = __Self__;\n");
+            } else {
+                this.out("(");
+                this.out([this._options.lib + "::_Closure * __Closure__"].concat(args).join(","));
+                this.out(") {\n");
+                this._level++;
+            }
 
-            this._level++;
+            if (closure.locals.length > 0) {
+                this.level();
+                this.out(closure.name);
+                this.out("locals__" + closure.template + " & __Locals__ = ");
+                this.out(closure.name);
+                this.out("type__" + closure.template + "::get(__Closure__);\n");
+            }
 
             for (let local of closure.locals) {
+                let type = this.closureLocalType(local, program);
                 this.level();
-                if (ts.isVariableDeclaration(local.valueDeclaration) || ts.isParameter(local.valueDeclaration)) {
-                    let type = local.valueDeclaration.type === undefined ? undefined : checker.getTypeAtLocation(local.valueDeclaration.type);
+                if (type !== undefined && !isObjectReferenceType(type) && (isObjectType(type) || isFunctionType(type))) {
                     this.out(define(local.name, type, program, this._options));
-                    this.out(" = __Closure__->get(");
-                    this.out(JSON.stringify(local.name));
-                    this.out(")");
+                } else {
+                    this.out(this.defineSymbol("", local, type, program));
+                    this.out(" & ");
+                    this.out(local.name);
                 }
+                this.out(" = __Locals__.");
+                this.out(local.name);
                 this.out(";\n");
             }
 
+            this.parameterCopies(s, program, async);
+
             if (ts.isBlock(s.body)) {
                 this.body(s.body, program, isa);
+                this.asyncEnd(s, returnType);
             } else {
+                this.level();
+                this.out(async ? "co_return " : "return ");
                 this.expression(s.body as ts.Expression, program, isa);
+                this.out(";\n");
             }
 
             this._level--;
@@ -2001,6 +3866,31 @@ export namespace CC {
             this.level();
             this.out("}\n\n");
 
+            if (async) {
+                this.templateParameters(scope, program, false);
+                this.level();
+                this.out("inline static ");
+                this.out(define("", returnType, program, this._options));
+                this.out(" ");
+                this.out(closure.name);
+                this.out("(");
+                args = [this._options.lib + "::_Closure * __Closure__"];
+                for (let param of s.parameters) {
+                    let n = checker.getSymbolAtLocation(param.name)!;
+                    args.push(defineParameter(n.name, getTypeAtLocation(param.type, checker), program, this._options));
+                }
+                this.out(args.join(","));
+                this.out(") {\n");
+                this._level++;
+                this.level();
+                this.out("return ");
+                this.out(closure.name);
+                this.out("async__" + closure.template + "(" + ["__Closure__"].concat(names).join(",") + ");\n");
+                this._level--;
+                this.level();
+                this.out("}\n\n");
+            }
+
         }
 
         public implementClosure(node: ts.Node, program: ts.Program, isa: ts.ClassDeclaration | undefined): void {
@@ -2022,18 +3912,26 @@ export namespace CC {
 
         }
 
-        public import(s: ts.ImportDeclaration, program: ts.Program): void {
+        public import(s: ts.ImportDeclaration, program: ts.Program, type: FileType = FileType.Header): string[] {
             let name = s.moduleSpecifier.getText().replace(/\"/g, "");
             if (name.startsWith("./")) {
+                if (type == FileType.Header) {
+                    let vs = forwardDeclarations(s, program.getTypeChecker());
+                    if (vs !== undefined) {
+                        return vs;
+                    }
+                }
                 this.include(name.substr(2) + ".h", false);
-            } else if (!name.startsWith(".")) {
+            } else if (!name.startsWith(".") && type == FileType.Header) {
                 this.include(name + "/" + name + ".h", true);
             }
-            this.out("\n");
+            return [];
         }
 
         public file(type: FileType, file: ts.SourceFile, program: ts.Program, name: string): void {
 
+            this._prefix = name.replace(/[^A-Za-z0-9_]/g, "_");
+
             if (type == FileType.Header) {
 
                 let fileName = name.replace("/", "_").toLocaleUpperCase();
@@ -2044,15 +3942,33 @@ export namespace CC {
                 this.include(this._options.lib + "/" + this._options.lib + ".h", true);
                 this.includeFile(file, program);
 
+                let forwards: string[] = [];
+
+                for (let st of file.statements) {
+                    if (ts.isImportDeclaration(st)) {
+                        forwards = forwards.concat(this.import(st, program));
+                    }
+                }
+
                 this.out("\n");
 
                 let v = this;
                 let checker = program.getTypeChecker();
+                let generics: GenericDeclaration[] = [];
 
                 if (this._options.namespace !== undefined) {
                     this.namespaceStart(this._options.namespace);
                 }
 
+                for (let forward of forwards) {
+                    this.level();
+                    this.out("class " + forward + ";\n");
+                }
+
+                if (forwards.length > 0) {
+                    this.out("\n");
+                }
+
                 function each(node: ts.Node): void {
                     if (ts.isModuleDeclaration(node)) {
 
@@ -2064,15 +3980,33 @@ export namespace CC {
                         v.interface(node, program);
                     } else if (ts.isClassDeclaration(node) && node.name !== undefined) {
                         v.class(node, program);
+                        if (isGenericDeclaration(node)) {
+                            generics.push(node);
+                        }
                     } else if (ts.isFunctionDeclaration(node) && node.name !== undefined) {
                         v.function(node, program);
-                    } else if (ts.isImportDeclaration(node)) {
-                        v.import(node, program);
+                        if (isGenericDeclaration(node)) {
+                            generics.push(node);
+                        }
+                    } else if (ts.isEnumDeclaration(node)) {
+                        v.enumDeclaration(node, program);
+                    } else if (ts.isVariableStatement(node)) {
+                        v.constants(node, program);
                     }
                 }
 
                 ts.forEachChild(file, each);
 
+                for (let node of generics) {
+                    if (ts.isClassDeclaration(node)) {
+                        this.implementClosure(node, program, node);
+                        this.implementClass(node, program);
+                    } else if (ts.isFunctionDeclaration(node)) {
+                        this.implementClosure(node, program, undefined);
+                        this.implementFunction(node, program);
+                    }
+                }
+
                 if (this._options.namespace !== undefined) {
                     this.namespaceEnd();
                 }
@@ -2083,6 +4017,12 @@ export namespace CC {
 
                 this.include(name + ".h");
 
+                for (let st of file.statements) {
+                    if (ts.isImportDeclaration(st)) {
+                        this.import(st, program, FileType.Source);
+                    }
+                }
+
                 this.out("\n");
 
                 let v = this;
@@ -2097,12 +4037,18 @@ export namespace CC {
                         if (node.body !== undefined) {
                             ts.forEachChild(node.body, each);
                         }
+                    } else if (isGenericDeclaration(node)) {
+                        return;
                     } else if (ts.isClassDeclaration(node) && node.name !== undefined) {
                         v.implementClosure(node, program, node);
                         v.implementClass(node, program);
                     } else if (ts.isFunctionDeclaration(node) && node.name !== undefined) {
                         v.implementClosure(node, program, undefined);
                         v.implementFunction(node, program);
+                    } else if (ts.isEnumDeclaration(node)) {
+                        v.implementEnum(node, program);
+                    } else if (ts.isVariableStatement(node)) {
+                        v.implementConstants(node, program);
                     }
                 }
 
@@ -10,11 +10,17 @@ Object.defineProperty(exports, "__esModule", { value: true });
 const ts = __importStar(require("typescript"));
 const fs = __importStar(require("fs"));
 const path = __importStar(require("path"));
-const CCompiler_1 = require("./CCompiler");
-function compile(stconfig) {
+const crypto = __importStar(require("crypto"));
+const { CC } = require("./CCompiler");
+function hash(text) {
+    return crypto.createHash("sha1").update(text).digest("hex");
+}
+function readConfig(stconfig) {
     console.info(stconfig);
-    let data = ts.readConfigFile(stconfig, (path) => {
-        return fs.readFileSync(path, { encoding: 'utf8' });
+    let data = ts.readConfigFile(stconfig, (path)=>{
+        return fs.readFileSync(path, {
+            encoding: 'utf8'
+        });
     });
     if (data.error !== undefined) {
         throw new Error(data.error.messageText);
@@ -23,7 +29,7 @@ function compile(stconfig) {
     let files = [];
     let basedir = path.dirname(stconfig);
     if (config.files !== undefined) {
-        for (let p of config.files) {
+        for (let p of config.files){
             files.push(path.normalize(path.join(basedir, p)));
         }
     }
@@ -31,44 +37,251 @@ function compile(stconfig) {
     if (options.lib === undefined) {
         options.lib = "kk";
     }
-    let program = ts.createProgram(files, config.compilerOptions);
-    for (let file of program.getSourceFiles()) {
+    let cachedir = basedir;
+    if (options.outDir !== undefined) {
+        cachedir = path.normalize(path.join(basedir, options.outDir));
+    }
+    return {
+        basedir: basedir,
+        files: files,
+        options: options,
+        compilerOptions: ts.convertCompilerOptionsFromJson(config.compilerOptions || {}, basedir).options,
+        cachedir: cachedir
+    };
+}
+function incrementalOptions(config) {
+    let compilerOptions = Object.assign({}, config.compilerOptions);
+    compilerOptions.incremental = true;
+    compilerOptions.tsBuildInfoFile = path.join(config.cachedir, ".kk.tsbuildinfo");
+    return compilerOptions;
+}
+class Output {
+    _path;
+    _stream;
+    _hash;
+    constructor(p){
+        this._path = p;
+        this._stream = fs.createWriteStream(p + ".tmp", {
+            encoding: 'utf8'
+        });
+        this._hash = crypto.createHash("sha1");
+    }
+    write(text) {
+        this._stream.write(text);
+        this._hash.update(text);
+    }
+    end() {
+        let digest = this._hash.digest("hex");
+        return new Promise((resolve, reject)=>{
+            this._stream.on("error", reject);
+            this._stream.end(()=>{
+                if (fs.existsSync(this._path) && hash(fs.readFileSync(this._path, {
+                    encoding: 'utf8'
+                })) == digest) {
+                    fs.unlinkSync(this._path + ".tmp");
+                } else {
+                    fs.renameSync(this._path + ".tmp", this._path);
+                }
+                resolve();
+            });
+        });
+    }
+}
+function writeFile(p, text) {
+    if (fs.existsSync(p) && fs.readFileSync(p, {
+        encoding: 'utf8'
+    }) == text) {
+        return;
+    }
+    fs.writeFileSync(p, text, {
+        encoding: 'utf8'
+    });
+}
+function outputFiles(config, file) {
+    let extname = path.extname(file.fileName);
+    let dirname = path.dirname(file.fileName);
+    let basename = path.basename(file.fileName, extname);
+    var outdir = dirname;
+    if (config.options.outDir !== undefined) {
+        outdir = path.normalize(path.join(config.basedir, config.options.outDir));
+    }
+    return [
+        path.join(outdir, basename + ".h"),
+        path.join(outdir, basename + ".cc")
+    ];
+}
+function emitFile(config, file, program) {
+    let extname = path.extname(file.fileName);
+    let dirname = path.dirname(file.fileName);
+    let basename = path.basename(file.fileName, extname);
+    let name = path.relative(config.basedir, path.join(dirname, basename));
+    let outs = outputFiles(config, file);
+    console.info(file.fileName, ">>", path.dirname(outs[0]));
+    let header = new Output(outs[0]);
+    new CC.Compiler(config.options, (text)=>{
+        header.write(text);
+    }).file(CC.FileType.Header, file, program, name);
+    let source = new Output(outs[1]);
+    new CC.Compiler(config.options, (text)=>{
+        source.write(text);
+    }).file(CC.FileType.Source, file, program, name);
+    return Promise.all([
+        header.end(),
+        source.end()
+    ]).then(()=>{});
+}
+function emitFiles(config, files, program) {
+    var p = Promise.resolve();
+    for (let file of files){
+        p = p.then(()=>emitFile(config, file, program));
+    }
+    return p;
+}
+function emitBuildFiles(config, program) {
+    if (!config.options.unity && !config.options.pch) {
+        return;
+    }
+    var sources = program.getSourceFiles().filter((file)=>!file.isDeclarationFile).map((file)=>path.relative(config.cachedir, outputFiles(config, file)[1]).split(path.sep).join("/")).sort();
+    let n = Math.min(config.options.unity || 0, sources.length);
+    if (n > 0) {
+        let units = [];
+        let size = Math.ceil(sources.length / n);
+        for(let i = 0; i < n; i++){
+            let name = "kk.unity." + i + ".cc";
+            let text = sources.slice(i * size, (i + 1) * size).map((v)=>"#include \"" + v + "\"\n").join("");
+            writeFile(path.join(config.cachedir, name), text);
+            units.push(name);
+        }
+        for(let i = n; fs.existsSync(path.join(config.cachedir, "kk.unity." + i + ".cc")); i++){
+            fs.unlinkSync(path.join(config.cachedir, "kk.unity." + i + ".cc"));
+        }
+        sources = units;
+    }
+    let lines = [
+        "# Generated by the kk compiler, do not edit.",
+        "",
+        "set(KK_SOURCES"
+    ];
+    for (let v of sources){
+        lines.push("    ${CMAKE_CURRENT_LIST_DIR}/" + v);
+    }
+    lines.push(")");
+    if (config.options.pch) {
+        lines.push("");
+        lines.push("set(KK_PRECOMPILE_HEADERS <" + config.options.lib + "/" + config.options.lib + ".h>)");
+    }
+    writeFile(path.join(config.cachedir, "kk.cmake"), lines.join("\n") + "\n");
+}
+function readCache(config) {
+    let p = path.join(config.cachedir, ".kk.cache.json");
+    if (fs.existsSync(p)) {
+        try {
+            return JSON.parse(fs.readFileSync(p, {
+                encoding: 'utf8'
+            }));
+        } catch (e) {
+            console.info("[cache]", p, e);
+        }
+    }
+    return {
+        hierarchy: "",
+        files: {}
+    };
+}
+function build(config, builder) {
+    let program = builder.getProgram();
+    let cache = readCache(config);
+    let affected = new Set();
+    let changed = new Set();
+    var all = false;
+    while(true){
+        let r = builder.getSemanticDiagnosticsOfNextAffectedFile();
+        if (r === undefined) {
+            break;
+        }
+        let file = r.affected;
+        if (file.kind == ts.SyntaxKind.SourceFile) {
+            affected.add(path.resolve(file.fileName));
+        } else {
+            all = true;
+        }
+    }
+    let hierarchy = CC.hierarchySignature(program);
+    let files = {};
+    if (hierarchy != cache.hierarchy) {
+        all = true;
+    }
+    for (let file of program.getSourceFiles()){
         if (file.isDeclarationFile) {
             continue;
         }
-        let extname = path.extname(file.fileName);
-        let dirname = path.dirname(file.fileName);
-        var outdir = dirname;
-        if (options.outDir !== undefined) {
-            outdir = path.normalize(path.join(basedir, options.outDir));
+        let fileName = path.resolve(file.fileName);
+        files[fileName] = hash(file.text);
+        if (cache.files[fileName] != files[fileName]) {
+            changed.add(fileName);
         }
-        console.info(file.fileName, ">>", outdir);
-        let basename = path.basename(file.fileName, extname);
-        let name = path.relative(basedir, path.join(dirname, basename));
-        {
-            let p = path.join(outdir, basename + ".h");
-            let out = [];
-            let cc = new CCompiler_1.CC.Compiler(options, (text) => {
-                out.push(text);
-            });
-            cc.file(CCompiler_1.CC.FileType.Header, file, program, name);
-            fs.writeFileSync(p, out.join(''), {
-                encoding: 'utf8'
-            });
+    }
+    let emits = [];
+    for (let file of program.getSourceFiles()){
+        if (file.isDeclarationFile) {
+            continue;
         }
-        {
-            let p = path.join(outdir, basename + ".cc");
-            let out = [];
-            let cc = new CCompiler_1.CC.Compiler(options, (text) => {
-                out.push(text);
-            });
-            cc.file(CCompiler_1.CC.FileType.Source, file, program, name);
-            fs.writeFileSync(p, out.join(''), {
-                encoding: 'utf8'
-            });
+        let fileName = path.resolve(file.fileName);
+        if (!all && !affected.has(fileName) && !changed.has(fileName) && outputFiles(config, file).every((p)=>fs.existsSync(p)) && !builder.getAllDependencies(file).some((p)=>changed.has(path.resolve(p)))) {
+            continue;
         }
+        emits.push(file);
+    }
+    console.info("[build]", emits.length, "file(s) to emit");
+    return emitFiles(config, emits, program).then(()=>{
+        emitBuildFiles(config, program);
+        builder.emitBuildInfo();
+        writeFile(path.join(config.cachedir, ".kk.cache.json"), JSON.stringify({
+            hierarchy: hierarchy,
+            files: files
+        }));
+    });
+}
+function compile(stconfig, incremental) {
+    let config = readConfig(stconfig);
+    var done;
+    if (incremental) {
+        let compilerOptions = incrementalOptions(config);
+        let host = ts.createIncrementalCompilerHost(compilerOptions);
+        let old = ts.readBuilderProgram(compilerOptions, host);
+        done = build(config, ts.createEmitAndSemanticDiagnosticsBuilderProgram(config.files, compilerOptions, host, old));
+    } else {
+        let program = ts.createProgram(config.files, config.compilerOptions);
+        done = emitFiles(config, program.getSourceFiles().filter((file)=>!file.isDeclarationFile), program).then(()=>{
+            emitBuildFiles(config, program);
+        });
     }
-    process.exit();
+    done.then(()=>{
+        process.exit();
+    }, (e)=>{
+        console.error(e);
+        process.exit(1);
+    });
+}
+function watch(stconfig) {
+    let config = readConfig(stconfig);
+    let host = ts.createWatchCompilerHost(config.files, incrementalOptions(config), ts.sys, ts.createEmitAndSemanticDiagnosticsBuilderProgram, (diagnostic)=>{
+        console.info(ts.flattenDiagnosticMessageText(diagnostic.messageText, "\n"));
+    }, (diagnostic)=>{
+        console.info("[watch]", ts.flattenDiagnosticMessageText(diagnostic.messageText, "\n"));
+    });
+    host.afterProgramCreate = (builder)=>{
+        build(config, builder).catch((e)=>{
+            console.error(e);
+        });
+    };
+    ts.createWatchProgram(host);
+}
+let args = process.argv.slice(2);
+let stconfig = args.filter((v)=>!v.startsWith("--"))[0];
+if (args.indexOf("--watch") >= 0) {
+    watch(stconfig);
+} else {
+    compile(stconfig, args.indexOf("--incremental") >= 0);
 }
-compile(process.argv[2]);
 //# sourceMappingURL=main.js.map
\ No newline at end of file
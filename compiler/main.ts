@@ -1,11 +1,27 @@
-
 import * as ts from "typescript";
 import * as fs from "fs";
 import * as path from "path";
+import * as crypto from "crypto";
 import { CC } from "./CCompiler";
 
+interface Config {
+  basedir: string
+  files: string[]
+  options: CC.Options
+  compilerOptions: ts.CompilerOptions
+  cachedir: string
+}
+
+interface Cache {
+  hierarchy: string
+  files: { [fileName: string]: string }
+}
+
+function hash(text: string): string {
+  return crypto.createHash("sha1").update(text).digest("hex");
+}
 
-function compile(stconfig: string): void {
+function readConfig(stconfig: string): Config {
 
   console.info(stconfig);
 
@@ -34,52 +50,301 @@ function compile(stconfig: string): void {
     options.lib = "kk";
   }
 
-  let program = ts.createProgram(files, config.compilerOptions);
+  let cachedir = basedir;
 
-  for (let file of program.getSourceFiles()) {
+  if (options.outDir !== undefined) {
+    cachedir = path.normalize(path.join(basedir, options.outDir));
+  }
+
+  return {
+    basedir: basedir,
+    files: files,
+    options: options,
+    compilerOptions: ts.convertCompilerOptionsFromJson(config.compilerOptions || {}, basedir).options,
+    cachedir: cachedir
+  };
+}
+
+function incrementalOptions(config: Config): ts.CompilerOptions {
+
+  let compilerOptions = Object.assign({}, config.compilerOptions);
+
+  compilerOptions.incremental = true;
+  compilerOptions.tsBuildInfoFile = path.join(config.cachedir, ".kk.tsbuildinfo");
+
+  return compilerOptions;
+}
 
+class Output {
+
+  private _path: string;
+  private _stream: fs.WriteStream;
+  private _hash: crypto.Hash;
+
+  constructor(p: string) {
+    this._path = p;
+    this._stream = fs.createWriteStream(p + ".tmp", { encoding: 'utf8' });
+    this._hash = crypto.createHash("sha1");
+  }
+
+  public write(text: string): void {
+    this._stream.write(text);
+    this._hash.update(text);
+  }
+
+  public end(): Promise<void> {
+    let digest = this._hash.digest("hex");
+    return new Promise<void>((resolve, reject): void => {
+      this._stream.on("error", reject);
+      this._stream.end((): void => {
+        if (fs.existsSync(this._path) && hash(fs.readFileSync(this._path, { encoding: 'utf8' })) == digest) {
+          fs.unlinkSync(this._path + ".tmp");
+        } else {
+          fs.renameSync(this._path + ".tmp", this._path);
+        }
+        resolve();
+      });
+    });
+  }
+}
+
+function writeFile(p: string, text: string): void {
+
+  if (fs.existsSync(p) && fs.readFileSync(p, { encoding: 'utf8' }) == text) {
+    return;
+  }
+
+  fs.writeFileSync(p, text, {
+    encoding: 'utf8'
+  });
+}
+
+function outputFiles(config: Config, file: ts.SourceFile): string[] {
+
+  let extname = path.extname(file.fileName);
+  let dirname = path.dirname(file.fileName);
+  let basename = path.basename(file.fileName, extname);
+  var outdir = dirname;
+
+  if (config.options.outDir !== undefined) {
+    outdir = path.normalize(path.join(config.basedir, config.options.outDir));
+  }
+
+  return [path.join(outdir, basename + ".h"), path.join(outdir, basename + ".cc")];
+}
+
+function emitFile(config: Config, file: ts.SourceFile, program: ts.Program): Promise<void> {
+
+  let extname = path.extname(file.fileName);
+  let dirname = path.dirname(file.fileName);
+  let basename = path.basename(file.fileName, extname);
+  let name = path.relative(config.basedir, path.join(dirname, basename));
+  let outs = outputFiles(config, file);
+
+  console.info(file.fileName, ">>", path.dirname(outs[0]));
+
+  let header = new Output(outs[0]);
+  new CC.Compiler(config.options, (text: string): void => {
+    header.write(text);
+  }).file(CC.FileType.Header, file, program, name);
+
+  let source = new Output(outs[1]);
+  new CC.Compiler(config.options, (text: string): void => {
+    source.write(text);
+  }).file(CC.FileType.Source, file, program, name);
+
+  return Promise.all([header.end(), source.end()]).then((): void => { });
+}
+
+function emitFiles(config: Config, files: ts.SourceFile[], program: ts.Program): Promise<void> {
+
+  var p = Promise.resolve();
+
+  for (let file of files) {
+    p = p.then((): Promise<void> => emitFile(config, file, program));
+  }
+
+  return p;
+}
+
+function emitBuildFiles(config: Config, program: ts.Program): void {
+
+  if (!config.options.unity && !config.options.pch) {
+    return;
+  }
+
+  var sources = program.getSourceFiles()
+    .filter((file: ts.SourceFile): boolean => !file.isDeclarationFile)
+    .map((file: ts.SourceFile): string => path.relative(config.cachedir, outputFiles(config, file)[1]).split(path.sep).join("/"))
+    .sort();
+
+  let n = Math.min(config.options.unity || 0, sources.length);
+
+  if (n > 0) {
+    let units: string[] = [];
+    let size = Math.ceil(sources.length / n);
+    for (let i = 0; i < n; i++) {
+      let name = "kk.unity." + i + ".cc";
+      let text = sources.slice(i * size, (i + 1) * size).map((v: string): string => "#include \"" + v + "\"\n").join("");
+      writeFile(path.join(config.cachedir, name), text);
+      units.push(name);
+    }
+    for (let i = n; fs.existsSync(path.join(config.cachedir, "kk.unity." + i + ".cc")); i++) {
+      fs.unlinkSync(path.join(config.cachedir, "kk.unity." + i + ".cc"));
+    }
+    sources = units;
+  }
+
+  let lines = ["# Generated by the kk compiler, do not edit.", "", "set(KK_SOURCES"];
+
+  for (let v of sources) {
+    lines.push("    ${CMAKE_CURRENT_LIST_DIR}/" + v);
+  }
+
+  lines.push(")");
+
+  if (config.options.pch) {
+    lines.push("");
+    lines.push("set(KK_PRECOMPILE_HEADERS <" + config.options.lib + "/" + config.options.lib + ".h>)");
+  }
+
+  writeFile(path.join(config.cachedir, "kk.cmake"), lines.join("\n") + "\n");
+}
+
+function readCache(config: Config): Cache {
+
+  let p = path.join(config.cachedir, ".kk.cache.json");
+
+  if (fs.existsSync(p)) {
+    try {
+      return JSON.parse(fs.readFileSync(p, { encoding: 'utf8' })) as Cache;
+    } catch (e) {
+      console.info("[cache]", p, e);
+    }
+  }
+
+  return { hierarchy: "", files: {} };
+}
+
+function build(config: Config, builder: ts.EmitAndSemanticDiagnosticsBuilderProgram): Promise<void> {
+
+  let program = builder.getProgram();
+  let cache = readCache(config);
+  let affected = new Set<string>();
+  let changed = new Set<string>();
+  var all = false;
+
+  while (true) {
+    let r = builder.getSemanticDiagnosticsOfNextAffectedFile();
+    if (r === undefined) {
+      break;
+    }
+    let file = r.affected as ts.SourceFile;
+    if (file.kind == ts.SyntaxKind.SourceFile) {
+      affected.add(path.resolve(file.fileName));
+    } else {
+      all = true;
+    }
+  }
+
+  let hierarchy = CC.hierarchySignature(program);
+  let files: { [fileName: string]: string } = {};
+
+  if (hierarchy != cache.hierarchy) {
+    all = true;
+  }
+
+  for (let file of program.getSourceFiles()) {
     if (file.isDeclarationFile) {
       continue;
     }
-
-    let extname = path.extname(file.fileName);
-    let dirname = path.dirname(file.fileName);
-    var outdir = dirname;
-    if (options.outDir !== undefined) {
-      outdir = path.normalize(path.join(basedir, options.outDir));
+    let fileName = path.resolve(file.fileName);
+    files[fileName] = hash(file.text);
+    if (cache.files[fileName] != files[fileName]) {
+      changed.add(fileName);
     }
+  }
 
-    console.info(file.fileName, ">>", outdir);
+  let emits: ts.SourceFile[] = [];
 
-    let basename = path.basename(file.fileName, extname);
-    let name = path.relative(basedir, path.join(dirname, basename));
-    {
-      let p = path.join(outdir, basename + ".h");
-      let out: string[] = [];
-      let cc = new CC.Compiler(options, (text: string): void => {
-        out.push(text);
-      });
-      cc.file(CC.FileType.Header, file, program, name);
+  for (let file of program.getSourceFiles()) {
 
-      fs.writeFileSync(p, out.join(''), {
-        encoding: 'utf8'
-      });
+    if (file.isDeclarationFile) {
+      continue;
     }
-    {
-      let p = path.join(outdir, basename + ".cc");
-      let out: string[] = [];
-      let cc = new CC.Compiler(options, (text: string): void => {
-        out.push(text);
-      });
-      cc.file(CC.FileType.Source, file, program, name);
-      fs.writeFileSync(p, out.join(''), {
-        encoding: 'utf8'
-      });
+
+    let fileName = path.resolve(file.fileName);
+
+    if (!all && !affected.has(fileName) && !changed.has(fileName)
+      && outputFiles(config, file).every((p: string): boolean => fs.existsSync(p))
+      && !builder.getAllDependencies(file).some((p: string): boolean => changed.has(path.resolve(p)))) {
+      continue;
     }
 
+    emits.push(file);
+  }
+
+  console.info("[build]", emits.length, "file(s) to emit");
+
+  return emitFiles(config, emits, program).then((): void => {
+    emitBuildFiles(config, program);
+    builder.emitBuildInfo();
+    writeFile(path.join(config.cachedir, ".kk.cache.json"), JSON.stringify({ hierarchy: hierarchy, files: files }));
+  });
+}
+
+function compile(stconfig: string, incremental: boolean): void {
+
+  let config = readConfig(stconfig);
+  var done: Promise<void>;
+
+  if (incremental) {
+    let compilerOptions = incrementalOptions(config);
+    let host = ts.createIncrementalCompilerHost(compilerOptions);
+    let old = ts.readBuilderProgram(compilerOptions, host);
+    done = build(config, ts.createEmitAndSemanticDiagnosticsBuilderProgram(config.files, compilerOptions, host, old));
+  } else {
+    let program = ts.createProgram(config.files, config.compilerOptions);
+    done = emitFiles(config, program.getSourceFiles().filter((file: ts.SourceFile): boolean => !file.isDeclarationFile), program).then((): void => {
+      emitBuildFiles(config, program);
+    });
   }
 
-  process.exit();
+  done.then((): void => {
+    process.exit();
+  }, (e: Error): void => {
+    console.error(e);
+    process.exit(1);
+  });
+}
+
+function watch(stconfig: string): void {
+
+  let config = readConfig(stconfig);
+
+  let host = ts.createWatchCompilerHost(config.files, incrementalOptions(config), ts.sys,
+    ts.createEmitAndSemanticDiagnosticsBuilderProgram,
+    (diagnostic: ts.Diagnostic): void => {
+      console.info(ts.flattenDiagnosticMessageText(diagnostic.messageText, "\n"));
+    },
+    (diagnostic: ts.Diagnostic): void => {
+      console.info("[watch]", ts.flattenDiagnosticMessageText(diagnostic.messageText, "\n"));
+    });
+
+  host.afterProgramCreate = (builder: ts.EmitAndSemanticDiagnosticsBuilderProgram): void => {
+    build(config, builder).catch((e: Error): void => {
+      console.error(e);
+    });
+  };
+
+  ts.createWatchProgram(host);
 }
 
-compile(process.argv[2]);
+let args = process.argv.slice(2);
+let stconfig = args.filter((v: string): boolean => !v.startsWith("--"))[0];
+
+if (args.indexOf("--watch") >= 0) {
+  watch(stconfig);
+} else {
+  compile(stconfig, args.indexOf("--incremental") >= 0);
+}
@@ -5,7 +5,6 @@
 
 namespace demo {
 
-
 	class IDemo {
 	public:
 		virtual kk::String title() = 0;
@@ -18,13 +17,13 @@ namespace demo {
 		virtual void setParent(IDemo * v) = 0;
 		virtual kk::Closure<kk::String,kk::String> * ondone() = 0;
 		virtual void setOndone(kk::Closure<kk::String,kk::String> * v) = 0;
-		virtual kk::String exec(kk::String name) = 0;
+		virtual kk::String exec(const kk::String &name) = 0;
 	};
 
-	class Demo:public kk::Object,public IDemo {
+	class Demo final:public kk::Object,public IDemo {
 	public: 
-		virtual IDemo * parent();
-		virtual void setParent(IDemo * v);
+		virtual IDemo * parent() { return this->_parent; }
+		virtual void setParent(IDemo * v) { this->_parent = v; }
 	protected:
 		kk::Weak<IDemo *> _parent;
 
@@ -32,40 +31,40 @@ namespace demo {
 		kk::String _title;
 
 	private: 
-		kk::Number _version;
+		kk::Int32 _version;
 
 	public: 
-		virtual kk::Map<kk::String,kk::String> &propertys();
-		virtual void setPropertys(kk::Map<kk::String,kk::String> &v);
+		virtual kk::Map<kk::String,kk::String> &propertys() { return this->_propertys; }
+		virtual void setPropertys(kk::Map<kk::String,kk::String> &v) { this->_propertys = v; }
 	protected:
 		kk::Map<kk::String,kk::String> _propertys;
 
 	public: 
-		virtual kk::String title();
+		virtual kk::String title() { return this->_title; }
 	public: 
-		virtual kk::Int version();
+		virtual kk::Int version() { return this->_version; }
 	public: 
-		virtual kk::Boolean output();
-		virtual void setOutput(kk::Boolean v);
+		virtual kk::Boolean output() { return this->_output; }
+		virtual void setOutput(kk::Boolean v) { this->_output = v; }
 	protected:
 		kk::Boolean _output;
 
 	public: 
-		virtual kk::Closure<kk::String,kk::String> * ondone();
-		virtual void setOndone(kk::Closure<kk::String,kk::String> * v);
+		virtual kk::Closure<kk::String,kk::String> * ondone() { return this->_ondone; }
+		virtual void setOndone(kk::Closure<kk::String,kk::String> * v) { this->_ondone = v; }
 	protected:
 		kk::Strong<kk::Closure<kk::String,kk::String> *> _ondone;
 
 	public: 
-		virtual kk::String exec(kk::String name);
+		virtual kk::String exec(const kk::String &name);
 	public: 
-		virtual kk::String done(kk::String name);
+		kk::String done(const kk::String &name);
 	public:
 		Demo(kk::String title,kk::Int version);
 
 	};
 
-	IDemo * createDemo(kk::String title,kk::Int version);
+	IDemo * createDemo(const kk::String &title,kk::Int version);
 
 }
 
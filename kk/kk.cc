@@ -1,285 +1,834 @@
 
 #include "kk.h"
 #include <pthread.h>
-#include <queue>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <deque>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KK_SIMD_X86
+#define KK_SSE2 __attribute__((target("sse2")))
+#define KK_AVX2 __attribute__((target("avx2")))
+#endif
 
 namespace kk
 {
 
-_Object::_Object() : _retainCount(0)
+WeakObject::WeakObject(IObject *object) : _object(object), _retainCount(1)
 {
 }
 
-_Object::~_Object()
+/*
+ * Returns the object retained, or null once it has been released to zero.
+ * The epoch pin keeps a retired object alive between the load and the
+ * retain; a retired object keeps a negative count, so the retain is undone.
+ */
+IObject *WeakObject::get()
 {
-
     Atomic *a = atomic();
 
-    if (a != nullptr)
-    {
-        a->lock();
-    }
+    a->lock();
 
-    std::set<IObject **>::iterator i = _weakObjects.begin();
+    IObject *v = _object.load(std::memory_order_acquire);
 
-    while (i != _weakObjects.end())
+    if (v != nullptr)
     {
-        IObject **v = *i;
-        if (v)
+        v->retain();
+        if (v->retainCount() <= 0)
         {
-            *v = NULL;
+            v->release();
+            v = nullptr;
         }
-        i++;
     }
 
-    if (a != nullptr)
+    a->unlock();
+
+    return v;
+}
+
+void WeakObject::retain()
+{
+    _retainCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WeakObject::release()
+{
+    if (_retainCount.fetch_sub(1, std::memory_order_release) == 1)
     {
-        a->unlock();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        delete this;
     }
 }
 
-void _Object::release()
+void WeakObject::clear()
 {
-    Atomic *a = atomic();
-    if (a != nullptr)
+    _object.store(nullptr, std::memory_order_release);
+}
+
+_Object::_Object() : _retainCount(0), _weakObject(nullptr)
+{
+}
+
+_Object::~_Object()
+{
+    WeakObject *v = _weakObject.load(std::memory_order_acquire);
+
+    if (v != nullptr)
     {
-        a->lock();
+        v->clear();
+        v->release();
     }
-    _retainCount--;
-    if (_retainCount == 0)
+}
+
+#define KK_OBJECT_RETIRED (-0x40000000)
+
+void _Object::release()
+{
+    if (_retainCount.fetch_sub(1, std::memory_order_release) == 1)
     {
-        if (a != nullptr)
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        /* A weak reader may have revived the object; only one release retires it. */
+        int n = 0;
+
+        if (!_retainCount.compare_exchange_strong(n, KK_OBJECT_RETIRED, std::memory_order_acq_rel))
         {
-            a->addObject(this);
+            return;
         }
-        else
+
+        WeakObject *v = _weakObject.load(std::memory_order_acquire);
+        Atomic *a = atomic();
+
+        /* Without a weak reference no reader can reach the object any more. */
+        if (v == nullptr || a == nullptr)
         {
             delete this;
+            return;
         }
-    }
-    if (a != nullptr)
-    {
+
+        v->clear();
+
+        /* unlock() frees it right away unless a weak reader is still pinned. */
+        a->lock();
+        a->addObject(this);
         a->unlock();
     }
 }
 
 void _Object::retain()
 {
-    Atomic *a = atomic();
-    if (a != nullptr)
-    {
-        a->lock();
-    }
-    _retainCount++;
-    if (a != nullptr)
-    {
-        a->unlock();
-    }
+    _retainCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void _Object::unretain()
+{
+    _retainCount.fetch_sub(1, std::memory_order_release);
 }
 
 int _Object::retainCount()
 {
-    return _retainCount;
+    return _retainCount.load(std::memory_order_acquire);
 }
 
-void _Object::weak(IObject **ptr)
+WeakObject *_Object::weakObject()
 {
-    Atomic *a = atomic();
-    if (a != nullptr)
-    {
-        a->lock();
-    }
-    _weakObjects.insert(ptr);
-    if (a != nullptr)
+    WeakObject *v = _weakObject.load(std::memory_order_acquire);
+
+    if (v == nullptr)
     {
-        a->unlock();
+        WeakObject *n = new WeakObject(this);
+
+        if (_weakObject.compare_exchange_strong(v, n, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            v = n;
+        }
+        else
+        {
+            delete n;
+        }
     }
+
+    return v;
 }
 
-void _Object::unWeak(IObject **ptr)
+#define KK_SCOPE_PAGE_SIZE 4096
+
+class ScopePage
 {
-    Atomic *a = atomic();
-    if (a != nullptr)
+  public:
+    ScopePage(ScopePage *prev) : prev(prev), next(nullptr), top(objects)
     {
-        a->lock();
+        if (prev != nullptr)
+        {
+            prev->next = this;
+        }
     }
-    std::set<IObject **>::iterator i = _weakObjects.find(ptr);
-    if (i != _weakObjects.end())
+
+    bool empty()
     {
-        _weakObjects.erase(i);
+        return top == objects;
     }
-    if (a != nullptr)
+
+    bool full()
     {
-        a->unlock();
+        return top == objects + sizeof(objects) / sizeof(IObject *);
     }
-}
 
-static pthread_key_t kScopeCurrent = 0;
+    ScopePage *prev;
+    ScopePage *next;
+    IObject **top;
+    IObject *objects[(KK_SCOPE_PAGE_SIZE - 3 * sizeof(void *)) / sizeof(IObject *)];
+};
 
-Scope::Scope() : _parent(Scope::current())
-{
-    pthread_setspecific(kScopeCurrent, this);
-}
+#define KK_ARENA_PAGE_SIZE (64 * 1024)
+#define KK_ARENA_REGION_SIZE ((size_t)1 << 30)
 
-Scope::~Scope()
+/*
+ * Arena pages are carved out of one reserved address range, so telling an
+ * arena pointer from a heap pointer is a range check and the page header
+ * is found by masking the address.
+ */
+class ArenaPage
 {
-    pthread_setspecific(kScopeCurrent, _parent);
+  public:
+    static bool contains(void *p)
+    {
+        char *base = _base.load(std::memory_order_acquire);
+        return base != nullptr && (size_t)((char *)p - base) < KK_ARENA_REGION_SIZE;
+    }
 
-    std::list<IObject *>::iterator i = _objects.begin();
+    static ArenaPage *pageOf(void *p)
+    {
+        char *base = _base.load(std::memory_order_acquire);
+        return (ArenaPage *)(base + (((char *)p - base) & ~(size_t)(KK_ARENA_PAGE_SIZE - 1)));
+    }
 
-    while (i != _objects.end())
+    static ArenaPage *create()
     {
-        IObject *v = *i;
-        v->release();
-        i++;
+        ArenaPage *page = nullptr;
+
+        pthread_mutex_lock(&_lock);
+
+        if (_free != nullptr)
+        {
+            page = _free;
+            _free = page->next;
+        }
+        else
+        {
+            char *base = _base.load(std::memory_order_relaxed);
+
+            if (base == nullptr)
+            {
+                void *v = mmap(nullptr, KK_ARENA_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+                if (v != MAP_FAILED)
+                {
+                    /* Align the start of the range to the page size. */
+                    base = (char *)(((size_t)v + KK_ARENA_PAGE_SIZE - 1) & ~(size_t)(KK_ARENA_PAGE_SIZE - 1));
+                    _regionEnd = (char *)v + KK_ARENA_REGION_SIZE;
+                    _regionTop = base;
+                    _base.store(base, std::memory_order_release);
+                }
+            }
+
+            if (base != nullptr && _regionTop + KK_ARENA_PAGE_SIZE <= _regionEnd)
+            {
+                page = (ArenaPage *)_regionTop;
+                _regionTop += KK_ARENA_PAGE_SIZE;
+            }
+        }
+
+        pthread_mutex_unlock(&_lock);
+
+        if (page != nullptr)
+        {
+            new (page) ArenaPage();
+        }
+
+        return page;
     }
-}
 
-Scope *Scope::parent()
-{
-    return _parent;
-}
+    void *alloc(size_t size)
+    {
+        if (_top + size > (char *)this + KK_ARENA_PAGE_SIZE)
+        {
+            return nullptr;
+        }
+        void *v = _top;
+        _top += size;
+        _live.fetch_add(1, std::memory_order_seq_cst);
+        return v;
+    }
 
-void Scope::addObject(IObject *object)
-{
-    _objects.push_back(object);
-    object->retain();
-}
+    void free()
+    {
+        if (_live.fetch_sub(1, std::memory_order_seq_cst) == 1 && _detached.load(std::memory_order_seq_cst))
+        {
+            recycle();
+        }
+    }
 
-Scope *Scope::current()
-{
-    static pthread_key_t v = 0;
-    if (v == 0)
+    /*
+     * Called when the owning arena goes away. Pages that still hold live
+     * objects are recycled by the last ArenaPage::free() instead.
+     */
+    void detach()
     {
-        pthread_key_create(&v, nullptr);
+        _detached.store(true, std::memory_order_seq_cst);
+        if (_live.load(std::memory_order_seq_cst) == 0)
+        {
+            recycle();
+        }
     }
-    return (Scope *)pthread_getspecific(v);
-}
 
-_Ref::_Ref() : _object(nullptr)
-{
-}
+    ArenaPage *next;
 
-IObject *_Ref::get()
-{
-    return _object;
-}
+  private:
+    ArenaPage() : next(nullptr), _top((char *)this + ((sizeof(ArenaPage) + 15) & ~(size_t)15)), _live(0), _detached(false), _recycled(false) {}
 
-_Weak::_Weak() : _Ref()
-{
-}
+    void recycle()
+    {
+        if (_recycled.exchange(true, std::memory_order_acq_rel))
+        {
+            return;
+        }
+        pthread_mutex_lock(&_lock);
+        next = _free;
+        _free = this;
+        pthread_mutex_unlock(&_lock);
+    }
 
-_Weak::_Weak(IObject *object) : _Ref()
-{
-    set(object);
-}
+    char *_top;
+    std::atomic<int> _live;
+    std::atomic<bool> _detached;
+    std::atomic<bool> _recycled;
 
-void _Weak::set(IObject *object)
+    static std::atomic<char *> _base;
+    static char *_regionTop;
+    static char *_regionEnd;
+    static ArenaPage *_free;
+    static pthread_mutex_t _lock;
+};
+
+std::atomic<char *> ArenaPage::_base(nullptr);
+char *ArenaPage::_regionTop = nullptr;
+char *ArenaPage::_regionEnd = nullptr;
+ArenaPage *ArenaPage::_free = nullptr;
+pthread_mutex_t ArenaPage::_lock = PTHREAD_MUTEX_INITIALIZER;
+
+class ScopeArena
 {
-    if (_object != nullptr)
+  public:
+    ScopeArena(ScopeArena *parent) : parent(parent), _page(nullptr)
     {
-        _object->unWeak(&_object);
     }
-    if (object != nullptr)
+
+    ~ScopeArena()
     {
-        object->weak(&_object);
+        ArenaPage *p = _page;
+        while (p != nullptr)
+        {
+            ArenaPage *n = p->next;
+            p->detach();
+            p = n;
+        }
     }
-    _object = object;
-}
 
-_Strong::_Strong() : _Ref()
-{
-}
+    void *alloc(size_t size)
+    {
+        size = (size + 15) & ~(size_t)15;
 
-_Strong::_Strong(IObject *object) : _Ref()
-{
-    set(object);
-}
+        if (size > KK_ARENA_PAGE_SIZE / 4)
+        {
+            return nullptr;
+        }
 
-void _Strong::set(IObject *object)
+        void *v = _page != nullptr ? _page->alloc(size) : nullptr;
+
+        if (v == nullptr)
+        {
+            ArenaPage *page = ArenaPage::create();
+            if (page == nullptr)
+            {
+                return nullptr;
+            }
+            page->next = _page;
+            _page = page;
+            v = page->alloc(size);
+        }
+
+        return v;
+    }
+
+    ScopeArena *parent;
+
+  private:
+    ArenaPage *_page;
+};
+
+class ScopePool
 {
-    if (object != nullptr)
+  public:
+    ScopePool() : current(nullptr), arena(nullptr), _hot(new ScopePage(nullptr))
     {
-        object->retain();
     }
-    if (_object != nullptr)
+
+    ~ScopePool()
     {
-        _object->release();
+        ScopePage *p = _hot;
+
+        while (p->prev != nullptr)
+        {
+            p = p->prev;
+        }
+
+        while (p != nullptr)
+        {
+            ScopePage *n = p->next;
+            delete p;
+            p = n;
+        }
     }
-    _object = object;
-}
 
-_Closure::_Closure() : _func(nullptr)
+    void push(IObject *object)
+    {
+        if (_hot->full())
+        {
+            _hot = _hot->next != nullptr ? _hot->next : new ScopePage(_hot);
+        }
+        *_hot->top++ = object;
+    }
+
+    void mark(ScopePage **page, IObject ***top)
+    {
+        *page = _hot;
+        *top = _hot->top;
+    }
+
+    /*
+     * Releases every object pushed after (page, top), newest first. The
+     * hot page is re-read on each step because a release may run
+     * destructors that push into the pool again.
+     */
+    void popTo(ScopePage *page, IObject **top)
+    {
+        for (;;)
+        {
+            ScopePage *p = _hot;
+
+            if (p->empty())
+            {
+                if (p == page || p->prev == nullptr)
+                {
+                    break;
+                }
+                _hot = p->prev;
+                continue;
+            }
+
+            if (p == page && p->top <= top)
+            {
+                break;
+            }
+
+            IObject *v = *--p->top;
+            v->release();
+        }
+
+        ScopePage *spare = _hot->next;
+
+        if (spare != nullptr && spare->next != nullptr)
+        {
+            ScopePage *p = spare->next;
+            spare->next = nullptr;
+            while (p != nullptr)
+            {
+                ScopePage *n = p->next;
+                delete p;
+                p = n;
+            }
+        }
+    }
+
+    Scope *current;
+    ScopeArena *arena;
+
+  private:
+    ScopePage *_hot;
+};
+
+static pthread_key_t kScopeKey;
+static pthread_once_t kScopeOnce = PTHREAD_ONCE_INIT;
+
+static void ScopePoolDealloc(void *v)
 {
+    delete (ScopePool *)v;
 }
 
-_Closure::_Closure(Func func) : _func(func)
+static void ScopeKeyCreate()
 {
+    pthread_key_create(&kScopeKey, ScopePoolDealloc);
 }
 
-_Closure::~_Closure()
+static ScopePool *ScopePoolGet(bool create)
 {
+    pthread_once(&kScopeOnce, ScopeKeyCreate);
 
-    std::map<std::string, Any>::iterator i = _locals.begin();
+    ScopePool *v = (ScopePool *)pthread_getspecific(kScopeKey);
 
-    while (i != _locals.end())
+    if (v == nullptr && create)
     {
-        i->second.release();
-        i++;
+        v = new ScopePool();
+        pthread_setspecific(kScopeKey, v);
     }
+
+    return v;
 }
 
-Any _Closure::get(const char *name)
+Scope::Scope() : _arena(nullptr)
 {
-    std::map<std::string, Any>::iterator i = _locals.find(name);
-    if (i != _locals.end())
-    {
-        return i->second;
-    }
-    return Any::Nil;
+    ScopePool *pool = ScopePoolGet(true);
+    _parent = pool->current;
+    pool->mark(&_page, &_top);
+    pool->current = this;
 }
 
-void _Closure::set(const char *name, Any value)
+Scope::Scope(Boolean arena) : _arena(nullptr)
 {
-    std::map<std::string, Any>::iterator i = _locals.find(name);
-    if (i == _locals.end())
+    ScopePool *pool = ScopePoolGet(true);
+    _parent = pool->current;
+    pool->mark(&_page, &_top);
+    pool->current = this;
+    if (arena)
     {
-        _locals[name] = value;
-        value.retain();
+        _arena = new ScopeArena(pool->arena);
+        pool->arena = _arena;
     }
 }
 
-Func _Closure::func()
+Scope::~Scope()
 {
-    return _func;
-}
+    drain();
 
-Any::Any() : _type(TypeNil), _objectValue(nullptr)
-{
-}
+    ScopePool *pool = ScopePoolGet(true);
+    pool->current = _parent;
 
-Any::Any(const Any &v) : _type(v._type), _objectValue(v._objectValue), _stringValue(v._stringValue)
-{
+    if (_arena != nullptr)
+    {
+        pool->arena = _arena->parent;
+        delete _arena;
+    }
 }
 
-Any::Any(const String &v) : _type(TypeString), _stringValue(v), _objectValue(nullptr)
+Scope *Scope::parent()
 {
+    return _parent;
 }
 
-Any::Any(const char *v) : _type(TypeString), _stringValue(v), _objectValue(nullptr)
+void Scope::addObject(IObject *object)
 {
+    object->retain();
+    adoptObject(object);
 }
 
-Any::Any(Int32 v) : _type(TypeInt32), _int32Value(v)
+void Scope::adoptObject(IObject *object)
 {
+    ScopePool *pool = ScopePoolGet(true);
+
+    if (pool->current == this)
+    {
+        pool->push(object);
+    }
+    else
+    {
+        _objects.push_back(object);
+    }
+}
+
+void Scope::drain()
+{
+    ScopePool *pool = ScopePoolGet(true);
+
+    if (pool->current == this)
+    {
+        pool->popTo(_page, _top);
+    }
+
+    while (!_objects.empty())
+    {
+        IObject *v = _objects.back();
+        _objects.pop_back();
+        v->release();
+    }
+
+    Atomic *a = atomic();
+
+    if (a != nullptr)
+    {
+        a->flush();
+    }
+}
+
+Scope *Scope::current()
+{
+    ScopePool *pool = ScopePoolGet(false);
+
+    if (pool != nullptr)
+    {
+        return pool->current;
+    }
+
+    return nullptr;
+}
+
+void *_Object::operator new(size_t size)
+{
+    ScopePool *pool = ScopePoolGet(false);
+
+    if (pool != nullptr && pool->arena != nullptr)
+    {
+        void *v = pool->arena->alloc(size);
+        if (v != nullptr)
+        {
+            return v;
+        }
+    }
+
+    return ::operator new(size);
+}
+
+void _Object::operator delete(void *p)
+{
+    if (ArenaPage::contains(p))
+    {
+        ArenaPage::pageOf(p)->free();
+    }
+    else
+    {
+        ::operator delete(p);
+    }
+}
+
+_Ref::_Ref() : _object(nullptr)
+{
+}
+
+IObject *_Ref::get() const
+{
+    return _object;
+}
+
+_Weak::_Weak() : _Ref(), _weakObject(nullptr)
+{
+}
+
+_Weak::_Weak(IObject *object) : _Ref(), _weakObject(nullptr)
+{
+    set(object);
+}
+
+_Weak::_Weak(const _Weak &v) : _Ref(), _weakObject(nullptr)
+{
+    set(v.get());
+}
+
+_Weak &_Weak::operator=(const _Weak &v)
+{
+    set(v.get());
+    return *this;
+}
+
+_Weak::~_Weak()
+{
+    if (_weakObject != nullptr)
+    {
+        _weakObject->release();
+    }
+}
+
+IObject *_Weak::get() const
+{
+    IObject *v = _weakObject != nullptr ? _weakObject->get() : nullptr;
+
+    if (v != nullptr)
+    {
+        /* Kept by the current Scope, or handed back unowned like a new object. */
+        Scope *scope = Scope::current();
+        if (scope != nullptr)
+        {
+            scope->adoptObject(v);
+        }
+        else
+        {
+            v->unretain();
+        }
+    }
+
+    return v;
+}
+
+void _Weak::set(IObject *object)
+{
+    WeakObject *v = object != nullptr ? object->weakObject() : nullptr;
+
+    if (v != nullptr)
+    {
+        v->retain();
+    }
+    if (_weakObject != nullptr)
+    {
+        _weakObject->release();
+    }
+    _weakObject = v;
+}
+
+_Strong::_Strong() : _Ref()
+{
+}
+
+_Strong::_Strong(IObject *object) : _Ref()
+{
+    set(object);
+}
+
+_Strong::_Strong(const _Strong &v) : _Ref()
+{
+    set(v.get());
+}
+
+_Strong::~_Strong()
+{
+    set(nullptr);
+}
+
+_Strong &_Strong::operator=(const _Strong &v)
+{
+    set(v.get());
+    return *this;
+}
+
+void _Strong::set(IObject *object)
+{
+    if (object != nullptr)
+    {
+        object->retain();
+    }
+    if (_object != nullptr)
+    {
+        _object->release();
+    }
+    _object = object;
+}
+
+_Closure::_Closure() : _func(nullptr)
+{
+}
+
+_Closure::_Closure(Func func) : _func(func)
+{
+}
+
+_Closure::~_Closure()
+{
+}
+
+Func _Closure::func()
+{
+    return _func;
+}
+
+class AnyString
+{
+  public:
+    static AnyString *create(const char *data, size_t length)
+    {
+        AnyString *v = (AnyString *)malloc(offsetof(AnyString, _data) + length + 1);
+        new (v) AnyString();
+        v->_length = length;
+        memcpy(v->_data, data, length);
+        v->_data[length] = 0;
+        return v;
+    }
+
+    void retain()
+    {
+        _retainCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release()
+    {
+        if (_retainCount.fetch_sub(1, std::memory_order_release) == 1)
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            this->~AnyString();
+            free(this);
+        }
+    }
+
+    const char *data()
+    {
+        return _data;
+    }
+
+    size_t length()
+    {
+        return _length;
+    }
+
+  private:
+    AnyString() : _retainCount(1), _length(0) {}
+
+    std::atomic<int> _retainCount;
+    size_t _length;
+    char _data[1];
+};
+
+static_assert(sizeof(Any) == 16, "kk::Any must stay a 16-byte value");
+
+Any::Any() : _type(TypeNil), _uint64Value(0)
+{
+}
+
+Any::Any(const Any &v) : _type(v._type), _uint64Value(v._uint64Value)
+{
+    if (_type == TypeString)
+    {
+        _stringValue->retain();
+    }
+}
+
+Any::Any(Any &&v) : _type(v._type), _uint64Value(v._uint64Value)
+{
+    v._type = TypeNil;
+    v._uint64Value = 0;
+}
+
+Any::Any(const String &v) : _type(TypeString), _stringValue(AnyString::create(v.data(), v.length()))
+{
+}
+
+Any::Any(const char *v) : _type(TypeString), _stringValue(AnyString::create(v, strlen(v)))
+{
+}
+
+Any::Any(Int32 v) : _type(TypeInt32), _uint64Value(0)
+{
+    _int32Value = v;
 }
 
 Any::Any(Int64 v) : _type(TypeInt64), _int64Value(v)
 {
 }
 
-Any::Any(Uint32 v) : _type(TypeUint32), _uint32Value(v)
+Any::Any(Uint32 v) : _type(TypeUint32), _uint64Value(0)
 {
+    _uint32Value = v;
 }
 
 Any::Any(Uint64 v) : _type(TypeUint64), _uint64Value(v)
@@ -289,8 +838,10 @@ Any::Any(Uint64 v) : _type(TypeUint64), _uint64Value(v)
 Any::Any(Number v) : _type(TypeNumber), _numberValue(v)
 {
 }
-Any::Any(Boolean v) : _type(TypeBoolean), _booleanValue(v)
+
+Any::Any(Boolean v) : _type(TypeBoolean), _uint64Value(0)
 {
+    _booleanValue = v;
 }
 
 Any::Any(IObject *v) : _type(TypeObject), _objectValue(v)
@@ -301,11 +852,54 @@ Any::Any(_Closure *v) : _type(TypeFunction), _functionValue(v)
 {
 }
 
-Any &Any::operator=(kk::String &v)
+Any::~Any()
+{
+    if (_type == TypeString)
+    {
+        _stringValue->release();
+    }
+}
+
+Any &Any::operator=(const Any &v)
+{
+    if (v._type == TypeString)
+    {
+        v._stringValue->retain();
+    }
+    if (_type == TypeString)
+    {
+        _stringValue->release();
+    }
+    _type = v._type;
+    _uint64Value = v._uint64Value;
+    return *this;
+}
+
+Any &Any::operator=(Any &&v)
+{
+    if (this != &v)
+    {
+        if (_type == TypeString)
+        {
+            _stringValue->release();
+        }
+        _type = v._type;
+        _uint64Value = v._uint64Value;
+        v._type = TypeNil;
+        v._uint64Value = 0;
+    }
+    return *this;
+}
+
+Any &Any::operator=(const kk::String &v)
 {
+    AnyString *p = AnyString::create(v.data(), v.length());
+    if (_type == TypeString)
+    {
+        _stringValue->release();
+    }
     _type = TypeString;
-    _stringValue = v;
-    _objectValue = nullptr;
+    _stringValue = p;
     return *this;
 }
 
@@ -345,7 +939,7 @@ void Any::release()
     }
 }
 
-Any::operator kk::Int()
+Any::operator kk::Int() const
 {
     switch (_type)
     {
@@ -362,14 +956,14 @@ Any::operator kk::Int()
     case TypeNumber:
         return _numberValue;
     case TypeString:
-        return atoi(_stringValue.c_str());
+        return atoi(_stringValue->data());
     default:
         break;
     }
     return 0;
 }
 
-Any::operator kk::Uint32()
+Any::operator kk::Uint32() const
 {
     switch (_type)
     {
@@ -386,14 +980,14 @@ Any::operator kk::Uint32()
     case TypeNumber:
         return _numberValue;
     case TypeString:
-        return atol(_stringValue.c_str());
+        return atol(_stringValue->data());
     default:
         break;
     }
     return 0;
 }
 
-Any::operator kk::Int64()
+Any::operator kk::Int64() const
 {
     switch (_type)
     {
@@ -410,13 +1004,13 @@ Any::operator kk::Int64()
     case TypeNumber:
         return _numberValue;
     case TypeString:
-        return atoll(_stringValue.c_str());
+        return atoll(_stringValue->data());
     default:
         break;
     }
     return 0;
 }
-Any::operator kk::Uint64()
+Any::operator kk::Uint64() const
 {
     switch (_type)
     {
@@ -433,13 +1027,13 @@ Any::operator kk::Uint64()
     case TypeNumber:
         return _numberValue;
     case TypeString:
-        return atoll(_stringValue.c_str());
+        return atoll(_stringValue->data());
     default:
         break;
     }
     return 0;
 }
-Any::operator kk::Number()
+Any::operator kk::Number() const
 {
     switch (_type)
     {
@@ -456,14 +1050,14 @@ Any::operator kk::Number()
     case TypeNumber:
         return _numberValue;
     case TypeString:
-        return atof(_stringValue.c_str());
+        return atof(_stringValue->data());
     default:
         break;
     }
     return 0;
 }
 
-Any::operator kk::Boolean()
+Any::operator kk::Boolean() const
 {
     switch (_type)
     {
@@ -480,14 +1074,14 @@ Any::operator kk::Boolean()
     case TypeNumber:
         return _numberValue != 0;
     case TypeString:
-        return !_stringValue.empty();
+        return _stringValue->length() != 0;
     default:
         break;
     }
     return false;
 }
 
-Any::operator kk::String()
+Any::operator kk::String() const
 {
     String v;
     switch (_type)
@@ -538,14 +1132,14 @@ Any::operator kk::String()
     }
     break;
     case TypeString:
-        return _stringValue;
+        return String(_stringValue->data(), _stringValue->length());
     default:
         break;
     }
     return v;
 }
 
-Any::operator kk::IObject *()
+Any::operator kk::IObject *() const
 {
     if (_type == TypeObject)
     {
@@ -554,7 +1148,7 @@ Any::operator kk::IObject *()
     return nullptr;
 }
 
-Any::operator kk::_Closure *()
+Any::operator kk::_Closure *() const
 {
     if (_type == TypeFunction)
     {
@@ -577,10 +1171,34 @@ String::String(const char *v) : std::string(v)
 {
 }
 
+String::String(const char *v, size_t length) : std::string(v, length)
+{
+}
+
+String::String(std::string &&v) noexcept : std::string(std::move(v))
+{
+}
+
 String::String(const String &v) : std::string(v)
 {
 }
 
+String::String(String &&v) noexcept : std::string(std::move(v))
+{
+}
+
+String &String::operator=(const String &v)
+{
+    std::string::operator=(v);
+    return *this;
+}
+
+String &String::operator=(String &&v) noexcept
+{
+    std::string::operator=(std::move(v));
+    return *this;
+}
+
 String &String::operator=(const char *v)
 {
     std::string::operator=(v);
@@ -633,14 +1251,19 @@ String &String::operator=(Uint64 v)
     return *this;
 }
 String String::operator+(const char *b)
-{   
-    String v(*this);
-    v.append(b);
+{
+    size_t n = strlen(b);
+    String v;
+    v.reserve(size() + n);
+    v.append(*this);
+    v.append(b, n);
     return v;
 }
 String String::operator+(const String &b)
 {
-    String v(*this);
+    String v;
+    v.reserve(size() + b.size());
+    v.append(*this);
     v.append(b);
     return v;
 }
@@ -673,79 +1296,1718 @@ String String::operator+(Uint64 b) {
     return v;
 }
 
-class MutexAtomic : public Atomic
+String String::concat(const StringPiece *pieces, size_t count)
 {
-  public:
-    MutexAtomic()
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i++)
     {
-        pthread_mutex_init(&_lock, nullptr);
-        pthread_mutex_init(&_objectLock, nullptr);
+        n += pieces[i].length();
     }
 
-    virtual ~MutexAtomic()
+    String v;
+    v.reserve(n);
+
+    for (size_t i = 0; i < count; i++)
     {
-        pthread_mutex_destroy(&_lock);
-        pthread_mutex_destroy(&_objectLock);
+        v.append(pieces[i].data(), pieces[i].length());
     }
 
-    virtual void lock()
+    return v;
+}
+
+StringPiece::StringPiece(const char *v) : _data(v), _length(v == nullptr ? 0 : strlen(v))
+{
+    if (_data == nullptr)
     {
-        pthread_mutex_lock(&_lock);
+        _data = "";
     }
+}
 
-    virtual void unlock()
-    {
-        pthread_mutex_unlock(&_lock);
+StringPiece::StringPiece(const String &v) : _data(v.data()), _length(v.length())
+{
+}
 
-        IObject *v = nullptr;
+StringPiece::StringPiece(Int32 v) : _data(nullptr)
+{
+    _length = snprintf(_buffer, sizeof(_buffer), "%d", v);
+}
 
-        do
+StringPiece::StringPiece(Int64 v) : _data(nullptr)
+{
+    _length = snprintf(_buffer, sizeof(_buffer), "%lld", v);
+}
+
+StringPiece::StringPiece(Uint32 v) : _data(nullptr)
+{
+    _length = snprintf(_buffer, sizeof(_buffer), "%u", v);
+}
+
+StringPiece::StringPiece(Uint64 v) : _data(nullptr)
+{
+    _length = snprintf(_buffer, sizeof(_buffer), "%llu", v);
+}
+
+StringPiece::StringPiece(Number v) : _data(nullptr)
+{
+    _length = snprintf(_buffer, sizeof(_buffer), "%g", v);
+}
+
+StringPiece::StringPiece(Boolean v) : _data(v ? "true" : "false"), _length(v ? 4 : 5)
+{
+}
+
+const char *StringPiece::data() const
+{
+    return _data != nullptr ? _data : _buffer;
+}
+
+size_t StringPiece::length() const
+{
+    return _length;
+}
+
+static inline Uint64 hashRead64(const unsigned char *p)
+{
+    Uint64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+Uint64 hash(const void *data, size_t length)
+{
+    const Uint64 k0 = 0x9e3779b97f4a7c15ULL;
+    const Uint64 k1 = 0xbf58476d1ce4e5b9ULL;
+    const unsigned char *p = (const unsigned char *)data;
+    Uint64 h = length * k0;
+
+    while (length >= 8)
+    {
+        h = (h ^ (hashRead64(p) * k1)) * k0;
+        h ^= h >> 29;
+        p += 8;
+        length -= 8;
+    }
+
+    if (length > 0)
+    {
+        Uint64 v = 0;
+        memcpy(&v, p, length);
+        h = (h ^ (v * k1)) * k0;
+        h ^= h >> 29;
+    }
+
+    return hashMix(h);
+}
+
+template <typename T>
+static Number scalarSum(const T *p, size_t n)
+{
+    Number v = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        v += p[i];
+    }
+    return v;
+}
+
+static Number scalarSum(const Int32 *p, size_t n)
+{
+    Int64 v = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        v += p[i];
+    }
+    return (Number)v;
+}
+
+template <typename T>
+static T scalarMin(const T *p, size_t n)
+{
+    if (n == 0)
+    {
+        return 0;
+    }
+    T v = p[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        if (p[i] < v)
+        {
+            v = p[i];
+        }
+    }
+    return v;
+}
+
+template <typename T>
+static T scalarMax(const T *p, size_t n)
+{
+    if (n == 0)
+    {
+        return 0;
+    }
+    T v = p[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        if (p[i] > v)
+        {
+            v = p[i];
+        }
+    }
+    return v;
+}
+
+static Number scalarDot(const Number *a, const Number *b, size_t n)
+{
+    Number v = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        v += a[i] * b[i];
+    }
+    return v;
+}
+
+static Number scalarDot(const Int32 *a, const Int32 *b, size_t n)
+{
+    Int64 v = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        v += (Int64)a[i] * b[i];
+    }
+    return (Number)v;
+}
+
+template <typename T>
+static void scalarScale(T *p, size_t n, T v)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        p[i] *= v;
+    }
+}
+
+template <typename T>
+static void scalarAdd(T *p, const T *v, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        p[i] += v[i];
+    }
+}
+
+template <typename T>
+static void scalarFill(T *p, size_t n, T v)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        p[i] = v;
+    }
+}
+
+template <typename T>
+static Boolean scalarEquals(const T *a, const T *b, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (a[i] != b[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef KK_SIMD_X86
+
+KK_SSE2 static Number sse2Sum(const Number *p, size_t n)
+{
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        a0 = _mm_add_pd(a0, _mm_loadu_pd(p + i));
+        a1 = _mm_add_pd(a1, _mm_loadu_pd(p + i + 2));
+    }
+    double t[2];
+    _mm_storeu_pd(t, _mm_add_pd(a0, a1));
+    Number v = t[0] + t[1];
+    for (; i < n; i++)
+    {
+        v += p[i];
+    }
+    return v;
+}
+
+KK_SSE2 static Number sse2Min(const Number *p, size_t n)
+{
+    if (n < 2)
+    {
+        return scalarMin(p, n);
+    }
+    __m128d m = _mm_set1_pd(p[0]);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        m = _mm_min_pd(m, _mm_loadu_pd(p + i));
+    }
+    double t[2];
+    _mm_storeu_pd(t, m);
+    Number v = t[0] < t[1] ? t[0] : t[1];
+    for (; i < n; i++)
+    {
+        if (p[i] < v)
+        {
+            v = p[i];
+        }
+    }
+    return v;
+}
+
+KK_SSE2 static Number sse2Max(const Number *p, size_t n)
+{
+    if (n < 2)
+    {
+        return scalarMax(p, n);
+    }
+    __m128d m = _mm_set1_pd(p[0]);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        m = _mm_max_pd(m, _mm_loadu_pd(p + i));
+    }
+    double t[2];
+    _mm_storeu_pd(t, m);
+    Number v = t[0] > t[1] ? t[0] : t[1];
+    for (; i < n; i++)
+    {
+        if (p[i] > v)
+        {
+            v = p[i];
+        }
+    }
+    return v;
+}
+
+KK_SSE2 static Number sse2Dot(const Number *a, const Number *b, size_t n)
+{
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        a0 = _mm_add_pd(a0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    double t[2];
+    _mm_storeu_pd(t, _mm_add_pd(a0, a1));
+    Number v = t[0] + t[1];
+    for (; i < n; i++)
+    {
+        v += a[i] * b[i];
+    }
+    return v;
+}
+
+KK_SSE2 static void sse2Scale(Number *p, size_t n, Number v)
+{
+    __m128d s = _mm_set1_pd(v);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        _mm_storeu_pd(p + i, _mm_mul_pd(_mm_loadu_pd(p + i), s));
+    }
+    for (; i < n; i++)
+    {
+        p[i] *= v;
+    }
+}
+
+KK_SSE2 static void sse2Add(Number *p, const Number *v, size_t n)
+{
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        _mm_storeu_pd(p + i, _mm_add_pd(_mm_loadu_pd(p + i), _mm_loadu_pd(v + i)));
+    }
+    for (; i < n; i++)
+    {
+        p[i] += v[i];
+    }
+}
+
+KK_SSE2 static void sse2Fill(Number *p, size_t n, Number v)
+{
+    __m128d s = _mm_set1_pd(v);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        _mm_storeu_pd(p + i, s);
+    }
+    for (; i < n; i++)
+    {
+        p[i] = v;
+    }
+}
+
+KK_SSE2 static Boolean sse2Equals(const Number *a, const Number *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        if (_mm_movemask_pd(_mm_cmpneq_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i))) != 0)
+        {
+            return false;
+        }
+    }
+    return scalarEquals(a + i, b + i, n - i);
+}
+
+KK_SSE2 static void sse2Add(Int32 *p, const Int32 *v, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(v + i));
+        _mm_storeu_si128((__m128i *)(p + i), _mm_add_epi32(x, y));
+    }
+    scalarAdd(p + i, v + i, n - i);
+}
+
+KK_SSE2 static void sse2Fill(Int32 *p, size_t n, Int32 v)
+{
+    __m128i s = _mm_set1_epi32(v);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(p + i), s);
+    }
+    scalarFill(p + i, n - i, v);
+}
+
+KK_SSE2 static Boolean sse2Equals(const Int32 *a, const Int32 *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(x, y)) != 0xffff)
+        {
+            return false;
+        }
+    }
+    return scalarEquals(a + i, b + i, n - i);
+}
+
+KK_AVX2 static Number avx2Sum(const Number *p, size_t n)
+{
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(p + i));
+        a1 = _mm256_add_pd(a1, _mm256_loadu_pd(p + i + 4));
+    }
+    double t[4];
+    _mm256_storeu_pd(t, _mm256_add_pd(a0, a1));
+    Number v = (t[0] + t[1]) + (t[2] + t[3]);
+    for (; i < n; i++)
+    {
+        v += p[i];
+    }
+    return v;
+}
+
+KK_AVX2 static Number avx2Min(const Number *p, size_t n)
+{
+    if (n < 4)
+    {
+        return scalarMin(p, n);
+    }
+    __m256d m = _mm256_set1_pd(p[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        m = _mm256_min_pd(m, _mm256_loadu_pd(p + i));
+    }
+    double t[4];
+    _mm256_storeu_pd(t, m);
+    Number v = t[0];
+    for (int k = 1; k < 4; k++)
+    {
+        if (t[k] < v)
+        {
+            v = t[k];
+        }
+    }
+    for (; i < n; i++)
+    {
+        if (p[i] < v)
+        {
+            v = p[i];
+        }
+    }
+    return v;
+}
+
+KK_AVX2 static Number avx2Max(const Number *p, size_t n)
+{
+    if (n < 4)
+    {
+        return scalarMax(p, n);
+    }
+    __m256d m = _mm256_set1_pd(p[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        m = _mm256_max_pd(m, _mm256_loadu_pd(p + i));
+    }
+    double t[4];
+    _mm256_storeu_pd(t, m);
+    Number v = t[0];
+    for (int k = 1; k < 4; k++)
+    {
+        if (t[k] > v)
+        {
+            v = t[k];
+        }
+    }
+    for (; i < n; i++)
+    {
+        if (p[i] > v)
+        {
+            v = p[i];
+        }
+    }
+    return v;
+}
+
+KK_AVX2 static Number avx2Dot(const Number *a, const Number *b, size_t n)
+{
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        a0 = _mm256_add_pd(a0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        a1 = _mm256_add_pd(a1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double t[4];
+    _mm256_storeu_pd(t, _mm256_add_pd(a0, a1));
+    Number v = (t[0] + t[1]) + (t[2] + t[3]);
+    for (; i < n; i++)
+    {
+        v += a[i] * b[i];
+    }
+    return v;
+}
+
+KK_AVX2 static void avx2Scale(Number *p, size_t n, Number v)
+{
+    __m256d s = _mm256_set1_pd(v);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm256_storeu_pd(p + i, _mm256_mul_pd(_mm256_loadu_pd(p + i), s));
+    }
+    for (; i < n; i++)
+    {
+        p[i] *= v;
+    }
+}
+
+KK_AVX2 static void avx2Add(Number *p, const Number *v, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm256_storeu_pd(p + i, _mm256_add_pd(_mm256_loadu_pd(p + i), _mm256_loadu_pd(v + i)));
+    }
+    for (; i < n; i++)
+    {
+        p[i] += v[i];
+    }
+}
+
+KK_AVX2 static void avx2Fill(Number *p, size_t n, Number v)
+{
+    __m256d s = _mm256_set1_pd(v);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm256_storeu_pd(p + i, s);
+    }
+    for (; i < n; i++)
+    {
+        p[i] = v;
+    }
+}
+
+KK_AVX2 static Boolean avx2Equals(const Number *a, const Number *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        if (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), _CMP_NEQ_UQ)) != 0)
+        {
+            return false;
+        }
+    }
+    for (; i < n; i++)
+    {
+        if (a[i] != b[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+KK_AVX2 static Number avx2Sum(const Int32 *p, size_t n)
+{
+    __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        a0 = _mm256_add_epi64(a0, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(p + i))));
+        a1 = _mm256_add_epi64(a1, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(p + i + 4))));
+    }
+    long long t[4];
+    _mm256_storeu_si256((__m256i *)t, _mm256_add_epi64(a0, a1));
+    Int64 v = t[0] + t[1] + t[2] + t[3];
+    for (; i < n; i++)
+    {
+        v += p[i];
+    }
+    return (Number)v;
+}
+
+KK_AVX2 static Int32 avx2Min(const Int32 *p, size_t n)
+{
+    if (n < 8)
+    {
+        return scalarMin(p, n);
+    }
+    __m256i m = _mm256_set1_epi32(p[0]);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        m = _mm256_min_epi32(m, _mm256_loadu_si256((const __m256i *)(p + i)));
+    }
+    Int32 t[8];
+    _mm256_storeu_si256((__m256i *)t, m);
+    Int32 v = scalarMin(t, 8);
+    for (; i < n; i++)
+    {
+        if (p[i] < v)
+        {
+            v = p[i];
+        }
+    }
+    return v;
+}
+
+KK_AVX2 static Int32 avx2Max(const Int32 *p, size_t n)
+{
+    if (n < 8)
+    {
+        return scalarMax(p, n);
+    }
+    __m256i m = _mm256_set1_epi32(p[0]);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        m = _mm256_max_epi32(m, _mm256_loadu_si256((const __m256i *)(p + i)));
+    }
+    Int32 t[8];
+    _mm256_storeu_si256((__m256i *)t, m);
+    Int32 v = scalarMax(t, 8);
+    for (; i < n; i++)
+    {
+        if (p[i] > v)
+        {
+            v = p[i];
+        }
+    }
+    return v;
+}
+
+KK_AVX2 static Number avx2Dot(const Int32 *a, const Int32 *b, size_t n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i x = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i y = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(b + i)));
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(x, y));
+    }
+    long long t[4];
+    _mm256_storeu_si256((__m256i *)t, acc);
+    Int64 v = t[0] + t[1] + t[2] + t[3];
+    for (; i < n; i++)
+    {
+        v += (Int64)a[i] * b[i];
+    }
+    return (Number)v;
+}
+
+KK_AVX2 static void avx2Scale(Int32 *p, size_t n, Int32 v)
+{
+    __m256i s = _mm256_set1_epi32(v);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+        _mm256_storeu_si256((__m256i *)(p + i), _mm256_mullo_epi32(x, s));
+    }
+    scalarScale(p + i, n - i, v);
+}
+
+KK_AVX2 static void avx2Add(Int32 *p, const Int32 *v, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(v + i));
+        _mm256_storeu_si256((__m256i *)(p + i), _mm256_add_epi32(x, y));
+    }
+    scalarAdd(p + i, v + i, n - i);
+}
+
+KK_AVX2 static void avx2Fill(Int32 *p, size_t n, Int32 v)
+{
+    __m256i s = _mm256_set1_epi32(v);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_si256((__m256i *)(p + i), s);
+    }
+    scalarFill(p + i, n - i, v);
+}
+
+KK_AVX2 static Boolean avx2Equals(const Int32 *a, const Int32 *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(x, y)) != -1)
+        {
+            return false;
+        }
+    }
+    return scalarEquals(a + i, b + i, n - i);
+}
+
+#endif
+
+struct TypedKernels
+{
+    Number (*sumF64)(const Number *, size_t);
+    Number (*minF64)(const Number *, size_t);
+    Number (*maxF64)(const Number *, size_t);
+    Number (*dotF64)(const Number *, const Number *, size_t);
+    void (*scaleF64)(Number *, size_t, Number);
+    void (*addF64)(Number *, const Number *, size_t);
+    void (*fillF64)(Number *, size_t, Number);
+    Boolean (*equalsF64)(const Number *, const Number *, size_t);
+    Number (*sumI32)(const Int32 *, size_t);
+    Int32 (*minI32)(const Int32 *, size_t);
+    Int32 (*maxI32)(const Int32 *, size_t);
+    Number (*dotI32)(const Int32 *, const Int32 *, size_t);
+    void (*scaleI32)(Int32 *, size_t, Int32);
+    void (*addI32)(Int32 *, const Int32 *, size_t);
+    void (*fillI32)(Int32 *, size_t, Int32);
+    Boolean (*equalsI32)(const Int32 *, const Int32 *, size_t);
+};
+
+static TypedKernels TypedKernelsCreate()
+{
+    TypedKernels v;
+    v.sumF64 = scalarSum<Number>;
+    v.minF64 = scalarMin<Number>;
+    v.maxF64 = scalarMax<Number>;
+    v.dotF64 = scalarDot;
+    v.scaleF64 = scalarScale<Number>;
+    v.addF64 = scalarAdd<Number>;
+    v.fillF64 = scalarFill<Number>;
+    v.equalsF64 = scalarEquals<Number>;
+    v.sumI32 = scalarSum;
+    v.minI32 = scalarMin<Int32>;
+    v.maxI32 = scalarMax<Int32>;
+    v.dotI32 = scalarDot;
+    v.scaleI32 = scalarScale<Int32>;
+    v.addI32 = scalarAdd<Int32>;
+    v.fillI32 = scalarFill<Int32>;
+    v.equalsI32 = scalarEquals<Int32>;
+#ifdef KK_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+    {
+        v.sumF64 = sse2Sum;
+        v.minF64 = sse2Min;
+        v.maxF64 = sse2Max;
+        v.dotF64 = sse2Dot;
+        v.scaleF64 = sse2Scale;
+        v.addF64 = sse2Add;
+        v.fillF64 = sse2Fill;
+        v.equalsF64 = sse2Equals;
+        v.addI32 = sse2Add;
+        v.fillI32 = sse2Fill;
+        v.equalsI32 = sse2Equals;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        v.sumF64 = avx2Sum;
+        v.minF64 = avx2Min;
+        v.maxF64 = avx2Max;
+        v.dotF64 = avx2Dot;
+        v.scaleF64 = avx2Scale;
+        v.addF64 = avx2Add;
+        v.fillF64 = avx2Fill;
+        v.equalsF64 = avx2Equals;
+        v.sumI32 = avx2Sum;
+        v.minI32 = avx2Min;
+        v.maxI32 = avx2Max;
+        v.dotI32 = avx2Dot;
+        v.scaleI32 = avx2Scale;
+        v.addI32 = avx2Add;
+        v.fillI32 = avx2Fill;
+        v.equalsI32 = avx2Equals;
+    }
+#endif
+    return v;
+}
+
+static const TypedKernels &typedKernels()
+{
+    static const TypedKernels v = TypedKernelsCreate();
+    return v;
+}
+
+Number typedSum(const Number *data, size_t length)
+{
+    return typedKernels().sumF64(data, length);
+}
+
+Number typedSum(const Int32 *data, size_t length)
+{
+    return typedKernels().sumI32(data, length);
+}
+
+Number typedMin(const Number *data, size_t length)
+{
+    return typedKernels().minF64(data, length);
+}
+
+Int32 typedMin(const Int32 *data, size_t length)
+{
+    return typedKernels().minI32(data, length);
+}
+
+Number typedMax(const Number *data, size_t length)
+{
+    return typedKernels().maxF64(data, length);
+}
+
+Int32 typedMax(const Int32 *data, size_t length)
+{
+    return typedKernels().maxI32(data, length);
+}
+
+Number typedDot(const Number *a, const Number *b, size_t length)
+{
+    return typedKernels().dotF64(a, b, length);
+}
+
+Number typedDot(const Int32 *a, const Int32 *b, size_t length)
+{
+    return typedKernels().dotI32(a, b, length);
+}
+
+void typedScale(Number *data, size_t length, Number v)
+{
+    typedKernels().scaleF64(data, length, v);
+}
+
+void typedScale(Int32 *data, size_t length, Int32 v)
+{
+    typedKernels().scaleI32(data, length, v);
+}
+
+void typedAdd(Number *data, const Number *v, size_t length)
+{
+    typedKernels().addF64(data, v, length);
+}
+
+void typedAdd(Int32 *data, const Int32 *v, size_t length)
+{
+    typedKernels().addI32(data, v, length);
+}
+
+void typedFill(Number *data, size_t length, Number v)
+{
+    typedKernels().fillF64(data, length, v);
+}
+
+void typedFill(Int32 *data, size_t length, Int32 v)
+{
+    typedKernels().fillI32(data, length, v);
+}
+
+Boolean typedEquals(const Number *a, const Number *b, size_t length)
+{
+    return typedKernels().equalsF64(a, b, length);
+}
+
+Boolean typedEquals(const Int32 *a, const Int32 *b, size_t length)
+{
+    return typedKernels().equalsI32(a, b, length);
+}
+
+void *typedAlloc(size_t size)
+{
+    void *v = nullptr;
+    if (posix_memalign(&v, 64, size > 0 ? size : 64) != 0)
+    {
+        return nullptr;
+    }
+    return v;
+}
+
+void typedFree(void *data)
+{
+    free(data);
+}
+
+struct SchedulerTask
+{
+    Scheduler::Func func;
+    void *data;
+};
+
+class SchedulerWorker
+{
+  public:
+    SchedulerWorker(SchedulerPool *pool) : pool(pool)
+    {
+        pthread_mutex_init(&_lock, nullptr);
+    }
+
+    ~SchedulerWorker()
+    {
+        pthread_mutex_destroy(&_lock);
+    }
+
+    void push(const SchedulerTask &task)
+    {
+        pthread_mutex_lock(&_lock);
+        _tasks.push_back(task);
+        pthread_mutex_unlock(&_lock);
+    }
+
+    bool pop(SchedulerTask &task)
+    {
+        pthread_mutex_lock(&_lock);
+        bool v = !_tasks.empty();
+        if (v)
+        {
+            task = _tasks.back();
+            _tasks.pop_back();
+        }
+        pthread_mutex_unlock(&_lock);
+        return v;
+    }
+
+    bool steal(SchedulerTask &task)
+    {
+        pthread_mutex_lock(&_lock);
+        bool v = !_tasks.empty();
+        if (v)
+        {
+            task = _tasks.front();
+            _tasks.pop_front();
+        }
+        pthread_mutex_unlock(&_lock);
+        return v;
+    }
+
+    SchedulerPool *pool;
+    size_t index;
+    pthread_t thread;
+
+  private:
+    pthread_mutex_t _lock;
+    std::deque<SchedulerTask> _tasks;
+};
+
+static pthread_key_t kSchedulerKey;
+static pthread_once_t kSchedulerOnce = PTHREAD_ONCE_INIT;
+
+static void SchedulerKeyCreate()
+{
+    pthread_key_create(&kSchedulerKey, nullptr);
+}
+
+static void *SchedulerMain(void *v);
+
+class SchedulerPool
+{
+  public:
+    SchedulerPool(size_t count) : _next(0), _pending(0), _idle(0), _stopping(false)
+    {
+        pthread_once(&kSchedulerOnce, SchedulerKeyCreate);
+        pthread_mutex_init(&_parkLock, nullptr);
+        pthread_cond_init(&_parkCond, nullptr);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            SchedulerWorker *worker = new SchedulerWorker(this);
+            worker->index = i;
+            _workers.push_back(worker);
+        }
+
+        for (SchedulerWorker *worker : _workers)
+        {
+            pthread_create(&worker->thread, nullptr, SchedulerMain, worker);
+        }
+    }
+
+    ~SchedulerPool()
+    {
+        pthread_mutex_lock(&_parkLock);
+        _stopping.store(true);
+        pthread_cond_broadcast(&_parkCond);
+        pthread_mutex_unlock(&_parkLock);
+
+        for (SchedulerWorker *worker : _workers)
+        {
+            pthread_join(worker->thread, nullptr);
+            delete worker;
+        }
+
+        pthread_cond_destroy(&_parkCond);
+        pthread_mutex_destroy(&_parkLock);
+    }
+
+    void post(const SchedulerTask &task)
+    {
+        SchedulerWorker *worker = (SchedulerWorker *)pthread_getspecific(kSchedulerKey);
+
+        if (worker == nullptr || worker->pool != this)
+        {
+            worker = _workers[_next.fetch_add(1, std::memory_order_relaxed) % _workers.size()];
+        }
+
+        _pending.fetch_add(1);
+        worker->push(task);
+
+        if (_idle.load() > 0)
+        {
+            pthread_mutex_lock(&_parkLock);
+            pthread_cond_signal(&_parkCond);
+            pthread_mutex_unlock(&_parkLock);
+        }
+    }
+
+    void run(SchedulerWorker *worker)
+    {
+        SchedulerTask task;
+
+        while (true)
+        {
+            if (worker->pop(task) || steal(worker, task))
+            {
+                _pending.fetch_sub(1);
+                (*task.func)(task.data);
+                continue;
+            }
+
+            pthread_mutex_lock(&_parkLock);
+            _idle.fetch_add(1);
+            while (_pending.load() == 0 && !_stopping.load())
+            {
+                pthread_cond_wait(&_parkCond, &_parkLock);
+            }
+            _idle.fetch_sub(1);
+            bool stop = _stopping.load() && _pending.load() == 0;
+            pthread_mutex_unlock(&_parkLock);
+
+            if (stop)
+            {
+                break;
+            }
+        }
+    }
+
+    size_t count()
+    {
+        return _workers.size();
+    }
+
+    bool isWorker()
+    {
+        SchedulerWorker *worker = (SchedulerWorker *)pthread_getspecific(kSchedulerKey);
+        return worker != nullptr && worker->pool == this;
+    }
+
+    bool help()
+    {
+        SchedulerWorker *worker = (SchedulerWorker *)pthread_getspecific(kSchedulerKey);
+        SchedulerTask task;
+
+        if (worker == nullptr || worker->pool != this || !(worker->pop(task) || steal(worker, task)))
+        {
+            return false;
+        }
+
+        _pending.fetch_sub(1);
+        (*task.func)(task.data);
+        return true;
+    }
+
+  private:
+    bool steal(SchedulerWorker *worker, SchedulerTask &task)
+    {
+        size_t n = _workers.size();
+        for (size_t i = 1; i < n; i++)
+        {
+            if (_workers[(worker->index + i) % n]->steal(task))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<SchedulerWorker *> _workers;
+    std::atomic<size_t> _next;
+    std::atomic<size_t> _pending;
+    std::atomic<int> _idle;
+    std::atomic<bool> _stopping;
+    pthread_mutex_t _parkLock;
+    pthread_cond_t _parkCond;
+};
+
+static void *SchedulerMain(void *v)
+{
+    SchedulerWorker *worker = (SchedulerWorker *)v;
+    pthread_setspecific(kSchedulerKey, worker);
+    worker->pool->run(worker);
+    return nullptr;
+}
+
+Scheduler::Scheduler(size_t count)
+{
+    if (count == 0)
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        count = n > 0 ? (size_t)n : 1;
+    }
+    _pool = new SchedulerPool(count);
+}
+
+Scheduler::~Scheduler()
+{
+    delete _pool;
+}
+
+void Scheduler::post(Func func, void *data)
+{
+    SchedulerTask task = {func, data};
+    _pool->post(task);
+}
+
+size_t Scheduler::count()
+{
+    return _pool->count();
+}
+
+Boolean Scheduler::help()
+{
+    return _pool->help();
+}
+
+Boolean Scheduler::isWorker()
+{
+    return _pool->isWorker();
+}
+
+Scheduler *Scheduler::shared()
+{
+    static Scheduler *v = new Scheduler(0);
+    return v;
+}
+
+#define KK_PARALLEL_CHUNKS 256
+#define KK_PARALLEL_GRAIN 1024
+
+/*
+ * Shared by the caller and the helper tasks of one parallelRange call.
+ * Helpers may start after the range is done, so each holds a reference.
+ */
+class ParallelRange
+{
+  public:
+    ParallelRange(size_t length, size_t grain, bool fixed, size_t workers, ParallelFunc func, void *data)
+        : length(length), grain(grain), fixed(fixed), workers(workers), func(func), data(data), next(0), done(0), _retainCount(1)
+    {
+        pthread_mutex_init(&lock, nullptr);
+        pthread_cond_init(&cond, nullptr);
+    }
+
+    ~ParallelRange()
+    {
+        pthread_mutex_destroy(&lock);
+        pthread_cond_destroy(&cond);
+    }
+
+    void retain()
+    {
+        _retainCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release()
+    {
+        if (_retainCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete this;
+        }
+    }
+
+    /*
+     * Claims the next chunk. Guided chunks take a share of what is left,
+     * so early chunks are large and the tail is split finely for balance.
+     */
+    bool claim(size_t &begin, size_t &end)
+    {
+        size_t i = next.load(std::memory_order_relaxed);
+        while (i < length)
+        {
+            size_t n = grain;
+            if (!fixed)
+            {
+                n = std::max(grain, (length - i) / (workers * 2));
+            }
+            size_t e = std::min(length, i + n);
+            if (next.compare_exchange_weak(i, e, std::memory_order_relaxed))
+            {
+                begin = i;
+                end = e;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run()
+    {
+        size_t begin, end;
+        while (claim(begin, end))
+        {
+            (*func)(data, begin, end);
+            if (done.fetch_add(end - begin, std::memory_order_acq_rel) + (end - begin) == length)
+            {
+                pthread_mutex_lock(&lock);
+                pthread_cond_broadcast(&cond);
+                pthread_mutex_unlock(&lock);
+            }
+        }
+    }
+
+    void join()
+    {
+        pthread_mutex_lock(&lock);
+        while (done.load(std::memory_order_acquire) != length)
+        {
+            pthread_cond_wait(&cond, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+    }
+
+    size_t length;
+    size_t grain;
+    bool fixed;
+    size_t workers;
+    ParallelFunc func;
+    void *data;
+    std::atomic<size_t> next;
+    std::atomic<size_t> done;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+  private:
+    std::atomic<int> _retainCount;
+};
+
+static void ParallelRangeRun(void *data)
+{
+    ParallelRange *v = (ParallelRange *)data;
+    v->run();
+    v->release();
+}
+
+void parallelRange(size_t length, size_t grain, bool fixed, ParallelFunc func, void *data)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    Scheduler *scheduler = Scheduler::shared();
+    size_t workers = scheduler->count();
+    size_t chunks = (length + grain - 1) / grain;
+
+    if (workers <= 1 || chunks <= 1)
+    {
+        for (size_t i = 0; i < length; i += grain)
+        {
+            (*func)(data, i, std::min(length, i + grain));
+        }
+        return;
+    }
+
+    ParallelRange *v = new ParallelRange(length, grain, fixed, workers, func, data);
+
+    for (size_t i = 1, n = std::min(workers, chunks); i < n; i++)
+    {
+        v->retain();
+        scheduler->post(ParallelRangeRun, v);
+    }
+
+    v->run();
+    v->join();
+    v->release();
+}
+
+size_t parallelGrain(size_t length)
+{
+    return std::max((size_t)KK_PARALLEL_GRAIN, (length + KK_PARALLEL_CHUNKS - 1) / KK_PARALLEL_CHUNKS);
+}
+
+struct ParallelFor
+{
+    Closure<void, Int> *fn;
+};
+
+static void ParallelForRun(void *data, size_t begin, size_t end)
+{
+    Closure<void, Int> *fn = ((ParallelFor *)data)->fn;
+    for (size_t i = begin; i < end; i++)
+    {
+        (*fn)((Int)i);
+    }
+}
+
+void parallelFor(Int length, Closure<void, Int> *fn)
+{
+    Strong<Closure<void, Int> *> ref(fn);
+    ParallelFor data = {fn};
+    parallelRange(length > 0 ? (size_t)length : 0, 1, false, ParallelForRun, &data);
+}
+
+class ChannelLock
+{
+  public:
+    ChannelLock()
+    {
+        pthread_mutex_init(&lock, nullptr);
+        pthread_cond_init(&cond, nullptr);
+    }
+
+    ~ChannelLock()
+    {
+        pthread_mutex_destroy(&lock);
+        pthread_cond_destroy(&cond);
+    }
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+_ChannelWait::_ChannelWait() : _waiters(0), _lock(new ChannelLock())
+{
+}
+
+_ChannelWait::~_ChannelWait()
+{
+    delete _lock;
+}
+
+void _ChannelWait::wait(Ready ready, void *data)
+{
+    pthread_mutex_lock(&_lock->lock);
+    _waiters.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!(*ready)(data))
+    {
+        pthread_cond_wait(&_lock->cond, &_lock->lock);
+    }
+    _waiters.fetch_sub(1, std::memory_order_relaxed);
+    pthread_mutex_unlock(&_lock->lock);
+}
+
+void _ChannelWait::wake()
+{
+    pthread_mutex_lock(&_lock->lock);
+    pthread_cond_broadcast(&_lock->cond);
+    pthread_mutex_unlock(&_lock->lock);
+}
+
+void _ConcurrentLock::wait()
+{
+    for (int i = 0;; i++)
+    {
+        bool v = false;
+        if (!_locked.load(std::memory_order_relaxed) && _locked.compare_exchange_weak(v, true, std::memory_order_acquire))
+        {
+            return;
+        }
+        if (i >= 64)
         {
+            sched_yield();
+        }
+    }
+}
+
+class PromiseLock
+{
+  public:
+    PromiseLock()
+    {
+        pthread_mutex_init(&lock, nullptr);
+        pthread_cond_init(&cond, nullptr);
+    }
+
+    ~PromiseLock()
+    {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&lock);
+    }
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    std::vector<SchedulerTask> waiters;
+};
+
+_PromiseState::_PromiseState() : _retainCount(1), _done(false), _lock(new PromiseLock())
+{
+}
+
+_PromiseState::~_PromiseState()
+{
+    delete _lock;
+}
 
-            pthread_mutex_lock(&_objectLock);
+void _PromiseState::retain()
+{
+    _retainCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void _PromiseState::release()
+{
+    if (_retainCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete this;
+    }
+}
+
+Boolean _PromiseState::isDone()
+{
+    return _done.load(std::memory_order_acquire);
+}
+
+Boolean _PromiseState::wait(Scheduler::Func func, void *data)
+{
+    pthread_mutex_lock(&_lock->lock);
+
+    if (_done.load(std::memory_order_relaxed))
+    {
+        pthread_mutex_unlock(&_lock->lock);
+        return false;
+    }
+
+    SchedulerTask task = {func, data};
+    _lock->waiters.push_back(task);
+    pthread_mutex_unlock(&_lock->lock);
+    return true;
+}
+
+void _PromiseState::done()
+{
+    std::vector<SchedulerTask> waiters;
+
+    pthread_mutex_lock(&_lock->lock);
+    _done.store(true, std::memory_order_release);
+    waiters.swap(_lock->waiters);
+    pthread_cond_broadcast(&_lock->cond);
+    pthread_mutex_unlock(&_lock->lock);
+
+    for (SchedulerTask &task : waiters)
+    {
+        Scheduler::shared()->post(task.func, task.data);
+    }
+}
 
-            if (_objects.empty())
+void _PromiseState::join()
+{
+    Scheduler *scheduler = Scheduler::shared();
+    bool worker = scheduler->isWorker();
+
+    while (!isDone())
+    {
+        if (worker && scheduler->help())
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&_lock->lock);
+        if (!_done.load(std::memory_order_relaxed))
+        {
+            if (worker)
             {
-                v = nullptr;
+                /* Wakes up now and then to pick up tasks posted meanwhile. */
+                struct timespec t;
+                clock_gettime(CLOCK_REALTIME, &t);
+                t.tv_nsec += 1000000;
+                if (t.tv_nsec >= 1000000000)
+                {
+                    t.tv_sec++;
+                    t.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&_lock->cond, &_lock->lock, &t);
             }
             else
             {
-                v = _objects.front();
-                _objects.pop();
+                pthread_cond_wait(&_lock->cond, &_lock->lock);
+            }
+        }
+        pthread_mutex_unlock(&_lock->lock);
+    }
+}
+
+/*
+ * Epoch-based reclamation. A thread pins the global epoch between lock()
+ * and unlock(). Objects that a weak reader may still reach are retired to
+ * one shared list stamped with the epoch; every unlock() at depth 0 frees
+ * the entries that every pinned thread has moved two epochs past, so
+ * whichever thread unpins last frees what it was holding back.
+ */
+
+class EpochAtomic;
+
+class EpochThread
+{
+  public:
+    EpochThread(EpochAtomic *atomic) : atomic(atomic), epoch(0), active(true), depth(0), reclaiming(false), next(nullptr) {}
+    EpochAtomic *atomic;
+    std::atomic<uint64_t> epoch;
+    std::atomic<bool> active;
+    int depth;
+    bool reclaiming;
+    EpochThread *next;
+};
+
+static pthread_key_t kEpochKey;
+static pthread_once_t kEpochOnce = PTHREAD_ONCE_INIT;
+
+static void EpochThreadExit(void *v);
+
+static void EpochKeyCreate()
+{
+    pthread_key_create(&kEpochKey, EpochThreadExit);
+}
+
+class EpochAtomic : public Atomic
+{
+  public:
+    EpochAtomic() : _epoch(2), _threads(nullptr), _retiredCount(0)
+    {
+        pthread_once(&kEpochOnce, EpochKeyCreate);
+        pthread_mutex_init(&_lock, nullptr);
+        pthread_mutex_init(&_retiredLock, nullptr);
+    }
+
+    virtual ~EpochAtomic()
+    {
+        pthread_mutex_destroy(&_retiredLock);
+        pthread_mutex_destroy(&_lock);
+    }
+
+    virtual void lock()
+    {
+        EpochThread *t = thread();
+
+        if (t->depth++ == 0)
+        {
+            t->epoch.store(_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    virtual void unlock()
+    {
+        EpochThread *t = thread();
+
+        if (--t->depth == 0)
+        {
+            t->epoch.store(0, std::memory_order_release);
+            reclaim(t);
+        }
+    }
+
+    virtual void addObject(IObject *object)
+    {
+        pthread_mutex_lock(&_retiredLock);
+        _retired.push_back(std::make_pair(object, _epoch.load(std::memory_order_acquire)));
+        _retiredCount.fetch_add(1, std::memory_order_release);
+        pthread_mutex_unlock(&_retiredLock);
+    }
+
+    virtual void flush()
+    {
+        EpochThread *t = thread();
+
+        if (t->depth == 0)
+        {
+            reclaim(t);
+        }
+    }
+
+    EpochThread *thread()
+    {
+        EpochThread *t = (EpochThread *)pthread_getspecific(kEpochKey);
+
+        if (t == nullptr)
+        {
+            pthread_mutex_lock(&_lock);
+
+            for (EpochThread *v = _threads.load(std::memory_order_acquire); v != nullptr; v = v->next)
+            {
+                bool active = false;
+                if (v->active.compare_exchange_strong(active, true, std::memory_order_acquire))
+                {
+                    t = v;
+                    break;
+                }
+            }
+
+            if (t == nullptr)
+            {
+                t = new EpochThread(this);
+                t->next = _threads.load(std::memory_order_relaxed);
+                _threads.store(t, std::memory_order_release);
+            }
+
+            pthread_mutex_unlock(&_lock);
+            pthread_setspecific(kEpochKey, t);
+        }
+
+        return t;
+    }
+
+    /*
+     * The epoch advances only when every pinned thread has observed the
+     * current one, so an object stamped e is unreachable once it reaches e + 2.
+     */
+    uint64_t advance()
+    {
+        uint64_t e = _epoch.load(std::memory_order_acquire);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        for (EpochThread *v = _threads.load(std::memory_order_acquire); v != nullptr; v = v->next)
+        {
+            uint64_t n = v->epoch.load(std::memory_order_acquire);
+            if (n != 0 && n != e)
+            {
+                return e;
+            }
+        }
+
+        if (_epoch.compare_exchange_strong(e, e + 1, std::memory_order_acq_rel))
+        {
+            return e + 1;
+        }
+
+        return e;
+    }
+
+    /*
+     * Stamps are pushed in epoch order, so the safe entries are a prefix of
+     * the list. They are deleted outside the list lock because destructors
+     * release and may retire more objects; those are picked up by the loop.
+     */
+    void reclaim(EpochThread *t)
+    {
+        if (t->reclaiming || _retiredCount.load(std::memory_order_acquire) == 0)
+        {
+            return;
+        }
+
+        t->reclaiming = true;
+
+        std::vector<IObject *> vs;
+
+        while (true)
+        {
+            advance();
+            uint64_t e = advance();
+
+            pthread_mutex_lock(&_retiredLock);
+            while (!_retired.empty() && _retired.front().second + 2 <= e)
+            {
+                vs.push_back(_retired.front().first);
+                _retired.pop_front();
             }
+            _retiredCount.store(_retired.size(), std::memory_order_release);
+            pthread_mutex_unlock(&_retiredLock);
 
-            pthread_mutex_unlock(&_objectLock);
+            if (vs.empty())
+            {
+                break;
+            }
 
-            if (v != nullptr && v->retainCount() == 0)
+            for (IObject *v : vs)
             {
                 delete (_Object *)v;
             }
 
-        } while (v);
+            vs.clear();
+        }
+
+        t->reclaiming = false;
     }
 
-    virtual void addObject(IObject *object)
+    void exit(EpochThread *t)
     {
-        pthread_mutex_lock(&_objectLock);
-        _objects.push(object);
-        pthread_mutex_unlock(&_objectLock);
+        reclaim(t);
+        t->active.store(false, std::memory_order_release);
     }
 
   private:
+    std::atomic<uint64_t> _epoch;
     pthread_mutex_t _lock;
-    pthread_mutex_t _objectLock;
-    std::queue<IObject *> _objects;
+    std::atomic<EpochThread *> _threads;
+    pthread_mutex_t _retiredLock;
+    std::deque<std::pair<IObject *, uint64_t>> _retired;
+    std::atomic<size_t> _retiredCount;
 };
 
-Atomic *atomic()
+static void EpochThreadExit(void *v)
 {
+    EpochThread *t = (EpochThread *)v;
+    pthread_setspecific(kEpochKey, t);
+    t->atomic->exit(t);
+    pthread_setspecific(kEpochKey, nullptr);
+}
 
-    static Atomic *a = nullptr;
+Atomic *atomic()
+{
 
-    if (a == nullptr)
-    {
-        a = new MutexAtomic();
-    }
+    static Atomic *a = new EpochAtomic();
 
     return a;
 }
@@ -9,6 +9,68 @@ export interface map<TKey,TValue> {
     [key: TKey]: TValue;
 }
 
+export interface orderedMap<TKey,TValue> {
+    // @ts-ignore
+    [key: TKey]: TValue;
+}
+
 export interface array<T> extends Array<T> {
 }
 
+
+export declare class float64array {
+    constructor(length: int);
+    readonly length: int;
+    [index: number]: number;
+    sum(): number;
+    min(): number;
+    max(): number;
+    dot(v: float64array): number;
+    scale(v: number): void;
+    add(v: float64array): void;
+    fill(v: number): void;
+    equals(v: float64array): boolean;
+}
+
+export declare class int32array {
+    constructor(length: int);
+    readonly length: int;
+    [index: number]: int;
+    sum(): number;
+    min(): int;
+    max(): int;
+    dot(v: int32array): number;
+    scale(v: int): void;
+    add(v: int32array): void;
+    fill(v: int): void;
+    equals(v: int32array): boolean;
+}
+
+export declare function parallelFor(length: int, fn: (index: int) => void): void;
+export declare function parallelMap<T, R>(source: array<T>, target: array<R>, fn: (value: T) => R): void;
+export declare function parallelReduce<T>(source: array<T>, initial: T, fn: (a: T, b: T) => T): T;
+
+export declare class channel<T> {
+    constructor(capacity: int, single?: boolean);
+    readonly capacity: int;
+    readonly length: int;
+    readonly closed: boolean;
+    close(): void;
+    send(v: T): boolean;
+    trySend(v: T): boolean;
+    receive(): T;
+    tryReceive(): T | undefined;
+    sendBatch(values: array<T>, wait?: boolean): int;
+    receiveBatch(target: array<T>, max: int, wait?: boolean): int;
+}
+
+export declare class concurrentMap<TKey, TValue> {
+    constructor();
+    readonly size: int;
+    get(key: TKey): TValue | undefined;
+    has(key: TKey): boolean;
+    set(key: TKey, value: TValue): void;
+    remove(key: TKey): boolean;
+    clear(): void;
+    forEach(fn: (value: TValue, key: TKey) => void): void;
+}
@@ -2,10 +2,25 @@
 #define _KK_H
 
 #include <string>
+#include <atomic>
 #include <map>
 #include <list>
 #include <set>
 #include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <type_traits>
+#include <exception>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace kk
 {
@@ -20,8 +35,13 @@ typedef double Number;
 typedef bool Boolean;
 typedef void *Func;
 class _Closure;
+class WeakObject;
+class ScopePage;
+class ScopeArena;
+class AnyString;
 class Object;
 class String;
+class StringPiece;
 class Any;
 
 class IObject
@@ -29,9 +49,29 @@ class IObject
   public:
     virtual void release() = 0;
     virtual void retain() = 0;
+    /* Drops a reference but keeps the object at zero, like a new one. */
+    virtual void unretain() = 0;
     virtual int retainCount() = 0;
-    virtual void weak(IObject **p) = 0;
-    virtual void unWeak(IObject **p) = 0;
+    virtual WeakObject *weakObject() = 0;
+};
+
+/*
+ * Weak reference control block. It is allocated the first time an object
+ * is weakly referenced and outlives the object until the last weak
+ * reference to it goes away.
+ */
+class WeakObject
+{
+  public:
+    WeakObject(IObject *object);
+    IObject *get();
+    void retain();
+    void release();
+    void clear();
+
+  private:
+    std::atomic<IObject *> _object;
+    std::atomic<int> _retainCount;
 };
 
 class Atomic
@@ -40,10 +80,67 @@ class Atomic
     virtual void lock() = 0;
     virtual void unlock() = 0;
     virtual void addObject(IObject *object) = 0;
+    /* Frees what the calling thread retired, if no reader can still see it. */
+    virtual void flush() = 0;
 };
 
 extern Atomic *atomic();
 
+class SchedulerPool;
+class PromiseLock;
+class ChannelLock;
+
+/*
+ * Work-stealing thread pool. Each worker owns a deque: tasks posted from a
+ * worker go to the back of its own deque and are popped from there, idle
+ * workers steal from the front of the others and park when all are empty.
+ */
+class Scheduler
+{
+  public:
+    typedef void (*Func)(void *data);
+    Scheduler(size_t count);
+    virtual ~Scheduler();
+    virtual void post(Func func, void *data);
+    virtual size_t count();
+    /* Runs one queued task if called on a worker of this scheduler. */
+    virtual Boolean help();
+    virtual Boolean isWorker();
+    static Scheduler *shared();
+
+  protected:
+    SchedulerPool *_pool;
+};
+
+/*
+ * Completion state of a kk::Promise. Continuations registered before the
+ * promise is done are posted to the shared scheduler once it is. join()
+ * on a worker keeps running queued tasks so the pool cannot starve.
+ */
+class _PromiseState
+{
+  public:
+    _PromiseState();
+    virtual ~_PromiseState();
+    void retain();
+    void release();
+    Boolean isDone();
+    Boolean wait(Scheduler::Func func, void *data);
+    void done();
+    void join();
+    std::exception_ptr exception;
+
+  protected:
+    std::atomic<int> _retainCount;
+    std::atomic<bool> _done;
+    PromiseLock *_lock;
+};
+
+/*
+ * Base of every kk object. Objects the compiler proves never escape the
+ * function that creates them are emitted as plain locals instead of with
+ * new; they are never retained and are destroyed at the end of the block.
+ */
 class _Object : public IObject
 {
   public:
@@ -51,34 +148,53 @@ class _Object : public IObject
     virtual ~_Object();
     virtual void release();
     virtual void retain();
+    virtual void unretain();
     virtual int retainCount();
-    virtual void weak(IObject **p);
-    virtual void unWeak(IObject **p);
+    virtual WeakObject *weakObject();
+
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
 
   private:
-    int _retainCount;
-    std::set<IObject **> _weakObjects;
+    std::atomic<int> _retainCount;
+    std::atomic<WeakObject *> _weakObject;
 };
 
+/*
+ * Autorelease scope. Objects added to the innermost scope of a thread are
+ * pushed onto that thread's page-based pool and released in one sweep when
+ * the scope ends or is drained.
+ *
+ * A scope created with arena = true also bump-allocates every kk object
+ * created inside it. Arena pages are recycled in bulk when the scope ends;
+ * a page still holding an object that escaped the scope is handed over to
+ * that object and freed when the last such object is deleted.
+ */
 class Scope
 {
   public:
     Scope();
+    Scope(Boolean arena);
     virtual ~Scope();
     virtual Scope *parent();
     virtual void addObject(IObject *object);
+    virtual void adoptObject(IObject *object);
+    virtual void drain();
     static Scope *current();
 
   protected:
     Scope *_parent;
-    std::list<IObject *> _objects;
+    ScopeArena *_arena;
+    ScopePage *_page;
+    IObject **_top;
+    std::vector<IObject *> _objects;
 };
 
 class _Ref
 {
   public:
     _Ref();
-    virtual IObject *get();
+    virtual IObject *get() const;
     virtual void set(IObject *object) = 0;
 
   protected:
@@ -90,7 +206,14 @@ class _Weak : public _Ref
   public:
     _Weak();
     _Weak(IObject *object);
+    _Weak(const _Weak &v);
+    virtual ~_Weak();
+    _Weak &operator=(const _Weak &v);
+    virtual IObject *get() const;
     virtual void set(IObject *object);
+
+  protected:
+    WeakObject *_weakObject;
 };
 
 class _Strong : public _Ref
@@ -98,6 +221,9 @@ class _Strong : public _Ref
   public:
     _Strong();
     _Strong(IObject *object);
+    _Strong(const _Strong &v);
+    virtual ~_Strong();
+    _Strong &operator=(const _Strong &v);
     virtual void set(IObject *object);
 };
 
@@ -110,8 +236,13 @@ class String : public std::string
   public:
     String();
     String(const char *v);
+    String(const char *v, size_t length);
     String(std::string &v);
+    String(std::string &&v) noexcept;
     String(const String &v);
+    String(String &&v) noexcept;
+    String &operator=(const String &v);
+    String &operator=(String &&v) noexcept;
     String &operator=(const char *v);
     String &operator=(Boolean v);
     String &operator=(Number v);
@@ -126,231 +257,2002 @@ class String : public std::string
     String operator+(Int64 b);
     String operator+(Uint32 b);
     String operator+(Uint64 b);
+
+    static String concat(const StringPiece *pieces, size_t count);
+};
+
+/*
+ * One operand of a string concatenation. Numbers are formatted into the
+ * piece itself so the final length is known before anything is copied.
+ */
+class StringPiece
+{
+  public:
+    StringPiece(const char *v);
+    StringPiece(const String &v);
+    StringPiece(Int32 v);
+    StringPiece(Int64 v);
+    StringPiece(Uint32 v);
+    StringPiece(Uint64 v);
+    StringPiece(Number v);
+    StringPiece(Boolean v);
+    const char *data() const;
+    size_t length() const;
+
+  protected:
+    const char *_data;
+    size_t _length;
+    char _buffer[32];
 };
 
+/*
+ * Concatenates all arguments into one String with a single allocation.
+ * The compiler lowers string `a + b + c` chains to kk::concat(a, b, c).
+ */
+template <typename... TArg>
+String concat(const TArg &... args)
+{
+    const StringPiece pieces[] = {StringPiece(args)...};
+    return String::concat(pieces, sizeof...(TArg));
+}
+
 class _Closure : public Object
 {
   public:
     _Closure();
     _Closure(Func func);
     virtual ~_Closure();
-    virtual Any get(const char *name);
-    virtual void set(const char *name, Any value);
     virtual Func func();
 
   protected:
     Func _func;
-    std::map<std::string, Any> _locals;
 };
 
-template <typename TKey, typename TValue>
-class Map : public Object
+extern Uint64 hash(const void *data, size_t length);
+
+inline Uint64 hashMix(Uint64 v)
 {
-  public:
-    Map() {}
-    Map(const Map &v)
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33;
+    v *= 0xc4ceb9fe1a85ec53ULL;
+    v ^= v >> 33;
+    return v;
+}
+
+template <typename T>
+struct Hash
+{
+    Uint64 operator()(const T &v) const
     {
-        _objects = v._objects;
+        return std::hash<T>()(v);
     }
-    TValue &operator[](TKey key)
+};
+
+template <>
+struct Hash<String>
+{
+    Uint64 operator()(const String &v) const
     {
-        return _objects[key];
+        return hash(v.data(), v.length());
     }
-    Map &operator=(const Map &v)
+};
+
+template <typename T>
+struct Hash<T *>
+{
+    Uint64 operator()(T *v) const
     {
-        _objects = v._objects;
-        return *this;
+        return (Uint64)(size_t)v;
     }
-
-  protected:
-    std::map<TKey, TValue> _objects;
 };
 
-template <typename TValue>
-class Array : public Object
+/*
+ * Sixteen control bytes of a HashTable, compared in parallel with SSE2
+ * where available and byte by byte otherwise.
+ */
+class HashGroup
 {
   public:
-    Array() {}
-    Array(const Array &v)
+    static const size_t Width = 16;
+    static const signed char Empty = -128;
+    static const signed char Deleted = -2;
+
+    explicit HashGroup(const signed char *ctrl)
     {
-        _objects = v->_objects;
+#ifdef __SSE2__
+        _ctrl = _mm_loadu_si128((const __m128i *)ctrl);
+#else
+        memcpy(_ctrl, ctrl, Width);
+#endif
     }
-    TValue &operator[](int key)
+
+    unsigned int match(signed char h) const
     {
-        return _objects[key];
+#ifdef __SSE2__
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h), _ctrl));
+#else
+        unsigned int m = 0;
+        for (size_t i = 0; i < Width; i++)
+        {
+            if (_ctrl[i] == h)
+            {
+                m |= 1u << i;
+            }
+        }
+        return m;
+#endif
     }
-    Array &operator=(const Array &v)
+
+    unsigned int matchEmpty() const
     {
-        _objects = v->_objects;
-        return *this;
+        return match(Empty);
     }
-    virtual int length() {
-        return _objects.size();
+
+    unsigned int matchEmptyOrDeleted() const
+    {
+#ifdef __SSE2__
+        return _mm_movemask_epi8(_ctrl);
+#else
+        unsigned int m = 0;
+        for (size_t i = 0; i < Width; i++)
+        {
+            if (_ctrl[i] < 0)
+            {
+                m |= 1u << i;
+            }
+        }
+        return m;
+#endif
     }
-  protected:
-    std::vector<TValue> _objects;
+
+  private:
+#ifdef __SSE2__
+    __m128i _ctrl;
+#else
+    signed char _ctrl[Width];
+#endif
 };
 
-enum Type
+template <typename TKey, typename TValue>
+struct HashEntry
 {
-    TypeNil,
-    TypeString,
-    TypeNumber,
-    TypeBoolean,
-    TypeFunction,
-    TypeObject,
-    TypeInt32,
-    TypeInt64,
-    TypeUint32,
-    TypeUint64
+    HashEntry(const TKey &key) : key(key), value() {}
+    HashEntry(const TKey &key, const TValue &value) : key(key), value(value) {}
+    TKey key;
+    TValue value;
 };
 
-class Any
+/*
+ * Open-addressing hash table in the Swiss-table layout: one control byte
+ * per slot holding 7 bits of the hash, probed a group at a time, with the
+ * entries stored inline in a flat array.
+ */
+template <typename TKey, typename TValue, typename THash = Hash<TKey>>
+class HashTable
 {
   public:
-    Any();
-    Any(const Any &v);
-    Any(const String &v);
-    Any(const char *v);
-    Any(Int32 v);
-    Any(Int64 v);
-    Any(Uint32 v);
-    Any(Uint64 v);
-    Any(Number v);
-    Any(Boolean v);
-    Any(IObject *v);
-    Any(_Closure *v);
-
-    virtual void retain();
-    virtual void release();
-
-    virtual Any &operator=(kk::String &v);
-
-    virtual operator kk::Int();
-    virtual operator kk::Uint();
-    virtual operator kk::Int64();
-    virtual operator kk::Uint64();
-    virtual operator kk::Number();
-    virtual operator kk::Boolean();
-    virtual operator kk::String();
-    virtual operator IObject *();
-    virtual operator _Closure *();
+    typedef HashEntry<TKey, TValue> Entry;
 
-    template <typename T, typename... TArg>
-    T operator()(TArg... arg)
+    class Iterator
     {
-        if (_type == TypeFunction && _functionValue != nullptr)
+      public:
+        Iterator(const HashTable *table, size_t index) : _table(table), _index(index)
         {
-            T((*fn)(_Closure *, TArg...)) = (T(*)(_Closure *, TArg...))_functionValue->func();
-            if (fn != nullptr)
+            skip();
+        }
+        Entry &operator*() const
+        {
+            return _table->_entries[_index];
+        }
+        Entry *operator->() const
+        {
+            return _table->_entries + _index;
+        }
+        Iterator &operator++()
+        {
+            _index++;
+            skip();
+            return *this;
+        }
+        bool operator!=(const Iterator &v) const
+        {
+            return _index != v._index;
+        }
+
+      private:
+        void skip()
+        {
+            while (_index < _table->_capacity && _table->_ctrl[_index] < 0)
             {
-                return (*fn)(_functionValue, arg...);
+                _index++;
             }
         }
-        return (T) nullptr;
-    }
+        const HashTable *_table;
+        size_t _index;
+    };
 
-    static Any Nil;
+    HashTable() : _ctrl(nullptr), _entries(nullptr), _capacity(0), _size(0), _growthLeft(0) {}
 
-  protected:
-    Type _type;
-    String _stringValue;
-    union {
-        IObject *_objectValue;
-        _Closure *_functionValue;
-        Number _numberValue;
-        Boolean _booleanValue;
-        Int32 _int32Value;
-        Uint32 _uint32Value;
-        Int64 _int64Value;
-        Uint64 _uint64Value;
-    };
-};
+    HashTable(const HashTable &v) : _ctrl(nullptr), _entries(nullptr), _capacity(0), _size(0), _growthLeft(0)
+    {
+        copy(v);
+    }
 
-template <typename T, typename... TArg>
-class Closure : public _Closure
-{
-  public:
-    Closure() : _Closure() {}
-    Closure(T (*func)(_Closure *, TArg...)) : _Closure((Func)func) {}
-    Closure(const Closure &v)
+    HashTable(HashTable &&v) : _ctrl(v._ctrl), _entries(v._entries), _capacity(v._capacity), _size(v._size), _growthLeft(v._growthLeft)
     {
-        _func = v._func;
-        _locals = v._locals;
+        v._ctrl = nullptr;
+        v._entries = nullptr;
+        v._capacity = v._size = v._growthLeft = 0;
     }
-    Closure *as(const char *key, Any value)
+
+    ~HashTable()
     {
-        _locals[key] = value;
-        return this;
+        destroy();
     }
-    T operator()(TArg... arg)
+
+    HashTable &operator=(const HashTable &v)
     {
-        T((*fn)(_Closure *, TArg...)) = (T(*)(_Closure *, TArg...))_func;
-        if (fn != nullptr)
+        if (this != &v)
         {
-            return (*fn)((_Closure *)this, arg...);
+            destroy();
+            copy(v);
         }
-        return (T) nullptr;
+        return *this;
     }
-    bool operator!=(void *v)
+
+    HashTable &operator=(HashTable &&v)
     {
-        return _func == v;
+        if (this != &v)
+        {
+            destroy();
+            _ctrl = v._ctrl;
+            _entries = v._entries;
+            _capacity = v._capacity;
+            _size = v._size;
+            _growthLeft = v._growthLeft;
+            v._ctrl = nullptr;
+            v._entries = nullptr;
+            v._capacity = v._size = v._growthLeft = 0;
+        }
+        return *this;
     }
-};
 
-template <class T = IObject>
-class Strong : public _Strong
-{
-  public:
-    Strong() : _Strong() {}
-    Strong(T object) : _Strong(object) {}
-    Strong(const Strong &ref) : _Strong(ref.get()) {}
-    T as()
+    size_t size() const
     {
-        return (T)get();
+        return _size;
     }
-    Strong &operator=(T object)
+
+    Iterator begin() const
     {
-        set((IObject *)object);
-        return *this;
+        return Iterator(this, 0);
     }
-    Strong &operator=(Strong &ref)
+
+    Iterator end() const
     {
-        set(ref.get());
-        return *this;
+        return Iterator(this, _capacity);
     }
-    operator T()
+
+    Entry *find(const TKey &key) const
     {
-        return (T)get();
+        if (_size == 0)
+        {
+            return nullptr;
+        }
+
+        Uint64 h = hashMix(THash()(key));
+        size_t mask = _capacity - 1;
+        size_t pos = (size_t)(h >> 7) & mask;
+        size_t step = 0;
+
+        for (;;)
+        {
+            HashGroup g(_ctrl + pos);
+
+            for (unsigned int m = g.match((signed char)(h & 0x7f)); m != 0; m &= m - 1)
+            {
+                size_t i = (pos + __builtin_ctz(m)) & mask;
+                if (_entries[i].key == key)
+                {
+                    return _entries + i;
+                }
+            }
+
+            if (g.matchEmpty() != 0)
+            {
+                return nullptr;
+            }
+
+            step += HashGroup::Width;
+            pos = (pos + step) & mask;
+        }
     }
-};
 
-template <class T = IObject>
-class Weak : public _Weak
-{
-  public:
-    Weak() : _Weak() {}
-    Weak(T object) : _Weak(object) {}
-    Weak(const Weak &ref) : _Weak(ref.get()) {}
-    virtual T as()
+    TValue &operator[](const TKey &key)
     {
-        return (T)get();
+        Entry *e = find(key);
+
+        if (e == nullptr)
+        {
+            e = new (slot(key)) Entry(key);
+        }
+
+        return e->value;
     }
-    virtual Weak &operator=(T object)
+
+    void set(const TKey &key, const TValue &value)
     {
-        set((kk::IObject *)object);
-        return *this;
+        Entry *e = find(key);
+
+        if (e == nullptr)
+        {
+            new (slot(key)) Entry(key, value);
+        }
+        else
+        {
+            e->value = value;
+        }
     }
-    virtual Weak &operator=(Weak &ref)
+
+    bool erase(const TKey &key)
     {
-        set(ref.get());
-        return *this;
+        Entry *e = find(key);
+
+        if (e == nullptr)
+        {
+            return false;
+        }
+
+        size_t i = e - _entries;
+        e->~Entry();
+        setCtrl(i, HashGroup::Deleted);
+        _size--;
+
+        return true;
     }
-    virtual operator T()
+
+    void clear()
     {
-        return (T)get();
+        destroy();
     }
-};
+
+  protected:
+    /*
+     * Claims a free slot for a key known to be absent and returns the
+     * uninitialised entry storage.
+     */
+    Entry *slot(const TKey &key)
+    {
+        if (_growthLeft == 0)
+        {
+            rehash(_capacity == 0 ? HashGroup::Width : (_size * 2 > _capacity * 7 / 8 ? _capacity * 2 : _capacity));
+        }
+
+        Uint64 h = hashMix(THash()(key));
+        size_t i = freeSlot(h);
+
+        if (_ctrl[i] == HashGroup::Empty)
+        {
+            _growthLeft--;
+        }
+
+        setCtrl(i, (signed char)(h & 0x7f));
+        _size++;
+
+        return _entries + i;
+    }
+
+    size_t freeSlot(Uint64 h) const
+    {
+        size_t mask = _capacity - 1;
+        size_t pos = (size_t)(h >> 7) & mask;
+        size_t step = 0;
+
+        for (;;)
+        {
+            unsigned int m = HashGroup(_ctrl + pos).matchEmptyOrDeleted();
+
+            if (m != 0)
+            {
+                return (pos + __builtin_ctz(m)) & mask;
+            }
+
+            step += HashGroup::Width;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    void setCtrl(size_t i, signed char h)
+    {
+        _ctrl[i] = h;
+        if (i < HashGroup::Width)
+        {
+            _ctrl[_capacity + i] = h;
+        }
+    }
+
+    void allocate(size_t capacity)
+    {
+        _capacity = capacity;
+        _ctrl = (signed char *)malloc(capacity + HashGroup::Width);
+        memset(_ctrl, HashGroup::Empty, capacity + HashGroup::Width);
+        _entries = (Entry *)malloc(sizeof(Entry) * capacity);
+        _size = 0;
+        _growthLeft = capacity * 7 / 8;
+    }
+
+    void rehash(size_t capacity)
+    {
+        signed char *ctrl = _ctrl;
+        Entry *entries = _entries;
+        size_t n = _capacity;
+
+        allocate(capacity);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            if (ctrl[i] >= 0)
+            {
+                Uint64 h = hashMix(THash()(entries[i].key));
+                size_t j = freeSlot(h);
+                setCtrl(j, (signed char)(h & 0x7f));
+                new (_entries + j) Entry(std::move(entries[i]));
+                entries[i].~Entry();
+                _size++;
+                _growthLeft--;
+            }
+        }
+
+        free(ctrl);
+        free(entries);
+    }
+
+    void copy(const HashTable &v)
+    {
+        if (v._capacity == 0)
+        {
+            return;
+        }
+
+        allocate(v._capacity);
+        memcpy(_ctrl, v._ctrl, _capacity + HashGroup::Width);
+
+        for (size_t i = 0; i < _capacity; i++)
+        {
+            if (_ctrl[i] >= 0)
+            {
+                new (_entries + i) Entry(v._entries[i]);
+            }
+        }
+
+        _size = v._size;
+        _growthLeft = v._growthLeft;
+    }
+
+    void destroy()
+    {
+        for (size_t i = 0; i < _capacity; i++)
+        {
+            if (_ctrl[i] >= 0)
+            {
+                _entries[i].~Entry();
+            }
+        }
+        free(_ctrl);
+        free(_entries);
+        _ctrl = nullptr;
+        _entries = nullptr;
+        _capacity = _size = _growthLeft = 0;
+    }
+
+    signed char *_ctrl;
+    Entry *_entries;
+    size_t _capacity;
+    size_t _size;
+    size_t _growthLeft;
+};
+
+/*
+ * Reference-counted copy-on-write storage. Copies share one buffer; the
+ * first mutation through a shared copy clones it.
+ */
+template <typename T>
+class Shared
+{
+  public:
+    Shared() : _data(nullptr) {}
+    Shared(const Shared &v) : _data(v._data)
+    {
+        if (_data != nullptr)
+        {
+            _data->retainCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    Shared(Shared &&v) : _data(v._data)
+    {
+        v._data = nullptr;
+    }
+    ~Shared()
+    {
+        release();
+    }
+    Shared &operator=(const Shared &v)
+    {
+        if (v._data != nullptr)
+        {
+            v._data->retainCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        release();
+        _data = v._data;
+        return *this;
+    }
+    Shared &operator=(Shared &&v)
+    {
+        if (this != &v)
+        {
+            release();
+            _data = v._data;
+            v._data = nullptr;
+        }
+        return *this;
+    }
+    const T &get() const
+    {
+        if (_data == nullptr)
+        {
+            static const T empty;
+            return empty;
+        }
+        return _data->value;
+    }
+    T &mutate()
+    {
+        if (_data == nullptr)
+        {
+            _data = new Data();
+        }
+        else if (_data->retainCount.load(std::memory_order_acquire) != 1)
+        {
+            Data *v = new Data(_data->value);
+            release();
+            _data = v;
+        }
+        return _data->value;
+    }
+
+  protected:
+    struct Data
+    {
+        Data() : retainCount(1), value() {}
+        Data(const T &v) : retainCount(1), value(v) {}
+        std::atomic<int> retainCount;
+        T value;
+    };
+
+    void release()
+    {
+        if (_data != nullptr && _data->retainCount.fetch_sub(1, std::memory_order_release) == 1)
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            delete _data;
+        }
+        _data = nullptr;
+    }
+
+    Data *_data;
+};
+
+template <typename TKey, typename TValue>
+class Map : public Object
+{
+  public:
+    Map() {}
+    Map(const Map &v) : _objects(v._objects)
+    {
+    }
+    TValue &operator[](const TKey &key)
+    {
+        return _objects.mutate()[key];
+    }
+    Map &operator=(const Map &v)
+    {
+        _objects = v._objects;
+        return *this;
+    }
+    const TValue *find(const TKey &key) const
+    {
+        const typename HashTable<TKey, TValue>::Entry *e = _objects.get().find(key);
+        return e == nullptr ? nullptr : &e->value;
+    }
+    const TValue &get(const TKey &key) const
+    {
+        static const TValue empty = TValue();
+        const TValue *v = find(key);
+        return v == nullptr ? empty : *v;
+    }
+    bool has(const TKey &key) const
+    {
+        return _objects.get().find(key) != nullptr;
+    }
+    bool remove(const TKey &key)
+    {
+        if (!has(key))
+        {
+            return false;
+        }
+        return _objects.mutate().erase(key);
+    }
+    int size() const
+    {
+        return (int)_objects.get().size();
+    }
+
+  protected:
+    Shared<HashTable<TKey, TValue>> _objects;
+};
+
+/*
+ * Map with keys kept in sorted order, for kk.orderedMap<K,V>.
+ */
+template <typename TKey, typename TValue>
+class OrderedMap : public Object
+{
+  public:
+    OrderedMap() {}
+    OrderedMap(const OrderedMap &v) : _objects(v._objects)
+    {
+    }
+    TValue &operator[](const TKey &key)
+    {
+        return _objects.mutate()[key];
+    }
+    OrderedMap &operator=(const OrderedMap &v)
+    {
+        _objects = v._objects;
+        return *this;
+    }
+    const TValue *find(const TKey &key) const
+    {
+        typename std::map<TKey, TValue>::const_iterator i = _objects.get().find(key);
+        return i == _objects.get().end() ? nullptr : &i->second;
+    }
+    const TValue &get(const TKey &key) const
+    {
+        static const TValue empty = TValue();
+        const TValue *v = find(key);
+        return v == nullptr ? empty : *v;
+    }
+    bool has(const TKey &key) const
+    {
+        return _objects.get().find(key) != _objects.get().end();
+    }
+    bool remove(const TKey &key)
+    {
+        if (!has(key))
+        {
+            return false;
+        }
+        return _objects.mutate().erase(key) != 0;
+    }
+    int size() const
+    {
+        return (int)_objects.get().size();
+    }
+
+  protected:
+    Shared<std::map<TKey, TValue>> _objects;
+};
+
+template <typename TValue>
+class Array : public Object
+{
+  public:
+    Array() {}
+    Array(const Array &v) : _objects(v._objects)
+    {
+    }
+    typename std::vector<TValue>::reference operator[](int key)
+    {
+        return _objects.mutate()[key];
+    }
+    typename std::vector<TValue>::const_reference operator[](int key) const
+    {
+        return _objects.get()[key];
+    }
+    Array &operator=(const Array &v)
+    {
+        _objects = v._objects;
+        return *this;
+    }
+    virtual int length() {
+        return _objects.get().size();
+    }
+    void push(const TValue &v)
+    {
+        _objects.mutate().push_back(v);
+    }
+    typename std::vector<TValue>::const_reference get(int key) const
+    {
+        static const TValue empty = TValue();
+        const std::vector<TValue> &vs = _objects.get();
+        return key >= 0 && (size_t)key < vs.size() ? vs[key] : empty;
+    }
+    const std::vector<TValue> &get() const
+    {
+        return _objects.get();
+    }
+    std::vector<TValue> &mutate()
+    {
+        return _objects.mutate();
+    }
+  protected:
+    Shared<std::vector<TValue>> _objects;
+};
+
+/*
+ * Bulk kernels behind TypedArray. Each one picks an AVX2, SSE2 or scalar
+ * implementation at runtime from the CPU features.
+ */
+extern Number typedSum(const Number *data, size_t length);
+extern Number typedSum(const Int32 *data, size_t length);
+extern Number typedMin(const Number *data, size_t length);
+extern Int32 typedMin(const Int32 *data, size_t length);
+extern Number typedMax(const Number *data, size_t length);
+extern Int32 typedMax(const Int32 *data, size_t length);
+extern Number typedDot(const Number *a, const Number *b, size_t length);
+extern Number typedDot(const Int32 *a, const Int32 *b, size_t length);
+extern void typedScale(Number *data, size_t length, Number v);
+extern void typedScale(Int32 *data, size_t length, Int32 v);
+extern void typedAdd(Number *data, const Number *v, size_t length);
+extern void typedAdd(Int32 *data, const Int32 *v, size_t length);
+extern void typedFill(Number *data, size_t length, Number v);
+extern void typedFill(Int32 *data, size_t length, Int32 v);
+extern Boolean typedEquals(const Number *a, const Number *b, size_t length);
+extern Boolean typedEquals(const Int32 *a, const Int32 *b, size_t length);
+extern void *typedAlloc(size_t size);
+extern void typedFree(void *data);
+
+/*
+ * Fixed-length numeric array in one 64-byte aligned buffer, for
+ * kk.float64array and kk.int32array. Like JavaScript typed arrays it is a
+ * reference type.
+ */
+template <typename T>
+class TypedArray : public Object
+{
+  public:
+    TypedArray(int length) : _data((T *)typedAlloc(sizeof(T) * (length > 0 ? length : 0))), _length(length > 0 ? length : 0)
+    {
+        typedFill(_data, _length, (T)0);
+    }
+    virtual ~TypedArray()
+    {
+        typedFree(_data);
+    }
+    T &operator[](int index)
+    {
+        return _data[index];
+    }
+    int length() const
+    {
+        return _length;
+    }
+    T *data()
+    {
+        return _data;
+    }
+    Number sum()
+    {
+        return typedSum(_data, _length);
+    }
+    T min()
+    {
+        return typedMin(_data, _length);
+    }
+    T max()
+    {
+        return typedMax(_data, _length);
+    }
+    Number dot(TypedArray *v)
+    {
+        return typedDot(_data, v->_data, _length < v->_length ? _length : v->_length);
+    }
+    void scale(T v)
+    {
+        typedScale(_data, _length, v);
+    }
+    void add(TypedArray *v)
+    {
+        typedAdd(_data, v->_data, _length < v->_length ? _length : v->_length);
+    }
+    void fill(T v)
+    {
+        typedFill(_data, _length, v);
+    }
+    Boolean equals(TypedArray *v)
+    {
+        return _length == v->_length && typedEquals(_data, v->_data, _length);
+    }
+
+  private:
+    TypedArray(const TypedArray &v);
+    TypedArray &operator=(const TypedArray &v);
+
+  protected:
+    T *_data;
+    int _length;
+};
+
+typedef TypedArray<Number> Float64Array;
+typedef TypedArray<Int32> Int32Array;
+
+enum Type
+{
+    TypeNil,
+    TypeString,
+    TypeNumber,
+    TypeBoolean,
+    TypeFunction,
+    TypeObject,
+    TypeInt32,
+    TypeInt64,
+    TypeUint32,
+    TypeUint64
+};
+
+/*
+ * Tagged 16-byte value. Strings are held as a shared immutable AnyString,
+ * so copying an Any never copies character data.
+ */
+class Any
+{
+  public:
+    Any();
+    Any(const Any &v);
+    Any(Any &&v);
+    Any(const String &v);
+    Any(const char *v);
+    Any(Int32 v);
+    Any(Int64 v);
+    Any(Uint32 v);
+    Any(Uint64 v);
+    Any(Number v);
+    Any(Boolean v);
+    Any(IObject *v);
+    Any(_Closure *v);
+    ~Any();
+
+    void retain();
+    void release();
+
+    Any &operator=(const Any &v);
+    Any &operator=(Any &&v);
+    Any &operator=(const kk::String &v);
+
+    operator kk::Int() const;
+    operator kk::Uint() const;
+    operator kk::Int64() const;
+    operator kk::Uint64() const;
+    operator kk::Number() const;
+    operator kk::Boolean() const;
+    operator kk::String() const;
+    operator IObject *() const;
+    operator _Closure *() const;
+
+    template <typename T, typename... TArg>
+    T operator()(TArg... arg)
+    {
+        if (_type == TypeFunction && _functionValue != nullptr)
+        {
+            T((*fn)(_Closure *, TArg...)) = (T(*)(_Closure *, TArg...))_functionValue->func();
+            if (fn != nullptr)
+            {
+                return (*fn)(_functionValue, arg...);
+            }
+        }
+        return (T) nullptr;
+    }
+
+    static Any Nil;
+
+  protected:
+    Type _type;
+    union {
+        AnyString *_stringValue;
+        IObject *_objectValue;
+        _Closure *_functionValue;
+        Number _numberValue;
+        Boolean _booleanValue;
+        Int32 _int32Value;
+        Uint32 _uint32Value;
+        Int64 _int64Value;
+        Uint64 _uint64Value;
+    };
+};
+
+/*
+ * How a value of type T is passed to generated functions and closures.
+ * Strings and Any are passed by const reference, everything else by value.
+ */
+template <typename T>
+struct Param
+{
+    typedef T type;
+};
+
+template <>
+struct Param<String>
+{
+    typedef const String &type;
+};
+
+template <>
+struct Param<Any>
+{
+    typedef const Any &type;
+};
+
+template <typename T, typename... TArg>
+class Closure : public _Closure
+{
+  public:
+    typedef T (*Function)(_Closure *, typename Param<TArg>::type...);
+    Closure() : _Closure() {}
+    Closure(Function func) : _Closure((Func)func) {}
+    Closure(const Closure &v)
+    {
+        _func = v._func;
+    }
+    T operator()(typename Param<TArg>::type... arg)
+    {
+        Function fn = (Function)_func;
+        if (fn != nullptr)
+        {
+            return (*fn)((_Closure *)this, arg...);
+        }
+        return T();
+    }
+    bool operator!=(void *v)
+    {
+        return _func == v;
+    }
+};
+
+/*
+ * Closure with captured variables. TLocals is the struct the compiler
+ * emits for each capturing arrow function, one typed field per capture.
+ */
+template <typename TLocals, typename T, typename... TArg>
+class LocalClosure : public Closure<T, TArg...>
+{
+  public:
+    template <typename... TValue>
+    LocalClosure(typename Closure<T, TArg...>::Function func, TValue... values) : Closure<T, TArg...>(func), locals(values...) {}
+    static TLocals &get(_Closure *closure)
+    {
+        return static_cast<LocalClosure *>(closure)->locals;
+    }
+    TLocals locals;
+};
+
+/*
+ * Closure without captured variables. One immortal instance exists per
+ * function, so retain and release are no-ops and nothing is allocated.
+ */
+template <typename T, typename... TArg>
+class StaticClosure : public Closure<T, TArg...>
+{
+  public:
+    StaticClosure(typename Closure<T, TArg...>::Function func) : Closure<T, TArg...>(func) {}
+    virtual void release() {}
+    virtual void retain() {}
+    virtual void unretain() {}
+    virtual int retainCount()
+    {
+        return 1;
+    }
+    template <typename Closure<T, TArg...>::Function func>
+    static Closure<T, TArg...> *get()
+    {
+        static StaticClosure v(func);
+        return &v;
+    }
+};
+
+template <class T = IObject>
+class Strong : public _Strong
+{
+  public:
+    Strong() : _Strong() {}
+    Strong(T object) : _Strong(object) {}
+    Strong(const Strong &ref) : _Strong(ref.get()) {}
+    T as()
+    {
+        return (T)get();
+    }
+    Strong &operator=(T object)
+    {
+        set((IObject *)object);
+        return *this;
+    }
+    Strong &operator=(Strong &ref)
+    {
+        set(ref.get());
+        return *this;
+    }
+    operator T()
+    {
+        return (T)get();
+    }
+};
+
+template <class T = IObject>
+class Weak : public _Weak
+{
+  public:
+    Weak() : _Weak() {}
+    Weak(T object) : _Weak(object) {}
+    Weak(const Weak &ref) : _Weak(ref.get()) {}
+    virtual T as()
+    {
+        return (T)get();
+    }
+    virtual Weak &operator=(T object)
+    {
+        set((kk::IObject *)object);
+        return *this;
+    }
+    virtual Weak &operator=(Weak &ref)
+    {
+        set(ref.get());
+        return *this;
+    }
+    virtual operator T()
+    {
+        return (T)get();
+    }
+    /*
+     * The object as an owned reference, or null. Without a Scope, get()
+     * can only lend the object; this stays valid whatever other owners do.
+     */
+    Strong<T> strong() const
+    {
+        IObject *v = _weakObject != nullptr ? _weakObject->get() : nullptr;
+        Strong<T> r((T)v);
+        if (v != nullptr)
+        {
+            v->release();
+        }
+        return r;
+    }
+};
+
+/*
+ * How a member of template parameter type T is stored by generated
+ * generic classes. Object pointers are held strongly, values as is.
+ */
+template <typename T, bool = std::is_convertible<T, IObject *>::value>
+struct Field
+{
+    typedef T type;
+};
+
+template <typename T>
+struct Field<T, true>
+{
+    typedef Strong<T> type;
+};
+
+/*
+ * Runs func over [0, length) on the shared scheduler, the calling thread
+ * included, and returns once every chunk has run. Chunks are claimed on
+ * demand and shrink as the range drains; with fixed set every chunk is
+ * exactly grain long, so chunk boundaries depend on length alone.
+ */
+typedef void (*ParallelFunc)(void *data, size_t begin, size_t end);
+extern void parallelRange(size_t length, size_t grain, bool fixed, ParallelFunc func, void *data);
+extern size_t parallelGrain(size_t length);
+
+extern void parallelFor(Int length, Closure<void, Int> *fn);
+
+/*
+ * Per-element output written by parallel chunks. std::vector<bool> packs
+ * bits, so neighbouring chunks would share words; bools are written to
+ * bytes and copied back once every chunk has run.
+ */
+template <typename T>
+struct _ParallelSlots
+{
+    typedef T type;
+    _ParallelSlots(std::vector<T> &vs) : _vs(vs) {}
+    T *data()
+    {
+        return _vs.data();
+    }
+    void commit() {}
+
+  private:
+    std::vector<T> &_vs;
+};
+
+template <>
+struct _ParallelSlots<bool>
+{
+    typedef char type;
+    _ParallelSlots(std::vector<bool> &vs) : _vs(vs), _slots(vs.size()) {}
+    char *data()
+    {
+        return _slots.data();
+    }
+    void commit()
+    {
+        for (size_t i = 0; i < _slots.size(); i++)
+        {
+            _vs[i] = _slots[i] != 0;
+        }
+    }
+
+  private:
+    std::vector<bool> &_vs;
+    std::vector<char> _slots;
+};
+
+template <typename T, typename R>
+struct _ParallelMap
+{
+    const std::vector<T> *source;
+    typename _ParallelSlots<R>::type *target;
+    Closure<R, T> *fn;
+    static void run(void *data, size_t begin, size_t end)
+    {
+        _ParallelMap *v = (_ParallelMap *)data;
+        for (size_t i = begin; i < end; i++)
+        {
+            v->target[i] = (*v->fn)((*v->source)[i]);
+        }
+    }
+};
+
+template <typename T, typename R>
+void parallelMap(Array<T> &source, Array<R> &target, Closure<R, T> *fn)
+{
+    Strong<Closure<R, T> *> ref(fn);
+    std::vector<R> &rs = target.mutate();
+    const std::vector<T> &vs = source.get();
+    rs.resize(vs.size());
+    _ParallelSlots<R> slots(rs);
+    _ParallelMap<T, R> data = {&vs, slots.data(), fn};
+    parallelRange(vs.size(), 1, false, _ParallelMap<T, R>::run, &data);
+    slots.commit();
+}
+
+/*
+ * Each fixed chunk is folded left to right from its first element and the
+ * chunk results are folded into initial in index order, so the result does
+ * not depend on the number of workers or on which one ran a chunk.
+ */
+template <typename T>
+struct _ParallelReduce
+{
+    const std::vector<T> *source;
+    typename _ParallelSlots<T>::type *results;
+    size_t grain;
+    Closure<T, T, T> *fn;
+    static void run(void *data, size_t begin, size_t end)
+    {
+        _ParallelReduce *v = (_ParallelReduce *)data;
+        T r = (*v->source)[begin];
+        for (size_t i = begin + 1; i < end; i++)
+        {
+            r = (*v->fn)(r, (*v->source)[i]);
+        }
+        v->results[begin / v->grain] = r;
+    }
+};
+
+template <typename T>
+T parallelReduce(Array<T> &source, T initial, Closure<T, T, T> *fn)
+{
+    Strong<Closure<T, T, T> *> ref(fn);
+    const std::vector<T> &vs = source.get();
+    size_t grain = parallelGrain(vs.size());
+    std::vector<T> results((vs.size() + grain - 1) / grain);
+    _ParallelSlots<T> slots(results);
+    _ParallelReduce<T> data = {&vs, slots.data(), grain, fn};
+    parallelRange(vs.size(), grain, true, _ParallelReduce<T>::run, &data);
+    slots.commit();
+    T r = initial;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        r = (*fn)(r, results[i]);
+    }
+    return r;
+}
+
+/*
+ * Parking for blocked channel operations. Waiters sleep until ready()
+ * holds; the ring operations themselves never take the lock, and notify()
+ * only does when someone is parked.
+ */
+class _ChannelWait
+{
+  public:
+    typedef bool (*Ready)(void *data);
+    _ChannelWait();
+    virtual ~_ChannelWait();
+    void wait(Ready ready, void *data);
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_waiters.load(std::memory_order_relaxed) > 0)
+        {
+            wake();
+        }
+    }
+
+  protected:
+    void wake();
+    std::atomic<int> _waiters;
+    ChannelLock *_lock;
+};
+
+/*
+ * A reference handed across threads. An object in flight holds exactly
+ * one reference, taken by the sender; the receiver gets it as is: handed
+ * to the current Scope, or with no Scope given back unowned like the
+ * result of new, for the first Strong that stores it to own.
+ */
+template <typename T, bool = std::is_convertible<T, IObject *>::value>
+struct _TransferRef
+{
+    static void retain(const T &v) {}
+    static void release(const T &v) {}
+    static void handoff(const T &v) {}
+};
+
+template <typename T>
+struct _TransferRef<T, true>
+{
+    static void retain(T v)
+    {
+        if (v != nullptr)
+        {
+            v->retain();
+        }
+    }
+    static void release(T v)
+    {
+        if (v != nullptr)
+        {
+            v->release();
+        }
+    }
+    static void handoff(T v)
+    {
+        if (v == nullptr)
+        {
+            return;
+        }
+        Scope *scope = Scope::current();
+        if (scope != nullptr)
+        {
+            scope->adoptObject(v);
+        }
+        else
+        {
+            v->unretain();
+        }
+    }
+};
+
+/*
+ * Members written by different threads are kept this far apart. kk objects
+ * come from _Object::operator new, which only guarantees the default
+ * alignment, so the gap is padding rather than alignas.
+ */
+#define KK_CACHE_LINE 64
+
+/*
+ * Bounded channel over a power-of-two ring. The default mode is a
+ * multi-producer multi-consumer ring where each cell carries a sequence
+ * number; with single set there must be one sender and one receiver, and
+ * the ring only publishes its head and tail indices.
+ */
+template <typename T>
+class Channel : public Object
+{
+  public:
+    Channel(Int capacity, Boolean single = false) : _single(single), _closed(false), _head(0), _tailCache(0), _tail(0), _headCache(0)
+    {
+        size_t n = 2;
+        while (n < (size_t)std::max(capacity, (Int)1))
+        {
+            n <<= 1;
+        }
+        _mask = n - 1;
+        _cells = new Cell[n];
+        for (size_t i = 0; i < n; i++)
+        {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    virtual ~Channel()
+    {
+        T v;
+        while (pop(v))
+        {
+            _TransferRef<T>::release(v);
+        }
+        delete[] _cells;
+    }
+
+    virtual Int capacity()
+    {
+        return (Int)(_mask + 1);
+    }
+
+    virtual Int length()
+    {
+        size_t t = _tail.load(std::memory_order_acquire);
+        size_t h = _head.load(std::memory_order_acquire);
+        return t > h ? (Int)(t - h) : 0;
+    }
+
+    virtual Boolean closed()
+    {
+        return _closed.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Wakes every blocked sender and receiver. Values already sent can
+     * still be received; further sends fail.
+     */
+    virtual void close()
+    {
+        _closed.store(true, std::memory_order_release);
+        _wait.notify();
+    }
+
+    virtual Boolean trySend(T v)
+    {
+        if (closed())
+        {
+            return false;
+        }
+        _TransferRef<T>::retain(v);
+        if (!push(v))
+        {
+            _TransferRef<T>::release(v);
+            return false;
+        }
+        _wait.notify();
+        return true;
+    }
+
+    virtual Boolean send(T v)
+    {
+        if (closed())
+        {
+            return false;
+        }
+        _TransferRef<T>::retain(v);
+        while (!push(v))
+        {
+            _wait.wait(canSend, this);
+            if (closed())
+            {
+                _TransferRef<T>::release(v);
+                return false;
+            }
+        }
+        _wait.notify();
+        return true;
+    }
+
+    /*
+     * Blocks until a value arrives. Returns T() once the channel is closed
+     * and drained.
+     */
+    virtual T receive()
+    {
+        T v;
+        bool last = false;
+        while (!pop(v))
+        {
+            if (last)
+            {
+                return T();
+            }
+            /* A value sent just before close() is still popped once more. */
+            last = closed();
+            if (!last)
+            {
+                _wait.wait(canReceive, this);
+            }
+        }
+        _wait.notify();
+        _TransferRef<T>::handoff(v);
+        return v;
+    }
+
+    /*
+     * Returns the next value without blocking, or T() when none is queued.
+     */
+    virtual T tryReceive()
+    {
+        T v;
+        if (!pop(v))
+        {
+            return T();
+        }
+        _wait.notify();
+        _TransferRef<T>::handoff(v);
+        return v;
+    }
+
+    /*
+     * Sends values in order and returns how many were sent. Without wait
+     * it stops at the first full slot; with wait it blocks for room and
+     * only stops early when the channel is closed.
+     */
+    virtual Int sendBatch(Array<T> &values, Boolean wait = true)
+    {
+        const std::vector<T> &vs = values.get();
+        size_t n = 0;
+        while (n < vs.size() && !closed())
+        {
+            _TransferRef<T>::retain(vs[n]);
+            if (push(vs[n]))
+            {
+                n++;
+                continue;
+            }
+            _TransferRef<T>::release(vs[n]);
+            if (!wait)
+            {
+                break;
+            }
+            _wait.notify();
+            _wait.wait(canSend, this);
+        }
+        if (n > 0)
+        {
+            _wait.notify();
+        }
+        return (Int)n;
+    }
+
+    /*
+     * Appends up to max values to target and returns how many were
+     * received. With wait it blocks until at least one value is available
+     * or the channel is closed and drained.
+     */
+    virtual Int receiveBatch(Array<T> &target, Int max, Boolean wait = true)
+    {
+        std::vector<T> &vs = target.mutate();
+        size_t n = 0;
+        bool last = false;
+        T v;
+        while (n < (size_t)std::max(max, (Int)0))
+        {
+            if (pop(v))
+            {
+                _TransferRef<T>::handoff(v);
+                vs.push_back(v);
+                n++;
+            }
+            else if (n == 0 && wait && !last)
+            {
+                last = closed();
+                if (!last)
+                {
+                    _wait.wait(canReceive, this);
+                }
+            }
+            else
+            {
+                break;
+            }
+        }
+        if (n > 0)
+        {
+            _wait.notify();
+        }
+        return (Int)n;
+    }
+
+  protected:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    static bool canSend(void *data)
+    {
+        Channel *v = (Channel *)data;
+        return v->closed() || v->_tail.load(std::memory_order_acquire) - v->_head.load(std::memory_order_acquire) <= v->_mask;
+    }
+
+    static bool canReceive(void *data)
+    {
+        Channel *v = (Channel *)data;
+        return v->closed() || v->_tail.load(std::memory_order_acquire) != v->_head.load(std::memory_order_acquire);
+    }
+
+    bool push(const T &v)
+    {
+        if (_single)
+        {
+            size_t t = _tail.load(std::memory_order_relaxed);
+            if (t - _headCache > _mask)
+            {
+                _headCache = _head.load(std::memory_order_acquire);
+                if (t - _headCache > _mask)
+                {
+                    return false;
+                }
+            }
+            _cells[t & _mask].value = v;
+            _tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &_cells[pos & _mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)pos;
+            if (dif == 0)
+            {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = v;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &v)
+    {
+        if (_single)
+        {
+            size_t h = _head.load(std::memory_order_relaxed);
+            if (h == _tailCache)
+            {
+                _tailCache = _tail.load(std::memory_order_acquire);
+                if (h == _tailCache)
+                {
+                    return false;
+                }
+            }
+            v = std::move(_cells[h & _mask].value);
+            _head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+        size_t pos = _head.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &_cells[pos & _mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+            if (dif == 0)
+            {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+        v = std::move(cell->value);
+        cell->seq.store(pos + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    Boolean _single;
+    std::atomic<bool> _closed;
+    Cell *_cells;
+    size_t _mask;
+    char _pad0[KK_CACHE_LINE];
+    std::atomic<size_t> _head;
+    size_t _tailCache;
+    char _pad1[KK_CACHE_LINE];
+    std::atomic<size_t> _tail;
+    size_t _headCache;
+    char _pad2[KK_CACHE_LINE];
+    _ChannelWait _wait;
+};
+
+/*
+ * Writer lock of one ConcurrentMap shard. It is held inline so the shard's
+ * padding covers it; writers spin briefly and then yield.
+ */
+class _ConcurrentLock
+{
+  public:
+    _ConcurrentLock() : _locked(false) {}
+    void lock()
+    {
+        bool v = false;
+        if (!_locked.compare_exchange_strong(v, true, std::memory_order_acquire))
+        {
+            wait();
+        }
+    }
+    void unlock()
+    {
+        _locked.store(false, std::memory_order_release);
+    }
+
+  protected:
+    void wait();
+    std::atomic<bool> _locked;
+};
+
+/*
+ * Hash map shared between threads, for kk.concurrentMap<K,V>. Keys are
+ * spread over a fixed set of shards. Each shard publishes an immutable
+ * HashTable snapshot: readers only pin the epoch and never write shared
+ * state, while a writer copies its shard's table under the shard lock,
+ * publishes the copy and retires the old one through the epoch. Suited to
+ * read-mostly maps; a write costs a copy of one shard. Object values are
+ * held strongly and returned with a reference handed to the current Scope.
+ */
+template <typename TKey, typename TValue>
+class ConcurrentMap : public Object
+{
+  public:
+    static const size_t Shards = 64;
+
+    virtual ~ConcurrentMap()
+    {
+        for (size_t i = 0; i < Shards; i++)
+        {
+            delete _shards[i].snapshot.load(std::memory_order_relaxed);
+        }
+    }
+
+    virtual Int size()
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < Shards; i++)
+        {
+            n += _shards[i].count.load(std::memory_order_relaxed);
+        }
+        return (Int)n;
+    }
+
+    virtual TValue get(const TKey &key)
+    {
+        Shard &shard = this->shard(key);
+        Atomic *a = atomic();
+        a->lock();
+        Snapshot *s = shard.snapshot.load(std::memory_order_acquire);
+        Entry *e = s == nullptr ? nullptr : s->table.find(key);
+        TValue v = e == nullptr ? TValue() : (TValue)e->value;
+        _TransferRef<TValue>::retain(v);
+        a->unlock();
+        _TransferRef<TValue>::handoff(v);
+        return v;
+    }
+
+    virtual Boolean has(const TKey &key)
+    {
+        Shard &shard = this->shard(key);
+        Atomic *a = atomic();
+        a->lock();
+        Snapshot *s = shard.snapshot.load(std::memory_order_acquire);
+        bool v = s != nullptr && s->table.find(key) != nullptr;
+        a->unlock();
+        return v;
+    }
+
+    /*
+     * The replaced value stays in the old snapshot and is released when
+     * that is reclaimed, never under the shard lock.
+     */
+    virtual void set(const TKey &key, TValue value)
+    {
+        Shard &shard = this->shard(key);
+        shard.lock.lock();
+        Snapshot *old = shard.snapshot.load(std::memory_order_relaxed);
+        Snapshot *s = old == nullptr ? new Snapshot() : new Snapshot(old->table);
+        s->table[key] = value;
+        publish(shard, s);
+        shard.lock.unlock();
+        retire(old);
+    }
+
+    virtual Boolean remove(const TKey &key)
+    {
+        Shard &shard = this->shard(key);
+        shard.lock.lock();
+        Snapshot *old = shard.snapshot.load(std::memory_order_relaxed);
+        if (old == nullptr || old->table.find(key) == nullptr)
+        {
+            shard.lock.unlock();
+            return false;
+        }
+        Snapshot *s = new Snapshot(old->table);
+        s->table.erase(key);
+        publish(shard, s);
+        shard.lock.unlock();
+        retire(old);
+        return true;
+    }
+
+    virtual void clear()
+    {
+        for (size_t i = 0; i < Shards; i++)
+        {
+            _shards[i].lock.lock();
+            Snapshot *old = _shards[i].snapshot.load(std::memory_order_relaxed);
+            publish(_shards[i], nullptr);
+            _shards[i].lock.unlock();
+            retire(old);
+        }
+    }
+
+    /*
+     * Visits every entry, one shard at a time. A shard's snapshot is copied
+     * while pinned and fn runs on the copy, so fn never holds back
+     * reclamation and writers may change any shard while it runs.
+     */
+    virtual void forEach(Closure<void, TValue, TKey> *fn)
+    {
+        Strong<Closure<void, TValue, TKey> *> ref(fn);
+        std::vector<std::pair<TKey, Value>> vs;
+        Atomic *a = atomic();
+        for (size_t i = 0; i < Shards; i++)
+        {
+            vs.clear();
+            a->lock();
+            Snapshot *s = _shards[i].snapshot.load(std::memory_order_acquire);
+            if (s != nullptr)
+            {
+                vs.reserve(s->table.size());
+                for (Entry &e : s->table)
+                {
+                    vs.push_back(std::make_pair(e.key, e.value));
+                }
+            }
+            a->unlock();
+            for (size_t j = 0; j < vs.size(); j++)
+            {
+                (*fn)((TValue)vs[j].second, vs[j].first);
+            }
+        }
+    }
+
+  protected:
+    typedef typename Field<TValue>::type Value;
+    typedef HashTable<TKey, Value> Table;
+    typedef typename Table::Entry Entry;
+
+    class Snapshot : public Object
+    {
+      public:
+        Snapshot() {}
+        Snapshot(const Table &table) : table(table) {}
+        Table table;
+    };
+
+    struct Shard
+    {
+        Shard() : snapshot(nullptr), count(0) {}
+        _ConcurrentLock lock;
+        std::atomic<Snapshot *> snapshot;
+        std::atomic<size_t> count;
+        char pad[KK_CACHE_LINE];
+    };
+
+    static void publish(Shard &shard, Snapshot *s)
+    {
+        shard.snapshot.store(s, std::memory_order_release);
+        shard.count.store(s == nullptr ? 0 : s->table.size(), std::memory_order_relaxed);
+    }
+
+    /*
+     * Readers may still be looking at the old snapshot, so it is freed by
+     * the epoch once they have all unpinned.
+     */
+    static void retire(Snapshot *s)
+    {
+        if (s != nullptr)
+        {
+            Atomic *a = atomic();
+            a->lock();
+            a->addObject(s);
+            a->unlock();
+        }
+    }
+
+    Shard &shard(const TKey &key)
+    {
+        return _shards[hashMix(Hash<TKey>()(key)) >> 58];
+    }
+
+    Shard _shards[Shards];
+};
+
+#if defined(__cpp_impl_coroutine)
+
+inline void _resume(void *address)
+{
+    std::coroutine_handle<>::from_address(address).resume();
+}
+
+struct _PromiseStart
+{
+    bool await_ready()
+    {
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        Scheduler::shared()->post(_resume, handle.address());
+    }
+    void await_resume() {}
+};
+
+template <typename T>
+class _PromiseValue : public _PromiseState
+{
+  public:
+    T get()
+    {
+        return value;
+    }
+    T value;
+};
+
+template <>
+class _PromiseValue<void> : public _PromiseState
+{
+  public:
+    void get() {}
+};
+
+template <typename T, typename TPromise>
+struct _PromiseReturn
+{
+    void return_value(T v)
+    {
+        static_cast<TPromise *>(this)->state->value = std::move(v);
+    }
+};
+
+template <typename TPromise>
+struct _PromiseReturn<void, TPromise>
+{
+    void return_void() {}
+};
+
+/*
+ * Result of a lowered TS async function. The coroutine body starts on the
+ * shared scheduler; co_await on a Promise suspends until it is done and
+ * resumes the awaiting coroutine on the scheduler. get() blocks instead.
+ */
+template <typename T>
+class Promise
+{
+  public:
+    struct promise_type : _PromiseReturn<T, promise_type>
+    {
+        promise_type() : state(new _PromiseValue<T>()) {}
+        ~promise_type()
+        {
+            state->release();
+        }
+        Promise get_return_object()
+        {
+            return Promise(state);
+        }
+        _PromiseStart initial_suspend()
+        {
+            return _PromiseStart();
+        }
+        std::suspend_never final_suspend() noexcept
+        {
+            state->done();
+            return std::suspend_never();
+        }
+        void unhandled_exception()
+        {
+            state->exception = std::current_exception();
+        }
+        _PromiseValue<T> *state;
+    };
+
+    Promise() : _state(nullptr) {}
+    Promise(_PromiseValue<T> *state) : _state(state)
+    {
+        _state->retain();
+    }
+    Promise(const Promise &v) : _state(v._state)
+    {
+        if (_state != nullptr)
+        {
+            _state->retain();
+        }
+    }
+    Promise(Promise &&v) noexcept : _state(v._state)
+    {
+        v._state = nullptr;
+    }
+    ~Promise()
+    {
+        if (_state != nullptr)
+        {
+            _state->release();
+        }
+    }
+    Promise &operator=(Promise v)
+    {
+        std::swap(_state, v._state);
+        return *this;
+    }
+    bool await_ready()
+    {
+        return _state->isDone();
+    }
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        return _state->wait(_resume, handle.address());
+    }
+    T await_resume()
+    {
+        if (_state->exception)
+        {
+            std::rethrow_exception(_state->exception);
+        }
+        return _state->get();
+    }
+    T get()
+    {
+        _state->join();
+        return await_resume();
+    }
+
+  protected:
+    _PromiseValue<T> *_state;
+};
+
+#else
+
+/*
+ * Generated async code needs C++20 coroutines; fail with a clear message
+ * instead of undefined names when it is built with an older standard.
+ */
+template <typename T>
+class Promise
+{
+    static_assert(std::is_same<T, T *>::value, "kk::Promise (TS async) needs C++20 coroutines, build with -std=c++20");
+};
+
+#endif
 
 } // namespace kk
 